@@ -0,0 +1,407 @@
+// Microbenchmarks for the connection layer.
+//
+//   ookoto_bench [--filter=<substring>] [--scale=<factor>]
+//
+// Every benchmark prints one JSON object per line to stdout, so runs of two
+// builds can be compared with any JSON tool. Latencies are per operation in
+// microseconds; items_per_sec counts rows for the batched benchmarks, and
+// mb_per_sec the input read by the import benchmarks.
+//
+// sqlite3 runs against a temporary file. mysql runs only when
+// OOKOTO_BENCH_MYSQL_DATABASE is set, using OOKOTO_BENCH_MYSQL_HOST, _PORT,
+// _USER and _PASSWORD for the rest of the connection settings.
+
+#include <cppformat/format.h>
+#include <ookoto/ookoto.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Connection = std::unique_ptr<ookoto::ConnectionInterface>;
+
+const int kScanWidths[] = {1, 8, 32};
+const std::size_t kBatchSizes[] = {10, 100, 1000};
+const std::size_t kImportThreads[] = {1, 0};
+
+std::string env(const char *name) {
+  auto value = std::getenv(name);
+  return (value) ? value : "";
+}
+
+class Bench {
+ public:
+  Bench(const ookoto::Config &config, const std::string &filter, double scale)
+      : _config(config), _filter(filter), _scale(scale) {}
+
+  void run_all() {
+    bench_connect_disconnect();
+    bench_create_table();
+    bench_insert_autocommit();
+    for (auto batch : kBatchSizes) {
+      bench_insert_transaction(batch);
+    }
+    for (auto width : kScanWidths) {
+      bench_scan(width);
+    }
+    for (auto threads : kImportThreads) {
+      bench_import(threads);
+    }
+  }
+
+ private:
+  ookoto::Config _config;
+  std::string _filter;
+  double _scale = 1;
+
+  std::size_t scaled(std::size_t count) const {
+    return std::max<std::size_t>(1, static_cast<std::size_t>(count * _scale));
+  }
+
+  bool selected(const std::string &name) const {
+    return _filter.empty() || name.find(_filter) != std::string::npos;
+  }
+
+  Connection connect() {
+    Connection conn;
+    auto result = ookoto::open_connection(_config, &conn);
+    if (!result.is_ok()) {
+      throw std::runtime_error("cannot connect to " + _config.driver);
+    }
+    return conn;
+  }
+
+  static void check(const ookoto::Status &result, const char *what) {
+    if (!result.is_ok() && !result.is_not_found()) {
+      throw std::runtime_error(what);
+    }
+  }
+
+  static void drop(ookoto::ConnectionInterface &conn,
+                   const std::string &table) {
+    conn.execute_sql(fmt::format("DROP TABLE IF EXISTS {}", table));
+  }
+
+  // times op once per iteration and prints the distribution
+  void measure(const std::string &name, std::size_t ops,
+               std::size_t items_per_op, const std::function<void()> &op,
+               std::size_t bytes_per_op = 0) {
+    std::vector<double> samples;
+    samples.reserve(ops);
+
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < ops; i++) {
+      auto begin = Clock::now();
+      op();
+      samples.push_back(
+          std::chrono::duration<double, std::micro>(Clock::now() - begin)
+              .count());
+    }
+    auto seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::sort(samples.begin(), samples.end());
+    auto ops_per_sec = (0 < seconds) ? ops / seconds : 0;
+    fmt::print(
+        "{{\"benchmark\":\"{}\",\"driver\":\"{}\",\"ops\":{},"
+        "\"items_per_op\":{},\"seconds\":{:.6f},\"ops_per_sec\":{:.1f},"
+        "\"items_per_sec\":{:.1f},\"p50_us\":{:.1f},\"p90_us\":{:.1f},"
+        "\"p99_us\":{:.1f},\"max_us\":{:.1f}{}}}\n",
+        name, _config.driver, ops, items_per_op, seconds, ops_per_sec,
+        ops_per_sec * items_per_op, percentile(samples, 0.50),
+        percentile(samples, 0.90), percentile(samples, 0.99),
+        samples.back(),
+        (0 < bytes_per_op)
+            ? fmt::format(",\"mb_per_sec\":{:.1f}",
+                          ops_per_sec * bytes_per_op / (1024 * 1024))
+            : "");
+    std::fflush(stdout);
+  }
+
+  // nearest-rank percentile of sorted samples
+  static double percentile(const std::vector<double> &samples, double p) {
+    auto rank = static_cast<std::size_t>(std::ceil(p * samples.size()));
+    return samples[std::min(samples.size(), std::max<std::size_t>(rank, 1)) -
+                   1];
+  }
+
+  static std::shared_ptr<ookoto::Schema> insert_schema() {
+    auto schema = std::make_shared<ookoto::Schema>();
+    schema->define_table_name("bench_insert");
+    schema->define_column("id", ookoto::Schema::Type::kInteger);
+    schema->define_column("name", ookoto::Schema::Type::kText);
+    schema->define_column("score", ookoto::Schema::Type::kFloat);
+    return schema;
+  }
+
+  static std::string insert_sql(std::size_t i) {
+    return fmt::format(
+        "INSERT INTO bench_insert (id, name, score) VALUES ({}, 'name-{}', {})",
+        i, i, i * 0.5);
+  }
+
+  void bench_connect_disconnect() {
+    auto name = "connect_disconnect";
+    if (!selected(name)) {
+      return;
+    }
+
+    measure(name, scaled(200), 1, [&]() { connect()->disconnect(); });
+  }
+
+  void bench_create_table() {
+    auto name = "create_table";
+    if (!selected(name)) {
+      return;
+    }
+
+    auto conn = connect();
+    auto schema = std::make_shared<ookoto::Schema>();
+    schema->define_table_name("bench_create");
+    schema->define_column("id", ookoto::Schema::Type::kInteger);
+    schema->define_column("name", ookoto::Schema::Type::kText);
+    schema->define_column("score", ookoto::Schema::Type::kFloat);
+    schema->define_column("active", ookoto::Schema::Type::kBoolean);
+    schema->define_column("payload", ookoto::Schema::Type::kBinary);
+    schema->define_column("birthday", ookoto::Schema::Type::kDate);
+    schema->define_timestamps();
+
+    drop(*conn, schema->table_name());
+    measure(name, scaled(200), 1, [&]() {
+      check(conn->create_table(schema), "create_table failed");
+      // dropping is part of every iteration but rarely dominates it
+      check(conn->drop_table(schema->table_name()), "drop_table failed");
+    });
+    conn->disconnect();
+  }
+
+  void bench_insert_autocommit() {
+    auto name = "insert_autocommit";
+    if (!selected(name)) {
+      return;
+    }
+
+    auto conn = connect();
+    auto schema = insert_schema();
+    drop(*conn, schema->table_name());
+    check(conn->create_table(schema), "create_table failed");
+
+    std::size_t i = 0;
+    measure(name, scaled(1000), 1, [&]() {
+      check(conn->execute_sql(insert_sql(i++)), "insert failed");
+    });
+
+    drop(*conn, schema->table_name());
+    conn->disconnect();
+  }
+
+  void bench_insert_transaction(std::size_t batch) {
+    auto name = fmt::format("insert_transaction_{}", batch);
+    if (!selected(name)) {
+      return;
+    }
+
+    auto conn = connect();
+    auto schema = insert_schema();
+    drop(*conn, schema->table_name());
+    check(conn->create_table(schema), "create_table failed");
+
+    std::size_t i = 0;
+    auto ops = std::max<std::size_t>(1, scaled(10000) / batch);
+    measure(name, ops, batch, [&]() {
+      auto result = conn->transaction([&]() {
+        for (std::size_t n = 0; n < batch; n++) {
+          auto result = conn->execute_sql(insert_sql(i++));
+          if (!result.is_ok()) {
+            return result;
+          }
+        }
+        return ookoto::Status::ok();
+      });
+      check(result, "transaction failed");
+    });
+
+    drop(*conn, schema->table_name());
+    conn->disconnect();
+  }
+
+  void bench_scan(int width) {
+    auto view_name = fmt::format("scan_row_view_{}cols", width);
+    auto map_name = fmt::format("scan_row_type_{}cols", width);
+    auto batch_name = fmt::format("scan_row_batch_{}cols", width);
+    if (!selected(view_name) && !selected(map_name) && !selected(batch_name)) {
+      return;
+    }
+
+    auto conn = connect();
+    auto schema = std::make_shared<ookoto::Schema>();
+    schema->define_table_name("bench_scan");
+    for (int c = 0; c < width; c++) {
+      schema->define_column(fmt::format("c{}", c),
+                            ookoto::Schema::Type::kText);
+    }
+    drop(*conn, schema->table_name());
+    check(conn->create_table(schema), "create_table failed");
+
+    auto rows = scaled(10000);
+    std::vector<ookoto::Appender::Row> values(
+        rows, ookoto::Appender::Row(width, "0123456789abcdef"));
+    check(conn->bulk_insert(schema, values), "bulk_insert failed");
+
+    auto sql = fmt::format("SELECT * FROM {}", schema->table_name());
+    auto ops = scaled(20);
+    std::size_t bytes = 0;
+    if (selected(view_name)) {
+      measure(view_name, ops, rows, [&]() {
+        check(conn->execute_sql_for_each(
+                  sql,
+                  [&](const ookoto::RowView &row) { bytes += row[0].size(); }),
+              "scan failed");
+      });
+    }
+    if (selected(map_name)) {
+      measure(map_name, ops, rows, [&]() {
+        check(conn->execute_sql_for_each(
+                  sql,
+                  [&](const ookoto::ConnectionInterface::RowType &row) {
+                    bytes += row.size();
+                  }),
+              "scan failed");
+      });
+    }
+    if (selected(batch_name)) {
+      measure(batch_name, ops, rows, [&]() {
+        check(conn->execute_sql_for_each_batch(
+                  sql, 1024,
+                  [&](const ookoto::RowBatch &batch) {
+                    for (std::size_t i = 0; i < batch.size(); i++) {
+                      bytes += batch[i][0].size();
+                    }
+                  }),
+              "scan failed");
+      });
+    }
+
+    drop(*conn, schema->table_name());
+    conn->disconnect();
+  }
+
+  // imports a generated TSV file into a fresh table on every iteration;
+  // threads 0 parses on every hardware thread
+  void bench_import(std::size_t threads) {
+    auto name = (threads == 0) ? std::string("import_tsv")
+                               : fmt::format("import_tsv_{}thread", threads);
+    if (!selected(name)) {
+      return;
+    }
+
+    auto tmpdir = env("TMPDIR");
+    auto path = fmt::format("{}/ookoto-bench-XXXXXX",
+                            tmpdir.empty() ? "/tmp" : tmpdir);
+    auto fd = mkstemp(&path[0]);
+    if (fd < 0) {
+      throw std::runtime_error("cannot create a temporary file");
+    }
+    auto rows = scaled(200000);
+    auto file = fdopen(fd, "w");
+    for (std::size_t i = 0; i < rows; i++) {
+      fmt::print(file, "{}\tname-{}\t{}\n", i, i, i * 0.5);
+    }
+    std::fclose(file);
+    std::size_t bytes = 0;
+    if (auto in = std::fopen(path.c_str(), "r")) {
+      std::fseek(in, 0, SEEK_END);
+      bytes = static_cast<std::size_t>(std::ftell(in));
+      std::fclose(in);
+    }
+
+    auto conn = connect();
+    auto schema = insert_schema();
+    ookoto::ImportOptions options;
+    options.threads = threads;
+    measure(name, scaled(5), rows, [&]() {
+      drop(*conn, schema->table_name());
+      check(conn->create_table(schema), "create_table failed");
+      check(ookoto::import_file(conn.get(), path, schema, options),
+            "import_file failed");
+    }, bytes);
+
+    drop(*conn, schema->table_name());
+    conn->disconnect();
+    std::remove(path.c_str());
+  }
+};
+
+void run(const ookoto::Config &config, const std::string &filter,
+         double scale) {
+  try {
+    Bench(config, filter, scale).run_all();
+  } catch (const std::exception &e) {
+    fmt::print(stderr, "{}: {}\n", config.driver, e.what());
+  }
+}
+}
+
+int main(int argc, char **argv) {
+  std::string filter;
+  double scale = 1;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--filter=", 9) == 0) {
+      filter = argv[i] + 9;
+    } else if (std::strncmp(argv[i], "--scale=", 8) == 0) {
+      scale = std::atof(argv[i] + 8);
+    } else {
+      fmt::print(stderr, "usage: {} [--filter=<substring>] [--scale=<factor>]\n",
+                 argv[0]);
+      return 1;
+    }
+  }
+  if (scale <= 0) {
+    scale = 1;
+  }
+
+  auto tmpdir = env("TMPDIR");
+  auto path = fmt::format("{}/ookoto-bench-XXXXXX",
+                          tmpdir.empty() ? "/tmp" : tmpdir);
+  auto fd = mkstemp(&path[0]);
+  if (fd < 0) {
+    fmt::print(stderr, "cannot create a temporary database: {}\n", path);
+    return 1;
+  }
+  close(fd);
+
+  ookoto::Config sqlite;
+  sqlite.driver = "sqlite3";
+  sqlite.database = path;
+  run(sqlite, filter, scale);
+  std::remove(path.c_str());
+
+  if (!env("OOKOTO_BENCH_MYSQL_DATABASE").empty()) {
+#ifdef OOKOTO_WITHOUT_MYSQL
+    fmt::print(stderr, "mysql: this build has no mysql driver\n");
+#else
+    ookoto::Config mysql;
+    mysql.driver = "mysql";
+    mysql.host = env("OOKOTO_BENCH_MYSQL_HOST");
+    mysql.port = env("OOKOTO_BENCH_MYSQL_PORT");
+    mysql.username = env("OOKOTO_BENCH_MYSQL_USER");
+    mysql.password = env("OOKOTO_BENCH_MYSQL_PASSWORD");
+    mysql.database = env("OOKOTO_BENCH_MYSQL_DATABASE");
+    run(mysql, filter, scale);
+#endif
+  }
+
+  return 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ @struct BulkInsertOptions
+
+ Appender および ConnectionInterface::bulk_insert に渡す設定です。
+ */
+struct BulkInsertOptions {
+  /**
+   まとめて書き込む最大行数を指定します
+
+   sqlite3 では 1 トランザクション、mysql では 1 つの INSERT 文に含める行数です。
+   */
+  std::size_t chunk_size = 1000;
+
+  /**
+   1 つの INSERT 文の最大バイト数を指定します。
+   0 を指定するとサーバーの max_allowed_packet を使います
+
+   対応するドライバ:
+   - mysql
+   */
+  std::size_t max_packet_size = 0;
+};
+
+/**
+ @struct BulkInsertStats
+
+ Appender が書き込んだ行数と所要時間です。
+ */
+struct BulkInsertStats {
+  /**
+   書き込みを確定した行数です
+   */
+  uint64_t rows = 0;
+
+  /**
+   発行したチャンク (トランザクションあるいは INSERT 文) の数です
+   */
+  uint64_t chunks = 0;
+
+  /**
+   最初の append から最後のチャンクの確定までの秒数です
+   */
+  double seconds = 0;
+
+  double rows_per_second() const { return (0 < seconds) ? rows / seconds : 0; }
+};
+
+/**
+ @class Appender
+
+ Schema に従って 1 つのテーブルに大量の行を書き込みます。
+
+ 行は Schema に定義した順のカラムの値で表現します。
+ ただし auto increment なカラムは含めません。
+ 文字列型以外のカラムでは空文字列を NULL として扱います。
+
+ ConnectionInterface::create_appender で取得します。
+ 破棄する際に未確定の行を書き込みますが、結果を確認するには flush
+ を呼び出してください。
+ 先にコネクションを切断した場合、未確定の行は破棄され、以降の操作は失敗します。
+ */
+class Appender {
+ public:
+  using Row = std::vector<std::string>;
+
+  virtual ~Appender() = default;
+
+  /**
+   row を追加します。チャンクが一杯になると書き込みを確定します
+
+   失敗した場合、確定していないチャンクの行は破棄されます。
+
+   @see Status
+   */
+  virtual Status append(const Row &row) = 0;
+
+  /**
+   確定していない行を書き込みます
+
+   @see Status
+   */
+  virtual Status flush() = 0;
+
+  /**
+   これまでに書き込んだ行数と所要時間を返します
+
+   @see BulkInsertStats
+   */
+  virtual BulkInsertStats stats() const = 0;
+};
+}
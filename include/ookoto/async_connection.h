@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "connection_interface.h"
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ @struct AsyncConnectionStats
+
+ AsyncConnection の実行状況です。
+ */
+struct AsyncConnectionStats {
+  /**
+   受け付けたタスクの数です
+   */
+  uint64_t submitted = 0;
+
+  /**
+   実行を終えたタスクの数です
+   */
+  uint64_t completed = 0;
+
+  /**
+   実行スレッドがキューをまとめて取り出した回数です
+
+   completed / batches が大きいほど、タスクが続けて実行されています。
+   */
+  uint64_t batches = 0;
+
+  /**
+   キューに溜まったタスク数の最大値です
+   */
+  std::size_t peak_queue_depth = 0;
+};
+
+/**
+ @class AsyncConnection
+
+ コネクションを専用の実行スレッドに持たせ、クエリを非同期に実行します。
+
+ 投入したタスクはキューに積まれ、実行スレッドが投入順に続けて実行します。
+ 結果は std::future で受け取ります。
+ コールバックや transaction の関数は実行スレッドで呼び出されます。
+
+ 破棄する際はキューに残っているタスクをすべて実行してからスレッドを終了します。
+ コネクションを同時に他のスレッドから使用しないでください。
+
+ @code
+ ookoto::AsyncConnection async(std::move(conn));
+ auto inserted = async.execute_sql("INSERT INTO users (name) VALUES ('a')");
+ auto counted = async.execute_sql_for_each(
+     "SELECT COUNT(*) FROM users", [&](const ookoto::RowView &row) { ... });
+ inserted.get();
+ counted.get();
+ @endcode
+ */
+class AsyncConnection {
+ public:
+  using Task = std::function<Status(ConnectionInterface &)>;
+
+  /**
+   接続済みの connection を引き受け、実行スレッドを開始します
+   */
+  explicit AsyncConnection(std::unique_ptr<ConnectionInterface> connection);
+  ~AsyncConnection();
+
+  /**
+   ConnectionInterface::execute_sql をキューに積みます
+   */
+  std::future<Status> execute_sql(const std::string &sql);
+
+  /**
+   ConnectionInterface::execute_sql_for_each をキューに積みます
+
+   fn は実行スレッドから呼び出されます。
+   */
+  std::future<Status> execute_sql_for_each(
+      const std::string &sql, const std::function<void(const RowView &)> &fn);
+
+  /**
+   ConnectionInterface::transaction をキューに積みます
+
+   t にはコネクションが渡されます。t の中でこのオブジェクトの future を待たないでください。
+   */
+  std::future<Status> transaction(const Task &t);
+
+  /**
+   任意の処理をキューに積みます
+   */
+  std::future<Status> submit(const Task &task);
+
+  /**
+   sqls を 1 度にキューへ積みます
+
+   実行スレッドは 1 回の起床で続けて実行します。
+   失敗した SQL があっても残りを実行します。
+   */
+  std::vector<std::future<Status>> pipeline(const std::vector<std::string> &sqls);
+
+  /**
+   これまでに投入したタスクがすべて終わるまで待ちます
+   */
+  void wait();
+
+  AsyncConnectionStats stats() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> _impl;
+};
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ @struct BackupProgress
+
+ バックアップの進み具合です。sqlite3 が報告するページ数で表します。
+ */
+struct BackupProgress {
+  /**
+   まだ複写していないページ数です
+   */
+  int64_t remaining = 0;
+
+  /**
+   複写元のページ数です。複写中に複写元が大きくなると増えます
+   */
+  int64_t total = 0;
+
+  double ratio() const {
+    return (0 < total) ? static_cast<double>(total - remaining) / total : 0;
+  }
+};
+
+/**
+ @struct BackupOptions
+
+ SqliteConnection::backup_to に渡す設定です。
+ */
+struct BackupOptions {
+  /**
+   1 回に複写するページ数です。0 以下ならすべてのページを 1 回で複写します
+
+   複写している間は同じコネクションへの書き込みを待たせるため、
+   小さくするほど書き込みの待ち時間は短くなります。
+   */
+  int pages_per_step = 256;
+
+  /**
+   複写の合間に待つ時間 (マイクロ秒) です。0 なら待たずに次を複写します
+   */
+  int64_t step_interval = 0;
+
+  /**
+   指定すると複写する度に進み具合を渡して呼び出します
+
+   バックアップを実行するスレッドから呼び出されます。
+   */
+  std::function<void(const BackupProgress &)> progress;
+};
+
+/**
+ @class BackupTask
+
+ 別スレッドで実行中のバックアップです。
+ SqliteConnection::backup_to で取得します。
+
+ 破棄すると実行中のバックアップを中断して終了を待ちます。
+ */
+class BackupTask {
+ public:
+  virtual ~BackupTask() = default;
+
+  /**
+   バックアップが終わるまで待ち、その結果を返します
+
+   @retval Status::ok すべてのページを複写した
+   @retval Status::status_ailment 失敗した、あるいは中断した
+   */
+  virtual Status wait() = 0;
+
+  /**
+   バックアップを中断します。複写先はバックアップを始める前の状態に戻ります
+   */
+  virtual void cancel() = 0;
+
+  /**
+   バックアップが終わっていれば true を返します
+   */
+  virtual bool done() const = 0;
+
+  /**
+   最後に複写した時点の進み具合を返します
+   */
+  virtual BackupProgress progress() const = 0;
+};
+}
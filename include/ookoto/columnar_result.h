@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "row_view.h"
+
+namespace ookoto {
+
+class ColumnarBuilder;
+
+/**
+ @class ColumnarResult
+
+ 結果セットをカラム毎の連続した配列として保持します。
+
+ 数値のカラムは int64_t あるいは double の配列に、
+ 文字列とバイナリのカラムは 1 つのバッファ (アリーナ) とオフセットの配列に格納します。
+ NULL はカラム毎のビットマップで表現します。
+ */
+class ColumnarResult {
+ public:
+  /**
+   カラムの型です
+
+   sqlite3 では最初の NULL でない値のストレージクラスから、
+   mysql では MYSQL_FIELD::type から決まります。
+   sqlite3 で異なるストレージクラスの値が混在する場合は、値を失わない型に変えます。
+   kInteger は kReal に、数値は kText あるいは kBlob に (それまでの値は文字列にします)、
+   kText は kBlob に変わります。
+   */
+  enum class Type {
+    kNull,
+    kInteger,
+    kReal,
+    kText,
+    kBlob,
+  };
+
+  class Column {
+   public:
+    const std::string &name() const { return _name; }
+    Type type() const { return _type; }
+
+    /**
+     行数を返します
+     */
+    std::size_t size() const { return _size; }
+
+    /**
+     NULL の行数を返します
+     */
+    std::size_t null_count() const { return _null_count; }
+
+    bool is_null(std::size_t row) const {
+      return (_nulls[row / 8] >> (row % 8)) & 1;
+    }
+
+    /**
+     kInteger のカラムの値の配列を返します。NULL の行は 0 です
+     */
+    const std::vector<int64_t> &integers() const { return _integers; }
+
+    /**
+     kReal のカラムの値の配列を返します。NULL の行は 0 です
+     */
+    const std::vector<double> &reals() const { return _reals; }
+
+    /**
+     kText あるいは kBlob のカラムの row 行目の値を返します。NULL の行は空です
+     */
+    StringView bytes(std::size_t row) const {
+      return StringView(_arena.data() + _offsets[row],
+                        _offsets[row + 1] - _offsets[row]);
+    }
+
+   private:
+    friend class ColumnarBuilder;
+
+    std::string _name;
+    Type _type = Type::kNull;
+    std::size_t _size = 0;
+    std::size_t _null_count = 0;
+    std::vector<uint8_t> _nulls;
+    std::vector<int64_t> _integers;
+    std::vector<double> _reals;
+    std::vector<char> _arena;
+    std::vector<uint64_t> _offsets;
+  };
+
+  /**
+   行数を返します
+   */
+  std::size_t row_count() const { return _row_count; }
+
+  std::size_t column_count() const { return _columns.size(); }
+
+  const Column &column(std::size_t index) const { return _columns[index]; }
+
+  /**
+   name のカラム位置を返します。存在しなければ RowView::kNotFound を返します
+   */
+  int index_of(const std::string &name) const {
+    for (std::size_t i = 0; i < _columns.size(); i++) {
+      if (_columns[i].name() == name) {
+        return static_cast<int>(i);
+      }
+    }
+    return RowView::kNotFound;
+  }
+
+ private:
+  friend class ColumnarBuilder;
+
+  std::size_t _row_count = 0;
+  std::vector<Column> _columns;
+};
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <limits>
 #include <map>
 #include <memory>
@@ -7,6 +9,180 @@
 
 namespace ookoto {
 
+class Profiler;
+class QueryLogger;
+class ResultCache;
+
+/**
+ @struct SqliteOptions
+
+ sqlite3 の接続時に適用する設定です。
+
+ profile で設定の組み合わせを選び、個別の項目で上書きします。
+ 空文字列あるいは kDefault の項目はプロファイルの値、
+ プロファイルにも無ければ sqlite3 の既定値を使います。
+
+ profile には以下を指定できます。
+ - durable: WAL, synchronous=FULL
+ - balanced: WAL, synchronous=NORMAL, 64MiB のページキャッシュ, 256MiB の mmap
+ - bulk-load: メモリ上のジャーナル, synchronous=OFF, 256MiB のページキャッシュ
+ - read-only-mmap: 読み取り専用, 1GiB の mmap
+ */
+struct SqliteOptions {
+  static const int64_t kDefault = std::numeric_limits<int64_t>::min();
+
+  /**
+   設定の組み合わせの名前を指定します
+   */
+  std::string profile;
+
+  /**
+   PRAGMA journal_mode の値 (DELETE, TRUNCATE, PERSIST, MEMORY, WAL, OFF) です
+   */
+  std::string journal_mode;
+
+  /**
+   PRAGMA synchronous の値 (OFF, NORMAL, FULL, EXTRA) です
+   */
+  std::string synchronous;
+
+  /**
+   PRAGMA cache_size の値です。負の値は KiB 単位の大きさを表します
+   */
+  int64_t cache_size = kDefault;
+
+  /**
+   PRAGMA mmap_size の値 (バイト) です
+   */
+  int64_t mmap_size = kDefault;
+
+  /**
+   PRAGMA page_size の値 (バイト) です。データベースを作成する前にだけ有効です
+   */
+  int64_t page_size = kDefault;
+
+  /**
+   PRAGMA temp_store の値 (DEFAULT, FILE, MEMORY) です
+   */
+  std::string temp_store;
+
+  /**
+   ロックの解放を待つ最大時間 (ミリ秒) です
+   */
+  int64_t busy_timeout = kDefault;
+
+  /**
+   読み取り専用で開きます。プロファイルの指定と論理和をとります
+   */
+  bool read_only = false;
+
+  /**
+   コネクション内部の排他制御を省きます (SQLITE_OPEN_NOMUTEX)。
+   コネクションを同時に複数のスレッドから使用しない場合に指定してください
+   */
+  bool no_mutex = false;
+
+  /**
+   読み取り専用のコネクションの数を指定します。0 なら 1 つのコネクションですべてを実行します
+
+   1 以上を指定すると journal_mode を WAL にし、書き込み用のコネクションとは別に
+   readers 個の読み取り専用のコネクションを開きます。
+   execute_sql_for_each, execute_sql_for_each_batch と execute_sql_columnar は空いている読み取り用のコネクションで、
+   それ以外の操作は書き込み用のコネクションで実行します。
+   transaction の中から読み取った場合は、未確定の書き込みが見えるよう書き込み用のコネクションを使います。
+
+   このとき SqliteConnection は複数のスレッドから呼び出せます。
+   ただし prepare, query, create_appender が返すオブジェクトは書き込み用のコネクションを使うため、
+   使用中に他のスレッドから書き込まないでください。
+   */
+  std::size_t readers = 0;
+
+  /**
+   複数のスレッドから同時に呼び出された transaction を 1 つにまとめてコミットする最大数を指定します。
+   0 あるいは 1 ならまとめません
+
+   2 以上を指定すると、transaction は待っている他の transaction と 1 つの物理的なトランザクションの中で、
+   それぞれ SAVEPOINT を切って実行されます。失敗した transaction はその SAVEPOINT まで巻き戻すため、
+   他の transaction には影響しません。コミットが終わるとそれぞれの呼び出し元に結果を返します。
+
+   まとめた transaction の関数は、最初に待ち始めたスレッドから順に呼び出されます。
+   呼び出し元とは別のスレッドで実行されることがあるため、スレッドローカルな状態に依存しないでください。
+   */
+  std::size_t group_commit_size = 0;
+
+  /**
+   まとめる transaction が group_commit_size に達するまで待つ最大時間 (マイクロ秒) です
+
+   0 なら待たず、前のコミットの間に溜まった transaction だけをまとめます。
+   */
+  int64_t group_commit_window = 0;
+};
+
+/**
+ mysql から結果を受け取る方法です
+ */
+enum class MysqlFetchMode {
+  /**
+   mysql_use_result で 1 行ずつ受け取ります。
+   メモリは節約できますが、コールバックが終わるまでサーバの資源を保持します。
+   */
+  kStream,
+
+  /**
+   mysql_store_result ですべての行を受け取ってからコールバックを呼び出します
+   */
+  kBuffer,
+
+  /**
+   別スレッドで budget バイトまで先読みしながらコールバックを呼び出します。
+   先読みが budget を超えるとコールバックの進みに合わせて受け取ります。
+   */
+  kHybrid,
+};
+
+/**
+ @struct MysqlFetchOptions
+
+ MysqlConnection::execute_sql_for_each で結果を受け取る方法です。
+ */
+struct MysqlFetchOptions {
+  MysqlFetchMode mode = MysqlFetchMode::kStream;
+
+  /**
+   kHybrid で先読みして保持する行の大きさ (バイト) の上限です
+   */
+  std::size_t budget = 16 * 1024 * 1024;
+
+  /**
+   kHybrid で先読みした行をコールバックに渡す単位 (バイト) です
+   */
+  std::size_t chunk_size = 256 * 1024;
+};
+
+/**
+ @struct MysqlOptions
+
+ mysql の接続時に適用する設定です。
+ */
+struct MysqlOptions {
+  /**
+   複数のステートメントを 1 回の通信で送信できるように接続します (CLIENT_MULTI_STATEMENTS)
+
+   指定しなくても MysqlConnection::execute_batch は使えますが、
+   バッチ毎に設定を切り替えるための通信が 2 回増えます。
+   指定すると execute_sql にも複数のステートメントを渡せるようになるため、
+   外部から受け取った文字列をそのまま SQL に埋め込まないでください。
+   */
+  bool multi_statements = false;
+
+  /**
+   execute_sql_for_each で結果を受け取る方法の既定値です
+
+   @see MysqlFetchOptions
+   */
+  MysqlFetchOptions fetch;
+};
+
 /**
  @struct Config
 
@@ -60,5 +236,72 @@ struct Config {
    - mysql
    */
   std::string password;
+
+  /**
+   コネクション毎にキャッシュするコンパイル済みステートメントの最大数を指定します。
+   0 を指定するとキャッシュしません
+
+   対応するドライバ:
+   - mysql
+   - sqlite3
+   */
+  std::size_t statement_cache_capacity = 64;
+
+  /**
+   実行した SQL を記録するロガーを指定します。指定しなければ記録しません
+
+   対応するドライバ:
+   - mysql
+   - sqlite3
+
+   @see QueryLogger
+   */
+  std::shared_ptr<QueryLogger> query_logger;
+
+  /**
+   execute_sql_cached の結果を保持するキャッシュを指定します。指定しなければキャッシュしません
+
+   同じ Config から生成したコネクションは同じキャッシュを共有します。
+
+   対応するドライバ:
+   - mysql
+   - sqlite3
+
+   @see ResultCache
+   */
+  std::shared_ptr<ResultCache> result_cache;
+
+  /**
+   SQL 毎の実行時間と実行計画を集計するプロファイラを指定します。指定しなければ集計しません
+
+   同じ Config から生成したコネクションは同じプロファイラに記録します。
+
+   対応するドライバ:
+   - mysql
+   - sqlite3
+
+   @see Profiler
+   */
+  std::shared_ptr<Profiler> profiler;
+
+  /**
+   sqlite3 の性能に関わる設定を指定します
+
+   対応するドライバ:
+   - sqlite3
+
+   @see SqliteOptions
+   */
+  SqliteOptions sqlite;
+
+  /**
+   mysql の接続に関わる設定を指定します
+
+   対応するドライバ:
+   - mysql
+
+   @see MysqlOptions
+   */
+  MysqlOptions mysql;
 };
 }
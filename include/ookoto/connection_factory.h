@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+#include "config.h"
+#include "connection_interface.h"
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ config.driver に対応するコネクションを生成し、接続した上で connection に格納します
+
+ @param config 接続先を指定してください
+ @param connection 接続したコネクションの格納先を指定してください
+ @retval Status::invalid_argument config.driver がサポートされていない
+ @see Config
+ @see Status
+ */
+Status open_connection(const Config &config,
+                       std::unique_ptr<ConnectionInterface> *connection);
+}
@@ -3,9 +3,19 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
+#include "appender.h"
+#include "columnar_result.h"
 #include "config.h"
+#include "cursor.h"
+#include "prepared_statement.h"
+#include "result_cache.h"
+#include "row_batch.h"
+#include "row_mapping.h"
+#include "row_view.h"
 #include "schema.h"
 #include "status.h"
+#include "value.h"
 
 namespace ookoto {
 
@@ -60,11 +70,25 @@ class ConnectionInterface {
   /**
    テーブルを生成します
 
+   Schema で定義した主キーとストレージの設定を反映し、
+   set_deferred を指定していないインデックスを作成します。
+
    @see Schema
    @see Status
    */
   virtual Status create_table(std::shared_ptr<Schema> schema) = 0;
 
+  /**
+   Schema::Index::set_deferred で定義したインデックスを作成します
+
+   大量のデータを読み込む場合は、create_table の後でデータを読み込んでから呼び出してください。
+   作成済みのインデックスは作成しません。
+
+   @see Schema
+   @see Status
+   */
+  virtual Status create_indexes(std::shared_ptr<Schema> schema) = 0;
+
   /**
    テーブルを削除します
 
@@ -106,6 +130,231 @@ class ConnectionInterface {
       const std::string &sql,
       const std::function<void(const RowType &)> &fn) = 0;
 
+  /**
+   sql を実行し、取得した 1 レコード毎に fn を呼び出します
+
+   RowType 版と異なり、レコード毎のコピーを行わずドライバのバッファを直接参照します。
+   RowView およびその値はコールバックから戻るまでの間だけ有効です。
+
+   @param sql 実行する SQL ステートメントを指定してください
+   @param fn コールバックする関数を指定してください
+   @see RowView
+   @see Status
+   */
+  virtual Status execute_sql_for_each(
+      const std::string &sql,
+      const std::function<void(const RowView &)> &fn) = 0;
+
+  /**
+   sql を実行し、取得した 1 レコード毎に fn を呼び出します
+
+   値を文字列に変換せず、ドライバのネイティブな型のまま読み出す場合に使います。
+
+   @param sql 実行する SQL ステートメントを指定してください
+   @param fn コールバックする関数を指定してください
+   @see ColumnReader
+   @see Status
+   */
+  virtual Status execute_sql_for_each(
+      const std::string &sql,
+      const std::function<void(const ColumnReader &)> &fn) = 0;
+
+  /**
+   sql を実行し、取得した 1 レコード毎に fn を呼び出します
+
+   各カラムの値をネイティブな型の Value として渡します。
+   整数や浮動小数点数を文字列に変換せず、NULL は Value::is_null で判別でき、
+   バイナリは途中の 0 で切り詰められません。
+   ValueRow およびその値はコールバックから戻るまでの間だけ有効です。
+
+   @param sql 実行する SQL ステートメントを指定してください
+   @param fn コールバックする関数を指定してください
+   @see ValueRow
+   @see Status
+   */
+  virtual Status execute_sql_for_each(
+      const std::string &sql,
+      const std::function<void(const ValueRow &)> &fn) = 0;
+
+  /**
+   sql を実行し、取得した 1 レコード毎に T へ変換して fn を呼び出します
+
+   T のメンバとカラムの対応は OOKOTO_ROW_MAPPING で宣言してください。
+   カラム位置は結果セット毎に 1 度だけ解決し、
+   各メンバには文字列を経由せずに値を格納します。
+
+   @code
+   conn.execute_sql_for_each<User>("SELECT id, name, score FROM users",
+                                   [](const User &user) { ... });
+   @endcode
+
+   @param sql 実行する SQL ステートメントを指定してください
+   @param fn コールバックする関数を指定してください
+   @retval Status::invalid_argument T に対応するカラムが結果セットに存在しない
+   @see RowMapping
+   @see Status
+   */
+  template <typename T>
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const T &)> &fn) {
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+
+    RowDecoder<T> decoder;
+    T row;
+    bool mismatch = false;
+    auto result = execute_sql_for_each(sql, [&](const ColumnReader &reader) {
+      if (!decoder.resolve(reader)) {
+        mismatch = true;
+        return;
+      }
+      decoder.decode(reader, &row);
+      fn(row);
+    });
+
+    return (mismatch) ? Status::invalid_argument() : result;
+  }
+
+  /**
+   sql を実行し、取得したすべてのレコードをカラム毎の配列として result に格納します
+
+   集計など、取得した値をカラム単位で処理する場合に使ってください。
+   レコードが 1 件もない場合も Status::ok を返します。
+
+   @param sql 実行する SQL ステートメントを指定してください
+   @param result 結果の格納先を指定してください
+   @see ColumnarResult
+   @see Status
+   */
+  virtual Status execute_sql_columnar(const std::string &sql,
+                                      ColumnarResult *result) = 0;
+
+  /**
+   sql を実行し、取得したレコードを batch_size 件ずつまとめて fn に渡します
+
+   fn の呼び出しはブロック毎に 1 回です。ブロックのバッファは再利用されるため、
+   幅の狭いレコードを大量に読む場合にレコード毎の呼び出しと確保の負担を減らせます。
+   最後のブロックは batch_size 件より少ないことがあります。
+
+   @code
+   conn.execute_sql_for_each_batch(
+       "SELECT id, name FROM users", 1024, [&](const ookoto::RowBatch &batch) {
+         for (std::size_t i = 0; i < batch.size(); i++) {
+           auto row = batch[i];
+           ...
+         }
+       });
+   @endcode
+
+   @param sql 実行する SQL ステートメントを指定してください
+   @param batch_size 1 つのブロックに含めるレコード数を指定してください
+   @param fn コールバックする関数を指定してください
+   @retval Status::invalid_argument batch_size が 0 である
+   @see RowBatch
+   @see Status
+   */
+  virtual Status execute_sql_for_each_batch(
+      const std::string &sql, std::size_t batch_size,
+      const std::function<void(const RowBatch &)> &fn) = 0;
+
+  /**
+   sql を実行し、結果セットを 1 レコードずつ取り出すカーソルを cursor に格納します
+
+   execute_sql_for_each と異なり、呼び出し側が必要な分だけレコードを読み進めます。
+
+   @param sql 実行する SQL ステートメントを指定してください
+   @param cursor 開いたカーソルの格納先を指定してください
+   @param options 1 回の通信で取得するレコード数などを指定してください
+   @see Cursor
+   @see CursorOptions
+   @see Status
+   */
+  virtual Status query(const std::string &sql, std::unique_ptr<Cursor> *cursor,
+                       const CursorOptions &options = CursorOptions()) = 0;
+
+  /**
+   sql に params をバインドして実行し、取得した 1 レコード毎に fn を呼び出します
+
+   Config::result_cache を指定すると、結果を sql と params をキーにキャッシュし、
+   同じ問い合わせには DB に問い合わせずにキャッシュした結果を渡します。
+   結果は参照したテーブルへの書き込みで破棄されます。
+   トランザクションの中で読み取った結果はキャッシュしません。
+
+   mysql では sql の FROM 句と JOIN 句から参照するテーブルを判別します。
+   判別できない sql の結果はキャッシュしません。
+
+   @code
+   conn.execute_sql_cached("SELECT name FROM countries WHERE code = ?",
+                           {ookoto::Value::text("JP", 2)},
+                           [](const ookoto::RowView &row) { ... });
+   @endcode
+
+   @param sql 実行する SQL ステートメントを指定してください
+   @param params パラメータ (?) にバインドする値を指定してください。バイナリは文字列としてバインドします
+   @param fn コールバックする関数を指定してください
+   @see ResultCache
+   @see Status
+   */
+  virtual Status execute_sql_cached(
+      const std::string &sql, const std::vector<Value> &params,
+      const std::function<void(const RowView &)> &fn) = 0;
+
+  /**
+   sql をコンパイルしたステートメントを statement に格納します
+
+   同じ sql のステートメントはコネクション毎にキャッシュされ、再利用されます。
+   キャッシュから取り出したステートメントのバインドは解除されています。
+   sqlite3 では、スキーマの変更で結果のカラムが変わったステートメントは
+   Status::status_ailment を返すため、もう一度 prepare してください。
+
+   @param sql コンパイルする SQL ステートメントを指定してください
+   @param statement コンパイルしたステートメントの格納先を指定してください
+   @see PreparedStatement
+   @see Status
+   */
+  virtual Status prepare(const std::string &sql,
+                         std::shared_ptr<PreparedStatement> *statement) = 0;
+
+  /**
+   ステートメントキャッシュの統計情報を返します
+
+   @see StatementCacheStats
+   */
+  virtual StatementCacheStats statement_cache_stats() const = 0;
+
+  /**
+   schema のテーブルに行を書き込む Appender を appender に格納します
+
+   sqlite3 では 1 つのプリペアドステートメントをチャンク毎のトランザクション内で再利用し、
+   mysql では複数行の INSERT 文をまとめて送信します。
+
+   @param schema 書き込み先のテーブルを指定してください
+   @param options チャンクの大きさなどを指定してください
+   @param appender 生成した Appender の格納先を指定してください
+   @see Appender
+   @see BulkInsertOptions
+   @see Status
+   */
+  virtual Status create_appender(std::shared_ptr<Schema> schema,
+                                 const BulkInsertOptions &options,
+                                 std::unique_ptr<Appender> *appender) = 0;
+
+  /**
+   schema のテーブルに rows を書き込みます
+
+   @param schema 書き込み先のテーブルを指定してください
+   @param rows 書き込む行を指定してください。値の並びは Appender と同じです
+   @param options チャンクの大きさなどを指定してください
+   @param stats 指定すると書き込んだ行数と所要時間を格納します
+   @see Appender
+   @see Status
+   */
+  virtual Status bulk_insert(
+      std::shared_ptr<Schema> schema, const std::vector<Appender::Row> &rows,
+      const BulkInsertOptions &options = BulkInsertOptions(),
+      BulkInsertStats *stats = nullptr) = 0;
+
  protected:
   bool _has_connection = false;
 };
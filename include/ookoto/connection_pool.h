@@ -0,0 +1,193 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "connection_interface.h"
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ @struct ConnectionPoolOptions
+
+ ConnectionPool に渡す設定です。
+ */
+struct ConnectionPoolOptions {
+  /**
+   open 時に接続しておくコネクション数を指定します
+   */
+  std::size_t min_size = 1;
+
+  /**
+   同時に保持するコネクションの最大数を指定します
+   */
+  std::size_t max_size = 8;
+
+  /**
+   コネクションが空くまで checkout が待つ最大時間を指定します
+   */
+  std::chrono::milliseconds checkout_timeout = std::chrono::milliseconds(1000);
+
+  /**
+   checkout 時に実行して接続を検証する SQL を指定します。空文字列なら検証しません
+
+   検証に失敗したコネクションは再接続されます。
+   */
+  std::string validation_query;
+};
+
+/**
+ @struct ConnectionPoolStats
+
+ ConnectionPool の使用状況です。
+ */
+struct ConnectionPoolStats {
+  /**
+   成功した checkout の回数です
+   */
+  uint64_t checkouts = 0;
+
+  /**
+   待ち時間の上限に達して失敗した checkout の回数です
+   */
+  uint64_t timeouts = 0;
+
+  /**
+   新たに接続した回数です (再接続を含みません)
+   */
+  uint64_t connects = 0;
+
+  /**
+   checkout 時の検証で再接続した回数です
+   */
+  uint64_t reconnects = 0;
+
+  /**
+   checkout の待ち時間の合計と最大値です
+   */
+  std::chrono::microseconds total_wait = std::chrono::microseconds(0);
+  std::chrono::microseconds max_wait = std::chrono::microseconds(0);
+
+  /**
+   保持しているコネクション数と、その内の貸出中・待機中の数です
+   */
+  std::size_t size = 0;
+  std::size_t in_use = 0;
+  std::size_t idle = 0;
+
+  /**
+   貸出中のコネクション数の最大値です
+   */
+  std::size_t peak_in_use = 0;
+
+  /**
+   コネクションが空くのを待っているスレッド数です
+   */
+  std::size_t waiting = 0;
+
+  std::chrono::microseconds average_wait() const {
+    if (checkouts == 0) {
+      return std::chrono::microseconds(0);
+    }
+    return total_wait / static_cast<int64_t>(checkouts);
+  }
+};
+
+/**
+ @class ConnectionPool
+
+ Config から生成したコネクションを複数のスレッドで共有するためのプールです。
+ 貸し出したコネクションは Handle の破棄とともにプールへ戻ります。
+
+ Handle はプールより先に破棄してください。
+ */
+class ConnectionPool {
+ public:
+  /**
+   @class Handle
+
+   貸し出したコネクションへの参照です
+   */
+  class Handle {
+   public:
+    Handle() = default;
+    Handle(Handle &&other);
+    Handle &operator=(Handle &&other);
+    ~Handle();
+
+    ConnectionInterface *get() const { return _connection.get(); }
+    ConnectionInterface *operator->() const { return get(); }
+    ConnectionInterface &operator*() const { return *get(); }
+    explicit operator bool() const { return _connection != nullptr; }
+
+    /**
+     コネクションをプールへ戻します
+     */
+    void release();
+
+   private:
+    friend class ConnectionPool;
+
+    ConnectionPool *_pool = nullptr;
+    std::unique_ptr<ConnectionInterface> _connection;
+
+    Handle(ConnectionPool *pool,
+           std::unique_ptr<ConnectionInterface> connection);
+    Handle(const Handle &) = delete;
+    Handle &operator=(const Handle &) = delete;
+  };
+
+  ConnectionPool(const Config &config,
+                 const ConnectionPoolOptions &options = ConnectionPoolOptions());
+  ~ConnectionPool();
+
+  /**
+   min_size 個のコネクションを接続します
+
+   @see Status
+   */
+  Status open();
+
+  /**
+   待機中のコネクションを切断し、以降の checkout を失敗させます
+   */
+  void close();
+
+  /**
+   コネクションを借り出して handle に格納します
+
+   空きがなく max_size に達している場合は checkout_timeout まで待ちます。
+
+   @retval Status::status_ailment 待ち時間の上限に達した、あるいは接続に失敗した
+   @see Status
+   */
+  Status checkout(Handle *handle);
+
+  /**
+   プールの使用状況を返します
+
+   @see ConnectionPoolStats
+   */
+  ConnectionPoolStats stats() const;
+
+ private:
+  Config _config;
+  ConnectionPoolOptions _options;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _available;
+  std::vector<std::unique_ptr<ConnectionInterface>> _idle;
+  bool _closed = false;
+  ConnectionPoolStats _stats;
+
+  void checkin(std::unique_ptr<ConnectionInterface> connection);
+  Status validate(ConnectionInterface *connection);
+};
+}
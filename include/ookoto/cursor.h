@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include "row_view.h"
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ @struct CursorOptions
+
+ ConnectionInterface::query に渡す設定です。
+ */
+struct CursorOptions {
+  /**
+   1 回の通信で取得するレコード数を指定します
+
+   0 以外を指定すると、mysql ではサーバー側の読み取り専用カーソルを開き、
+   fetch_size 件ずつ取得します。途中で close しても残りのレコードを転送しません。
+   0 の場合は結果をストリームとして受信するため、close 時に残りを読み捨てます。
+
+   sqlite3 では常に 1 レコードずつ評価するため、この設定は使いません。
+
+   対応するドライバ:
+   - mysql
+   */
+  std::size_t fetch_size = 0;
+};
+
+/**
+ @class Cursor
+
+ 結果セットを 1 レコードずつ取り出すカーソルです。
+ ConnectionInterface::query で取得します。
+
+ next の呼び出しの合間に任意の処理を挟むことができ、
+ 必要なレコードを読んだ時点で close して残りを破棄できます。
+ カーソルを開いている間、コネクションで他のクエリを実行しないでください。
+
+ @code
+ std::unique_ptr<ookoto::Cursor> cursor;
+ conn->query("SELECT id, name FROM users", &cursor);
+ for (auto &row : *cursor) {
+   if (done(row)) break;
+ }
+ cursor->close();
+ @endcode
+ */
+class Cursor {
+ public:
+  /**
+   range-based for 用の入力イテレータです
+   */
+  class iterator {
+   public:
+    explicit iterator(Cursor *cursor = nullptr) : _cursor(cursor) {
+      advance();
+    }
+
+    const RowView &operator*() const { return _cursor->row(); }
+    const RowView *operator->() const { return &_cursor->row(); }
+
+    iterator &operator++() {
+      advance();
+      return *this;
+    }
+
+    bool operator==(const iterator &other) const {
+      return _cursor == other._cursor;
+    }
+    bool operator!=(const iterator &other) const { return !(*this == other); }
+
+   private:
+    Cursor *_cursor = nullptr;
+
+    void advance() {
+      if (_cursor && !_cursor->next()) {
+        _cursor = nullptr;
+      }
+    }
+  };
+
+  virtual ~Cursor() = default;
+
+  /**
+   次のレコードへ進みます
+
+   @retval true レコードを取得した
+   @retval false 終端に達したか失敗した。status で確認してください
+   */
+  virtual bool next() = 0;
+
+  /**
+   現在のレコードを返します。次に next を呼び出すまで有効です
+   */
+  virtual const RowView &row() const = 0;
+
+  /**
+   最後に失敗した操作の結果を返します。失敗していなければ Status::ok です
+
+   @see Status
+   */
+  virtual Status status() const = 0;
+
+  /**
+   結果セットを解放します。破棄する際にも呼び出されます
+   */
+  virtual void close() = 0;
+
+  iterator begin() { return iterator(this); }
+  iterator end() { return iterator(); }
+};
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "connection_interface.h"
+#include "schema.h"
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ @struct ImportOptions
+
+ import_file に渡す設定です。既定値はタブ区切り (TSV) です。
+
+ CSV を読み込む場合は delimiter に ',' を、quote に '"' を指定してください。
+ */
+struct ImportOptions {
+  /**
+   フィールドの区切り文字です
+   */
+  char delimiter = '\t';
+
+  /**
+   フィールドを囲む引用符です。'\0' なら引用符を扱いません
+
+   引用符の中では区切り文字と改行をそのまま書け、引用符は 2 つ重ねて表します。
+   引用符の中に改行があり得るため、ファイルをスレッド毎に分割する際は先頭からレコードを辿ります。
+   */
+  char quote = '\0';
+
+  /**
+   true なら先頭の 1 行を読み飛ばします
+   */
+  bool header = false;
+
+  /**
+   このフィールドを NULL として扱います。
+   文字列型以外のカラムでは空のフィールドも NULL になります
+   */
+  std::string null_value = "\\N";
+
+  /**
+   フィールドを解析するスレッド数です。0 ならハードウェアのスレッド数です
+   */
+  std::size_t threads = 0;
+
+  /**
+   解析したスレッドから書き込みに渡す行数です
+   */
+  std::size_t batch_rows = 4096;
+
+  /**
+   1 つのトランザクションで書き込む行数です
+   */
+  std::size_t transaction_rows = 100000;
+
+  /**
+   1 つの INSERT 文に含める行数です。パラメータが 999 個を超えないように減らします
+   */
+  std::size_t rows_per_insert = 64;
+};
+
+/**
+ @struct ImportStats
+
+ import_file が書き込んだ行数と所要時間です。
+ */
+struct ImportStats {
+  /**
+   書き込みを確定した行数です
+   */
+  uint64_t rows = 0;
+
+  /**
+   読み込んだファイルの大きさ (バイト) です
+   */
+  uint64_t bytes = 0;
+
+  /**
+   ファイルを開いてから最後のトランザクションを確定し、インデックスを作成するまでの秒数です
+   */
+  double seconds = 0;
+
+  double rows_per_second() const { return (0 < seconds) ? rows / seconds : 0; }
+
+  double megabytes_per_second() const {
+    return (0 < seconds) ? bytes / seconds / (1024 * 1024) : 0;
+  }
+};
+
+/**
+ path の CSV/TSV ファイルを schema のテーブルに書き込みます
+
+ ファイルをメモリにマップしてレコードの境界で threads 個に分割し、
+ 各スレッドで区切り文字を探してフィールドを Schema::Type に従って変換します。
+ 変換した行は呼び出したスレッドがファイルの順に、
+ 複数行の INSERT 文をプリペアして transaction_rows 行毎のトランザクションで書き込みます。
+ 書き込み終えた後で Schema::Index::set_deferred を指定したインデックスを作成します。
+
+ フィールドはレコード毎に schema で定義した順 (auto increment なカラムを除く) に並べてください。
+ 失敗した場合、それまでに確定したトランザクションの行は残ります。
+
+ @code
+ ookoto::ImportStats stats;
+ auto result = ookoto::import_file(conn.get(), "users.tsv", schema,
+                                   ookoto::ImportOptions(), &stats);
+ @endcode
+
+ @param connection 書き込むコネクションを指定してください
+ @param path 読み込むファイルを指定してください
+ @param schema 書き込むテーブルを指定してください
+ @param options 区切り文字や並列度を指定してください
+ @param stats 指定すると書き込んだ行数と所要時間を格納します
+ @retval Status::invalid_argument フィールドの数や値が schema と合わない
+ @see ImportOptions
+ @see ImportStats
+ @see Status
+ */
+Status import_file(ConnectionInterface *connection, const std::string &path,
+                   std::shared_ptr<Schema> schema,
+                   const ImportOptions &options = ImportOptions(),
+                   ImportStats *stats = nullptr);
+}
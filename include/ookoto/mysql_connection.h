@@ -4,6 +4,29 @@
 
 namespace ookoto {
 
+/**
+ @struct MysqlFetchStats
+
+ MysqlConnection::execute_sql_for_each で結果を受け取った際の状況です。
+ */
+struct MysqlFetchStats {
+  /**
+   コールバックに渡した行数です
+   */
+  uint64_t rows = 0;
+
+  /**
+   コールバックに渡す前に保持した行数とその大きさ (バイト) の最大値です
+   */
+  uint64_t buffered_rows = 0;
+  std::size_t buffered_bytes = 0;
+
+  /**
+   クエリの送信からすべての行を受け取るまでの、サーバの資源を保持した秒数です
+   */
+  double server_seconds = 0;
+};
+
 /**
  @class MysqlConnection
 
@@ -12,7 +35,7 @@ namespace ookoto {
 class MysqlConnection : public ConnectionInterface {
  public:
   MysqlConnection();
-  virtual ~MysqlConnection() = default;
+  virtual ~MysqlConnection();
 
   virtual bool exists_table(const std::string &table_name) const;
   virtual int64_t last_row_id() const;
@@ -21,14 +44,92 @@ class MysqlConnection : public ConnectionInterface {
   virtual Status disconnect();
 
   virtual Status create_table(std::shared_ptr<Schema> schema);
+  virtual Status create_indexes(std::shared_ptr<Schema> schema);
   virtual Status drop_table(const std::string &table_name);
 
   virtual Status transaction(const std::function<Status()> &t);
 
   virtual Status execute_sql(const std::string &sql);
   using RowType = ConnectionInterface::RowType;
+  using ConnectionInterface::execute_sql_for_each;
   virtual Status execute_sql_for_each(
       const std::string &sql, const std::function<void(const RowType &)> &fn);
+  virtual Status execute_sql_for_each(
+      const std::string &sql, const std::function<void(const RowView &)> &fn);
+  virtual Status execute_sql_for_each(
+      const std::string &sql,
+      const std::function<void(const ColumnReader &)> &fn);
+  virtual Status execute_sql_for_each(
+      const std::string &sql, const std::function<void(const ValueRow &)> &fn);
+  virtual Status execute_sql_for_each_batch(
+      const std::string &sql, std::size_t batch_size,
+      const std::function<void(const RowBatch &)> &fn);
+  virtual Status execute_sql_columnar(const std::string &sql,
+                                      ColumnarResult *result);
+
+  /**
+   options で指定した方法で結果を受け取り、1 行ずつ fn を呼び出します
+
+   Config::mysql に指定した方法をこのクエリだけ変更します。
+   kHybrid では fn を呼び出すスレッドは変わりませんが、行は別スレッドで受け取ります。
+
+   @param options 結果を受け取る方法を指定してください
+   @param stats 指定すると結果を受け取った際の状況を格納します
+   @see MysqlFetchOptions
+   @see MysqlFetchStats
+   */
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const RowView &)> &fn,
+                              const MysqlFetchOptions &options,
+                              MysqlFetchStats *stats = nullptr);
+  virtual Status query(const std::string &sql, std::unique_ptr<Cursor> *cursor,
+                       const CursorOptions &options = CursorOptions());
+
+  /**
+   sqls を 1 回の通信でまとめて送信し、ステートメント毎の結果を results に格納します
+
+   sqls の 1 要素には 1 つのステートメントを指定してください。取得したレコードは捨てられます。
+   mysql は失敗したステートメント以降を実行しないため、それ以降の結果は Status::status_ailment になります。
+
+   transactional を指定すると START TRANSACTION と COMMIT も同じ通信で送信します。
+   いずれかのステートメントが失敗した場合は ROLLBACK を送信し、すべての変更を取り消します。
+   transaction の中で呼び出した場合は外側のトランザクションを確定しないよう、
+   START TRANSACTION と COMMIT の代わりに SAVEPOINT と RELEASE SAVEPOINT を送信し、
+   失敗時は ROLLBACK TO SAVEPOINT でこのバッチの変更だけを取り消します。
+
+   @code
+   std::vector<ookoto::Status> results;
+   conn.execute_batch({"UPDATE stocks SET count = count - 1 WHERE id = 1",
+                       "INSERT INTO orders (stock_id) VALUES (1)"},
+                      &results, true);
+   @endcode
+
+   @param sqls 実行する SQL ステートメントを指定してください
+   @param results 指定するとステートメント毎の結果を sqls と同じ順に格納します
+   @param transactional true なら 1 つのトランザクションとして実行します
+   @retval Status::ok すべてのステートメントが成功した
+   @see MysqlOptions::multi_statements
+   @see Status
+   */
+  Status execute_batch(const std::vector<std::string> &sqls,
+                       std::vector<Status> *results = nullptr,
+                       bool transactional = false);
+
+  virtual Status execute_sql_cached(
+      const std::string &sql, const std::vector<Value> &params,
+      const std::function<void(const RowView &)> &fn);
+
+  virtual Status prepare(const std::string &sql,
+                         std::shared_ptr<PreparedStatement> *statement);
+  virtual StatementCacheStats statement_cache_stats() const;
+
+  virtual Status create_appender(std::shared_ptr<Schema> schema,
+                                 const BulkInsertOptions &options,
+                                 std::unique_ptr<Appender> *appender);
+  virtual Status bulk_insert(
+      std::shared_ptr<Schema> schema, const std::vector<Appender::Row> &rows,
+      const BulkInsertOptions &options = BulkInsertOptions(),
+      BulkInsertStats *stats = nullptr);
 
  private:
   class Impl;
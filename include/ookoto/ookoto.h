@@ -1,8 +1,25 @@
 #pragma once
 
+#include "appender.h"
+#include "async_connection.h"
+#include "backup.h"
+#include "columnar_result.h"
 #include "config.h"
+#include "connection_factory.h"
 #include "connection_interface.h"
+#include "connection_pool.h"
+#include "cursor.h"
+#include "file_import.h"
 #include "mysql_connection.h"
+#include "prepared_statement.h"
+#include "profiler.h"
+#include "query_logger.h"
+#include "result_cache.h"
+#include "row_batch.h"
+#include "row_mapping.h"
+#include "row_view.h"
 #include "schema.h"
+#include "sharded_connection.h"
 #include "sqlite_connection.h"
-#include "status.h"
\ No newline at end of file
+#include "status.h"
+#include "table.h"
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "row_view.h"
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ @class PreparedStatement
+
+ コンパイル済みの SQL ステートメントです。
+ パラメータ (?) に値をバインドしてから実行します。
+
+ ConnectionInterface::prepare で取得します。取得したステートメントは
+ コネクションを切断する前に解放してください。
+ */
+class PreparedStatement {
+ public:
+  virtual ~PreparedStatement() = default;
+
+  /**
+   index 番目 (1 始まり) のパラメータに値をバインドします
+
+   @see Status
+   */
+  virtual Status bind(int index, int64_t value) = 0;
+  virtual Status bind(int index, double value) = 0;
+  virtual Status bind(int index, const std::string &value) = 0;
+
+  /**
+   index 番目 (1 始まり) のパラメータに NULL をバインドします
+
+   @see Status
+   */
+  virtual Status bind_null(int index) = 0;
+
+  /**
+   すべてのパラメータのバインドを解除します
+
+   @see Status
+   */
+  virtual Status clear_bindings() = 0;
+
+  /**
+   ステートメントを実行します。取得したレコードは捨てられます
+
+   @see Status
+   */
+  virtual Status execute() = 0;
+
+  /**
+   ステートメントを実行し、取得した 1 レコード毎に fn を呼び出します
+
+   @param fn コールバックする関数を指定してください
+   @see RowView
+   @see Status
+   */
+  virtual Status execute_for_each(
+      const std::function<void(const RowView &)> &fn) = 0;
+};
+
+/**
+ @struct StatementCacheStats
+
+ コネクション毎のステートメントキャッシュの統計情報です。
+ */
+struct StatementCacheStats {
+  /**
+   キャッシュ済みのステートメントを再利用した回数です
+   */
+  uint64_t hits = 0;
+
+  /**
+   ステートメントを新たにコンパイルした回数です
+   */
+  uint64_t misses = 0;
+
+  /**
+   容量超過によりキャッシュから追い出した回数です
+   */
+  uint64_t evictions = 0;
+
+  /**
+   現在キャッシュしているステートメントの数です
+   */
+  std::size_t size = 0;
+
+  /**
+   キャッシュできるステートメントの最大数です
+   */
+  std::size_t capacity = 0;
+};
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ookoto {
+
+/**
+ @struct StatementCounters
+
+ sqlite3_stmt_status で取得したステートメントの実行状況です。
+ mysql では常に 0 です。
+ */
+struct StatementCounters {
+  /**
+   テーブルを全件走査するために進めた回数です (SQLITE_STMTSTATUS_FULLSCAN_STEP)
+   */
+  int64_t fullscan_steps = 0;
+
+  /**
+   ソートした回数です (SQLITE_STMTSTATUS_SORT)
+   */
+  int64_t sorts = 0;
+
+  /**
+   自動インデックスに挿入した行数です (SQLITE_STMTSTATUS_AUTOINDEX)
+   */
+  int64_t autoindexes = 0;
+
+  /**
+   仮想マシンで実行した命令数です (SQLITE_STMTSTATUS_VM_STEP)
+   */
+  int64_t vm_steps = 0;
+};
+
+/**
+ @struct StatementProfile
+
+ Profiler が正規化した SQL 毎に集計した記録です。
+ */
+struct StatementProfile {
+  /**
+   リテラルを ? に置き換え、空白をまとめた SQL です
+
+   @see Profiler::normalize
+   */
+  std::string sql;
+
+  /**
+   実行した回数と、そのうち失敗した回数です
+   */
+  uint64_t calls = 0;
+  uint64_t failures = 0;
+
+  /**
+   コールバックに渡したレコード数です
+   */
+  uint64_t rows = 0;
+
+  /**
+   実行に要した時間の合計です。driver と callback の和です
+   */
+  std::chrono::microseconds total = std::chrono::microseconds(0);
+
+  /**
+   total のうち、ドライバと DB で費やした時間です
+   */
+  std::chrono::microseconds driver = std::chrono::microseconds(0);
+
+  /**
+   total のうち、コールバックの中で費やした時間です
+   */
+  std::chrono::microseconds callback = std::chrono::microseconds(0);
+
+  /**
+   最も時間のかかった 1 回の時間です
+   */
+  std::chrono::microseconds max = std::chrono::microseconds(0);
+
+  /**
+   すべての実行で合計したステートメントの実行状況です
+   */
+  StatementCounters counters;
+
+  /**
+   ProfilerOptions::plan_threshold 以上かかった時に取得した実行計画です。
+   sqlite3 は EXPLAIN QUERY PLAN の、mysql は EXPLAIN の結果を 1 行ずつ並べます
+
+   取得していなければ空です。
+   */
+  std::string plan;
+};
+
+/**
+ @struct ProfilerOptions
+
+ Profiler に渡す設定です。
+ */
+struct ProfilerOptions {
+  /**
+   1 回の実行にこの時間以上かかった SQL の実行計画を取得します
+
+   実行計画は SQL 毎に 1 度だけ、実行したコネクションで取得します。
+   */
+  std::chrono::microseconds plan_threshold = std::chrono::milliseconds(100);
+
+  /**
+   false なら実行計画を取得しません
+   */
+  bool capture_plans = true;
+
+  /**
+   記録する SQL の種類の上限です。超えた SQL は記録せずに untracked で数えます
+   */
+  std::size_t max_statements = 1024;
+};
+
+/**
+ @class Profiler
+
+ SQL の実行時間とレコード数を、正規化した SQL 毎に集計します。
+ Config::profiler に設定すると有効になり、同じ Config から生成したコネクションの間で共有されます。
+
+ 次の呼び出しを記録します。
+ - execute_sql
+ - execute_sql_for_each
+ - execute_sql_for_each_batch
+ - execute_sql_columnar
+ - execute_sql_cached (キャッシュから返した結果を除きます)
+
+ コールバックを呼び出す度に時計を読むため、記録している間はレコード毎に数十ナノ秒ほど遅くなります。
+
+ @code
+ auto profiler = std::make_shared<ookoto::Profiler>();
+ config.profiler = profiler;
+ ...
+ for (auto &statement : profiler->top(10)) {
+   fmt::print("{} {}us {}\n", statement.sql, statement.total.count(),
+              statement.plan);
+ }
+ @endcode
+ */
+class Profiler {
+ public:
+  explicit Profiler(const ProfilerOptions &options = ProfilerOptions());
+  ~Profiler();
+
+  /**
+   合計の実行時間が長い順に n 件の記録を返します
+   */
+  std::vector<StatementProfile> top(std::size_t n) const;
+
+  /**
+   max_statements を超えたために記録しなかった実行の回数を返します
+   */
+  uint64_t untracked() const;
+
+  /**
+   すべての記録を破棄します
+   */
+  void reset();
+
+  /**
+   sql の文字列と数値のリテラルを ? に置き換え、連続した空白を 1 つにまとめます。
+   IN (1, 2, 3) のような ? の並びは 1 つの ? にまとめます
+   */
+  static std::string normalize(const std::string &sql);
+
+ private:
+  friend class QueryProfile;
+  class Impl;
+  std::unique_ptr<Impl> _impl;
+
+  Profiler(const Profiler &) = delete;
+  Profiler &operator=(const Profiler &) = delete;
+};
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ @class QueryLogger
+
+ 実行した SQL を記録するロガーのインターフェイスです。
+ Config::query_logger に設定すると、各ドライバが SQL の実行毎に log を呼び出します。
+
+ log はクエリを実行したスレッドで呼び出されるため、ブロックしてはいけません。
+ */
+class QueryLogger {
+ public:
+  virtual ~QueryLogger() = default;
+
+  /**
+   実行した SQL を記録します
+
+   @param sql 実行した SQL ステートメント
+   @param elapsed 実行に要した時間
+   @param status 実行結果
+   */
+  virtual void log(const std::string &sql, std::chrono::microseconds elapsed,
+                   const Status &status) = 0;
+};
+
+/**
+ @class NullQueryLogger
+
+ 何も記録しないロガーです。
+ */
+class NullQueryLogger : public QueryLogger {
+ public:
+  void log(const std::string &, std::chrono::microseconds,
+           const Status &) override {}
+};
+
+/**
+ @struct QueryLogEntry
+
+ AsyncQueryLogger が出力先に渡す 1 件の記録です。
+ */
+struct QueryLogEntry {
+  std::string sql;
+  std::chrono::microseconds elapsed = std::chrono::microseconds(0);
+  bool ok = true;
+};
+
+/**
+ @struct AsyncQueryLoggerOptions
+
+ AsyncQueryLogger に渡す設定です。
+ */
+struct AsyncQueryLoggerOptions {
+  /**
+   リングバッファに保持できる記録の数を指定します。2 のべき乗に切り上げます
+
+   バッファが一杯の場合、記録は捨てられます。
+   */
+  std::size_t capacity = 4096;
+
+  /**
+   記録する SQL の最大バイト数を指定します。超えた部分は切り捨てます
+   */
+  std::size_t max_sql_length = 1024;
+
+  /**
+   N 件に 1 件の割合で記録します。1 ならすべて記録します
+   */
+  uint32_t sample_every = 1;
+
+  /**
+   指定した時間以上かかった SQL だけを記録します。0 ならすべて記録します
+   */
+  std::chrono::microseconds slow_query_threshold = std::chrono::microseconds(0);
+
+  /**
+   失敗した SQL を sample_every や slow_query_threshold に関わらず記録します
+   */
+  bool always_log_failures = true;
+
+  /**
+   バッファが空の時にバックグラウンドスレッドが待つ時間を指定します
+   */
+  std::chrono::milliseconds flush_interval = std::chrono::milliseconds(10);
+
+  /**
+   記録の出力先を指定します。指定しなければ標準出力へ書き出します
+
+   バックグラウンドスレッドから呼び出されます。
+   */
+  std::function<void(const QueryLogEntry &)> sink;
+};
+
+/**
+ @class AsyncQueryLogger
+
+ SQL をロックフリーなリングバッファへコピーし、
+ バックグラウンドスレッドで出力先へ書き出すロガーです。
+ */
+class AsyncQueryLogger : public QueryLogger {
+ public:
+  struct Stats {
+    /**
+     出力先へ書き出した件数です
+     */
+    uint64_t written = 0;
+
+    /**
+     バッファが一杯で捨てた件数です
+     */
+    uint64_t dropped = 0;
+
+    /**
+     サンプリングや閾値によって記録しなかった件数です
+     */
+    uint64_t skipped = 0;
+  };
+
+  explicit AsyncQueryLogger(
+      const AsyncQueryLoggerOptions &options = AsyncQueryLoggerOptions());
+  virtual ~AsyncQueryLogger();
+
+  void log(const std::string &sql, std::chrono::microseconds elapsed,
+           const Status &status) override;
+
+  /**
+   バッファに残っている記録をすべて書き出すまで待ちます
+   */
+  void flush();
+
+  Stats stats() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> _impl;
+};
+}
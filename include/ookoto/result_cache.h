@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace ookoto {
+
+/**
+ @struct ResultCacheStats
+
+ ResultCache の使用状況です。
+ */
+struct ResultCacheStats {
+  /**
+   キャッシュした結果を返した回数です
+   */
+  uint64_t hits = 0;
+
+  /**
+   キャッシュに結果がなく、DB に問い合わせた回数です
+   */
+  uint64_t misses = 0;
+
+  /**
+   容量超過によりキャッシュから追い出した結果の数です
+   */
+  uint64_t evictions = 0;
+
+  /**
+   テーブルの変更により破棄した結果の数です
+   */
+  uint64_t invalidations = 0;
+
+  /**
+   現在キャッシュしている結果の数とその大きさ (バイト) です
+   */
+  std::size_t entries = 0;
+  std::size_t bytes = 0;
+
+  /**
+   キャッシュできる大きさ (バイト) の上限です
+   */
+  std::size_t capacity = 0;
+
+  double hit_ratio() const {
+    auto total = hits + misses;
+    return (0 < total) ? static_cast<double>(hits) / total : 0;
+  }
+};
+
+/**
+ @class ResultCache
+
+ ConnectionInterface::execute_sql_cached の結果を、SQL とバインドした値をキーに保持します。
+ Config::result_cache に設定すると有効になり、同じ Config から生成したコネクションの間で共有されます。
+
+ 容量を超えると最も長く使われていない結果から追い出します。
+ 結果は参照したテーブル毎に管理し、テーブルが変更されるとそのテーブルを参照する結果だけを破棄します。
+
+ - sqlite3 では sqlite3_update_hook で変更を検知します。
+   コネクションの間で共有する場合は journal_mode を WAL にしてください。
+ - mysql では同じキャッシュを使うコネクションから実行した書き込みで検知します。
+
+ 他のプロセスやキャッシュを共有しないコネクションからの書き込み、
+ sqlite3 の WITHOUT ROWID なテーブルへの書き込みは検知できないため、invalidate を呼び出してください。
+ */
+class ResultCache {
+ public:
+  static const std::size_t kDefaultCapacity = 64 * 1024 * 1024;
+
+  /**
+   @param capacity キャッシュする結果の大きさ (バイト) の上限を指定してください
+   */
+  explicit ResultCache(std::size_t capacity = kDefaultCapacity);
+  ~ResultCache();
+
+  /**
+   table を参照する結果を破棄します
+   */
+  void invalidate(const std::string &table);
+
+  /**
+   すべての結果を破棄します
+   */
+  void clear();
+
+  /**
+   使用状況を返します
+
+   @see ResultCacheStats
+   */
+  ResultCacheStats stats() const;
+
+ private:
+  friend class CachedQuery;
+  class Impl;
+  std::unique_ptr<Impl> _impl;
+
+  ResultCache(const ResultCache &) = delete;
+  ResultCache &operator=(const ResultCache &) = delete;
+};
+}
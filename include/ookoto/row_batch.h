@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+#include "row_view.h"
+
+namespace ookoto {
+
+class RowBatchBuilder;
+
+/**
+ @class RowBatch
+
+ 複数のレコードをまとめて参照するブロックです。
+ ConnectionInterface::execute_sql_for_each_batch で受け取ります。
+
+ ブロック内の文字列とバイナリの値は 1 つのバッファ (アリーナ) に詰めて保持します。
+ アリーナと値の配列はブロックの間で解放せずに再利用するため、
+ 参照先はコールバックから戻るまでの間だけ有効です。
+ */
+class RowBatch {
+ public:
+  const RowView::Columns &columns() const { return *_columns; }
+
+  /**
+   ブロック内のレコード数を返します
+   */
+  std::size_t size() const { return _rows; }
+  bool empty() const { return _rows == 0; }
+
+  /**
+   row 番目のレコードを返します
+   */
+  RowView operator[](std::size_t row) const {
+    return RowView(*_columns, _values.data() + row * _columns->size());
+  }
+
+  /**
+   アリーナに詰めた値の大きさ (バイト) を返します
+   */
+  std::size_t arena_size() const { return _arena.size(); }
+
+ private:
+  friend class RowBatchBuilder;
+
+  const RowView::Columns *_columns = nullptr;
+  std::size_t _rows = 0;
+  std::vector<StringView> _values;
+  std::string _arena;
+  // offset and size of each value in the arena while the block is filled
+  std::vector<std::pair<std::size_t, std::size_t>> _cells;
+};
+}
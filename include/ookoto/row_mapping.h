@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include "row_view.h"
+
+namespace ookoto {
+
+/**
+ @class ColumnReader
+
+ 現在のレコードの値をドライバのネイティブな型のまま読み出すインターフェイスです。
+ 文字列への変換を経由しません。
+ */
+class ColumnReader {
+ public:
+  virtual ~ColumnReader() = default;
+
+  /**
+   結果セットのカラム名と位置の対応を返します
+   */
+  virtual const RowView::Columns &columns() const = 0;
+
+  virtual bool is_null(int index) const = 0;
+  virtual int64_t get_int64(int index) const = 0;
+  virtual double get_double(int index) const = 0;
+
+  /**
+   index 番目のカラムの値を文字列として返します。コールバックから戻るまで有効です
+   */
+  virtual StringView get_text(int index) const = 0;
+};
+
+/**
+ @struct RowField
+
+ 構造体のメンバとカラム名の対応です。OOKOTO_ROW_FIELD で生成してください
+ */
+template <typename T, typename M>
+struct RowField {
+  const char *name;
+  M T::*member;
+};
+
+template <typename T, typename M>
+RowField<T, M> make_row_field(const char *name, M T::*member) {
+  return RowField<T, M>{name, member};
+}
+
+/**
+ @struct RowMapping
+
+ 構造体 T とカラムの対応を宣言するトレイトです。
+ OOKOTO_ROW_MAPPING で特殊化してください。
+
+ @code
+ struct User {
+   int64_t id;
+   std::string name;
+   double score;
+ };
+ OOKOTO_ROW_MAPPING(User, OOKOTO_ROW_FIELD(id), OOKOTO_ROW_FIELD(name),
+                    OOKOTO_ROW_FIELD(score));
+ @endcode
+ */
+template <typename T>
+struct RowMapping {
+  static_assert(sizeof(T) == 0,
+                "declare the columns of T with OOKOTO_ROW_MAPPING");
+};
+
+/**
+ メンバ名と同じ名前のカラムに対応付けます
+ */
+#define OOKOTO_ROW_FIELD(member) ::ookoto::make_row_field(#member, &type::member)
+
+/**
+ カラム名を指定して対応付けます
+ */
+#define OOKOTO_ROW_COLUMN(column, member) \
+  ::ookoto::make_row_field(column, &type::member)
+
+/**
+ 構造体 T のメンバとカラムの対応を宣言します。グローバル名前空間で使用してください
+ */
+#define OOKOTO_ROW_MAPPING(T, ...)                                \
+  namespace ookoto {                                              \
+  template <>                                                     \
+  struct RowMapping<T> {                                          \
+    using type = T;                                               \
+    static auto fields() -> decltype(std::make_tuple(__VA_ARGS__)) { \
+      return std::make_tuple(__VA_ARGS__);                        \
+    }                                                             \
+  };                                                              \
+  }
+
+namespace row_mapping_detail {
+
+template <typename M>
+typename std::enable_if<std::is_integral<M>::value>::type read(
+    const ColumnReader &reader, int index, M *value) {
+  *value = static_cast<M>(reader.get_int64(index));
+}
+
+template <typename M>
+typename std::enable_if<std::is_floating_point<M>::value>::type read(
+    const ColumnReader &reader, int index, M *value) {
+  *value = static_cast<M>(reader.get_double(index));
+}
+
+inline void read(const ColumnReader &reader, int index, std::string *value) {
+  auto text = reader.get_text(index);
+  value->assign(text.data() ? text.data() : "", text.size());
+}
+
+inline void read(const ColumnReader &reader, int index, StringView *value) {
+  *value = reader.get_text(index);
+}
+
+template <typename T, typename Fields, std::size_t I = 0,
+          std::size_t N = std::tuple_size<Fields>::value>
+struct Decoder {
+  static bool resolve(const Fields &fields, const RowView::Columns &columns,
+                      int *indexes) {
+    indexes[I] = columns.index_of(std::get<I>(fields).name);
+    return indexes[I] != RowView::kNotFound &&
+           Decoder<T, Fields, I + 1, N>::resolve(fields, columns, indexes);
+  }
+
+  static void decode(const Fields &fields, const int *indexes,
+                     const ColumnReader &reader, T *row) {
+    auto &field = std::get<I>(fields);
+    auto &value = row->*(field.member);
+    if (reader.is_null(indexes[I])) {
+      value = typename std::remove_reference<decltype(value)>::type();
+    } else {
+      read(reader, indexes[I], &value);
+    }
+    Decoder<T, Fields, I + 1, N>::decode(fields, indexes, reader, row);
+  }
+};
+
+template <typename T, typename Fields, std::size_t N>
+struct Decoder<T, Fields, N, N> {
+  static bool resolve(const Fields &, const RowView::Columns &, int *) {
+    return true;
+  }
+  static void decode(const Fields &, const int *, const ColumnReader &, T *) {}
+};
+}  // namespace row_mapping_detail
+
+/**
+ @class RowDecoder
+
+ RowMapping<T> に従ってレコードを T に変換します。
+ カラム位置は最初のレコードで 1 度だけ解決します
+ */
+template <typename T>
+class RowDecoder {
+ public:
+  using Fields = decltype(RowMapping<T>::fields());
+  using Impl = row_mapping_detail::Decoder<T, Fields>;
+
+  RowDecoder() : _fields(RowMapping<T>::fields()) {}
+
+  /**
+   reader のカラムと T のメンバを対応付けます。存在しないカラムがあれば false を返します
+   */
+  bool resolve(const ColumnReader &reader) {
+    if (!_resolved) {
+      _valid = Impl::resolve(_fields, reader.columns(), _indexes);
+      _resolved = true;
+    }
+    return _valid;
+  }
+
+  void decode(const ColumnReader &reader, T *row) const {
+    Impl::decode(_fields, _indexes, reader, row);
+  }
+
+ private:
+  Fields _fields;
+  int _indexes[std::tuple_size<Fields>::value];
+  bool _resolved = false;
+  bool _valid = false;
+};
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ookoto {
+
+/**
+ @class StringView
+
+ ドライバのバッファを指す、所有権を持たない文字列の参照です。
+ 参照先はコールバックから戻るまでの間だけ有効です。
+ */
+class StringView {
+ public:
+  StringView() = default;
+  StringView(const char *data, std::size_t size) : _data(data), _size(size) {}
+
+  const char *data() const { return _data; }
+  std::size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+
+  /**
+   値が NULL であれば true を返します
+
+   @retval true 値が NULL である
+   @retval false それ以外
+   */
+  bool is_null() const { return _data == nullptr; }
+
+  /**
+   参照先をコピーした std::string を返します。NULL の場合は空文字列です
+   */
+  std::string to_string() const {
+    return (_data) ? std::string(_data, _size) : std::string();
+  }
+
+ private:
+  const char *_data = nullptr;
+  std::size_t _size = 0;
+};
+
+/**
+ @class RowView
+
+ 1 レコードをカラム位置で参照する軽量なビューです。
+ カラム名の解決は結果セット毎に 1 度だけ行われます。
+ */
+class RowView {
+ public:
+  static const int kNotFound = -1;
+
+  /**
+   @class Columns
+
+   結果セットのカラム名と位置の対応を保持します
+   */
+  class Columns {
+   public:
+    void add(const std::string &name) {
+      _indexes.emplace(name, static_cast<int>(_names.size()));
+      _names.emplace_back(name);
+    }
+
+    std::size_t size() const { return _names.size(); }
+    const std::string &name(std::size_t index) const { return _names[index]; }
+
+    int index_of(const std::string &name) const {
+      auto it = _indexes.find(name);
+      return (it == _indexes.end()) ? kNotFound : it->second;
+    }
+
+   private:
+    std::vector<std::string> _names;
+    std::map<std::string, int> _indexes;
+  };
+
+  RowView(const Columns &columns, const StringView *values)
+      : _columns(&columns), _values(values) {}
+
+  std::size_t size() const { return _columns->size(); }
+
+  /**
+   index 番目のカラム名を返します
+   */
+  const std::string &name(std::size_t index) const {
+    return _columns->name(index);
+  }
+
+  /**
+   name のカラム位置を返します。存在しなければ kNotFound を返します
+
+   ループの外で 1 度だけ呼び出し、結果の位置で値を参照してください。
+   */
+  int index_of(const std::string &name) const {
+    return _columns->index_of(name);
+  }
+
+  /**
+   index 番目のカラムの値を返します
+   */
+  const StringView &operator[](std::size_t index) const {
+    return _values[index];
+  }
+
+  /**
+   name のカラムの値を返します。存在しなければ NULL を返します
+   */
+  StringView get(const std::string &name) const {
+    auto index = index_of(name);
+    return (index == kNotFound) ? StringView() : _values[index];
+  }
+
+ private:
+  const Columns *_columns = nullptr;
+  const StringView *_values = nullptr;
+};
+}
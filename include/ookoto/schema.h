@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -38,6 +39,58 @@ class Schema {
     bool _auto_increment = false;
   };
 
+  class Index;
+  using IndexPtr = std::shared_ptr<Index>;
+
+  /**
+   @class Index
+
+   define_index で定義するインデックスです
+   */
+  class Index {
+   public:
+    Index(const std::string &name, const std::vector<std::string> &columns);
+
+    Index &set_unique();
+
+    /**
+     キーの後ろに columns を加え、インデックスだけで問い合わせに答えられるようにします (カバリングインデックス)
+
+     sqlite3 と mysql には INCLUDE 句がないため、キーの末尾のカラムとして作成します。
+     */
+    Index &set_include(const std::vector<std::string> &columns);
+
+    /**
+     predicate を満たす行だけを索引します (部分インデックス)
+
+     mysql は部分インデックスを扱えないため、predicate を無視してすべての行を索引します。
+     set_unique と組み合わせた場合は意味が変わるため、mysql では作成に失敗します。
+     */
+    Index &set_where(const std::string &predicate);
+
+    /**
+     create_table では作成せず、ConnectionInterface::create_indexes で作成します
+
+     データを読み込んでからインデックスを作成すると、行毎にインデックスを更新するより速くなります。
+     */
+    Index &set_deferred();
+
+    const std::string &name() const { return _name; }
+    const std::vector<std::string> &columns() const { return _columns; }
+    const std::vector<std::string> &include() const { return _include; }
+    const std::string &where() const { return _where; }
+    bool unique() const { return _unique; }
+    bool deferred() const { return _deferred; }
+
+   private:
+    std::string _name;
+    std::vector<std::string> _columns;
+    std::vector<std::string> _include;
+    std::string _where;
+    bool _unique = false;
+    bool _deferred = false;
+  };
+
   enum {
     kColumnName = 0,
     kColumnType = 1,
@@ -67,14 +120,53 @@ class Schema {
                      const std::function<void(PropertyPtr)> &fn = nullptr);
   void define_timestamps();
 
+  /**
+   columns の順に並べた複合主キーを定義します
+
+   Property::set_primary_key と同時には使えません。
+   */
+  void define_primary_key(const std::vector<std::string> &columns);
+
+  /**
+   columns をキーとするインデックスを定義します
+   */
+  void define_index(const std::string &name,
+                    const std::vector<std::string> &columns,
+                    const std::function<void(IndexPtr)> &fn = nullptr);
+
+  /**
+   sqlite3 で WITHOUT ROWID のテーブルを作成します。主キーが必要です
+
+   行を主キーの順に格納するため、主キーでの検索が 1 回で済みます。mysql では無視します
+   */
+  void define_without_rowid();
+
+  /**
+   mysql のストレージエンジン (ENGINE) と行フォーマット (ROW_FORMAT) を指定します。
+   sqlite3 では無視します
+   */
+  void define_engine(const std::string &engine);
+  void define_row_format(const std::string &row_format);
+
   std::string table_name() const;
   int defined_column_size() const;
   void each_column(
       const std::function<void(const std::string &column_name)> &fn);
   void each_define(const std::function<void(const ColumnType &def)> &fn);
+  void each_index(const std::function<void(const Index &index)> &fn) const;
+
+  const std::vector<std::string> &primary_key() const { return _primary_key; }
+  bool without_rowid() const { return _without_rowid; }
+  const std::string &engine() const { return _engine; }
+  const std::string &row_format() const { return _row_format; }
 
  private:
   std::string _table_name;
   std::vector<ColumnType> _column_defs;
+  std::vector<std::string> _primary_key;
+  std::vector<IndexPtr> _indexes;
+  bool _without_rowid = false;
+  std::string _engine;
+  std::string _row_format;
 };
 }
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "connection_interface.h"
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ シャードキーから振り分け先のシャードの番号 (0 から始まります) を返す関数です
+ */
+using ShardFunction = std::function<std::size_t(const std::string &key)>;
+
+/**
+ key のハッシュ値 (FNV-1a) で shards 個のシャードに振り分ける関数を返します
+
+ ハッシュ値はプラットフォームやビルドに依存しないため、データの配置に使えます。
+ */
+ShardFunction hash_shard(std::size_t shards);
+
+/**
+ key を整数として読み、bounds[i] 未満ならシャード i に振り分ける関数を返します
+
+ bounds は昇順に並べてください。すべての値以上の key はシャード bounds.size() に振り分けます。
+ */
+ShardFunction range_shard(const std::vector<int64_t> &bounds);
+
+/**
+ @struct ShardingOptions
+
+ ShardedConnection に渡す設定です。
+ */
+struct ShardingOptions {
+  /**
+   シャードキーを振り分ける関数です。指定しなければ hash_shard を使います
+   */
+  ShardFunction shard;
+
+  /**
+   create_appender と bulk_insert でシャードキーとして読むカラム名です。
+   指定しなければ Appender::Row の先頭の値を使います
+   */
+  std::string key_column;
+
+  /**
+   すべてのシャードへの問い合わせで、呼び出し元に渡す前に読み進めておくレコード数の上限です (シャード毎)
+   */
+  std::size_t prefetch_rows = 4096;
+};
+
+/**
+ @class ShardedConnection
+
+ 複数のコネクションをシャードとしてまとめ、1 つのコネクションとして扱います。
+
+ シャードキーを受け取る操作は ShardingOptions::shard で選んだ 1 つのシャードで実行します。
+ それ以外の操作はすべてのシャードで並列に実行します。
+ - execute_sql, create_table, create_indexes, drop_table は各シャードで実行し、最初に失敗した結果を返します。
+   ただし行を変更する execute_sql にはシャードキーが必要です
+ - execute_sql_for_each などの読み取りは各シャードの結果を読み進めながら、
+   呼び出したスレッドでシャードの区別なく順にコールバックします。
+   所要時間は最も遅いシャードの時間に近くなります。
+   ORDER BY や集計はシャード毎に適用されます
+   コールバックが例外を送出すると、各シャードは残りの行を読まずに止まります
+ - create_appender と bulk_insert は行を ShardingOptions::key_column の値で振り分けます
+
+ 並列に実行した操作でシャードが例外を送出した場合は、例外を送出せずにそのシャードの失敗として扱います。
+
+ シャードをまたぐトランザクションとプリペアドステートメントは扱えないため、
+ シャードキーを受け取る transaction と prepare を使ってください。
+ コールバックの中からこのコネクションを使わないでください。
+
+ @code
+ std::vector<ookoto::Config> shards(4, config);
+ for (std::size_t i = 0; i < shards.size(); i++) {
+   shards[i].database = fmt::format("users{}.db", i);
+ }
+ ookoto::ShardedConnection conn(shards);
+ conn.connect();
+ conn.execute_sql(user_id, "INSERT INTO users ...");
+ conn.execute_sql_for_each("SELECT * FROM users WHERE active = 1",
+                           [&](const ookoto::RowView &row) { ... });
+ @endcode
+ */
+class ShardedConnection : public ConnectionInterface {
+ public:
+  /**
+   @param shards シャード毎の接続先を指定してください
+   @param options 振り分ける関数などを指定してください
+   */
+  explicit ShardedConnection(const std::vector<Config> &shards,
+                             const ShardingOptions &options = ShardingOptions());
+  virtual ~ShardedConnection();
+
+  std::size_t shard_count() const;
+
+  /**
+   key を振り分けるシャードの番号を返します
+   */
+  std::size_t shard_of(const std::string &key) const;
+
+  /**
+   index 番目のシャードのコネクションを返します。接続していなければ nullptr です
+   */
+  ConnectionInterface *shard(std::size_t index) const;
+
+  /**
+   テーブルがすべてのシャードに存在していれば true を返します
+   */
+  virtual bool exists_table(const std::string &table_name) const;
+
+  /**
+   最後にシャードキーで振り分けた操作のシャードの last_row_id を返します。
+   ID はシャード毎に採番されるため、シャードの間で重複します
+   */
+  virtual int64_t last_row_id() const;
+
+  /**
+   すべてのシャードに、コンストラクタで指定した Config で接続します
+
+   config は使用しません。1 つでも失敗した場合は接続したシャードを切断します。
+   */
+  virtual Status connect(const Config &config);
+  Status connect();
+  virtual Status disconnect();
+
+  virtual Status create_table(std::shared_ptr<Schema> schema);
+  virtual Status create_indexes(std::shared_ptr<Schema> schema);
+  virtual Status drop_table(const std::string &table_name);
+
+  /**
+   シャードをまたぐトランザクションは扱えないため、常に Status::status_ailment を返します
+   */
+  virtual Status transaction(const std::function<Status()> &t);
+
+  /**
+   key のシャードでトランザクションを開始してから t を実行します
+
+   t の中では同じ key を指定して操作してください。
+   */
+  Status transaction(const std::string &key, const std::function<Status()> &t);
+
+  /**
+   すべてのシャードで sql を実行します
+
+   CREATE や DROP などの定義の変更に使います。
+   INSERT や UPDATE などの行の変更はシャードの数だけ適用されてしまうため、
+   シャードキーを受け取る execute_sql を使ってください。
+
+   @retval Status::invalid_argument 行を変更する、あるいは解釈できない文を含む
+   */
+  virtual Status execute_sql(const std::string &sql);
+
+  /**
+   key のシャードで sql を実行します
+
+   @retval Status::invalid_argument key を振り分けたシャードが存在しない
+   */
+  Status execute_sql(const std::string &key, const std::string &sql);
+
+  using RowType = ConnectionInterface::RowType;
+  using ConnectionInterface::execute_sql_for_each;
+  virtual Status execute_sql_for_each(
+      const std::string &sql, const std::function<void(const RowType &)> &fn);
+  virtual Status execute_sql_for_each(
+      const std::string &sql, const std::function<void(const RowView &)> &fn);
+  virtual Status execute_sql_for_each(
+      const std::string &sql,
+      const std::function<void(const ColumnReader &)> &fn);
+  virtual Status execute_sql_for_each(
+      const std::string &sql, const std::function<void(const ValueRow &)> &fn);
+
+  /**
+   key のシャードで sql を実行し、取得した 1 レコード毎に fn を呼び出します
+
+   @retval Status::invalid_argument key を振り分けたシャードが存在しない
+   */
+  Status execute_sql_for_each(const std::string &key, const std::string &sql,
+                              const std::function<void(const RowView &)> &fn);
+
+  virtual Status execute_sql_for_each_batch(
+      const std::string &sql, std::size_t batch_size,
+      const std::function<void(const RowBatch &)> &fn);
+  virtual Status execute_sql_columnar(const std::string &sql,
+                                      ColumnarResult *result);
+
+  /**
+   すべてのシャードの結果を読み進めるカーソルを cursor に格納します
+
+   options は各シャードのカーソルにそのまま渡します。
+   カーソルを開いたまま他の操作をすると、カーソルは閉じられ、
+   status は Status::status_ailment を返します。
+   */
+  virtual Status query(const std::string &sql, std::unique_ptr<Cursor> *cursor,
+                       const CursorOptions &options = CursorOptions());
+
+  virtual Status execute_sql_cached(
+      const std::string &sql, const std::vector<Value> &params,
+      const std::function<void(const RowView &)> &fn);
+
+  /**
+   シャードをまたぐステートメントは扱えないため、常に Status::status_ailment を返します
+   */
+  virtual Status prepare(const std::string &sql,
+                         std::shared_ptr<PreparedStatement> *statement);
+
+  /**
+   key のシャードで sql をコンパイルしたステートメントを statement に格納します
+   */
+  Status prepare(const std::string &key, const std::string &sql,
+                 std::shared_ptr<PreparedStatement> *statement);
+
+  /**
+   すべてのシャードの統計情報を合計して返します
+   */
+  virtual StatementCacheStats statement_cache_stats() const;
+
+  virtual Status create_appender(std::shared_ptr<Schema> schema,
+                                 const BulkInsertOptions &options,
+                                 std::unique_ptr<Appender> *appender);
+  virtual Status bulk_insert(
+      std::shared_ptr<Schema> schema, const std::vector<Appender::Row> &rows,
+      const BulkInsertOptions &options = BulkInsertOptions(),
+      BulkInsertStats *stats = nullptr);
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> _impl;
+};
+}
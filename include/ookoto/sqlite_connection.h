@@ -1,5 +1,6 @@
 #pragma once
 
+#include "backup.h"
 #include "connection_interface.h"
 
 namespace ookoto {
@@ -12,23 +13,140 @@ namespace ookoto {
 class SqliteConnection : public ConnectionInterface {
  public:
   SqliteConnection();
-  virtual ~SqliteConnection() = default;
+  virtual ~SqliteConnection();
 
   virtual bool exists_table(const std::string &table_name) const;
   virtual int64_t last_row_id() const;
 
+  /**
+   接続時に適用し、実際に有効になった設定を返します
+
+   要求した値が受け付けられなかった場合 (mmap が無効なビルドや、
+   既存のデータベースの page_size など) は sqlite3 が報告する値になります。
+
+   @see SqliteOptions
+   */
+  SqliteOptions effective_options() const;
+
   virtual Status connect(const Config &config);
   virtual Status disconnect();
 
   virtual Status create_table(std::shared_ptr<Schema> schema);
+  virtual Status create_indexes(std::shared_ptr<Schema> schema);
   virtual Status drop_table(const std::string &table_name);
 
   virtual Status transaction(const std::function<Status()> &t);
 
   virtual Status execute_sql(const std::string &sql);
   using RowType = ConnectionInterface::RowType;
+  using ConnectionInterface::execute_sql_for_each;
   virtual Status execute_sql_for_each(
       const std::string &sql, const std::function<void(const RowType &)> &fn);
+  virtual Status execute_sql_for_each(
+      const std::string &sql, const std::function<void(const RowView &)> &fn);
+  virtual Status execute_sql_for_each(
+      const std::string &sql,
+      const std::function<void(const ColumnReader &)> &fn);
+  virtual Status execute_sql_for_each(
+      const std::string &sql, const std::function<void(const ValueRow &)> &fn);
+  virtual Status execute_sql_for_each_batch(
+      const std::string &sql, std::size_t batch_size,
+      const std::function<void(const RowBatch &)> &fn);
+  virtual Status execute_sql_columnar(const std::string &sql,
+                                      ColumnarResult *result);
+
+  /**
+   sql の結果を 1 レコードずつ取り出す Cursor を cursor に格納します
+
+   sqlite3 は常に 1 レコードずつ評価するため、options は効果を持ちません。
+
+   @see ConnectionInterface::query
+   @see CursorOptions
+   */
+  virtual Status query(const std::string &sql, std::unique_ptr<Cursor> *cursor,
+                       const CursorOptions &options = CursorOptions());
+
+  /**
+   table を rowid の範囲で partitions 個に分割し、並列に走査します
+
+   範囲毎に読み取り専用のコネクションとスレッドを用意し、
+   predicate を満たすレコードを fn に渡します。
+   fn は複数のスレッドから同時に呼び出されるため、partition 毎に別の領域へ集計してください。
+   すべての範囲を走査し終えると、呼び出したスレッドで partition の順に merge を呼び出します。
+   fn が例外を送出した場合は、すべての範囲の走査が終わるのを待ってから呼び出したスレッドで送出し直します。
+
+   範囲毎に別のコネクションで読み取るため、走査中の書き込みが一部の範囲にだけ見えることがあります。
+   メモリ上のデータベースと WITHOUT ROWID なテーブルには使えません。
+
+   @code
+   std::vector<int64_t> sums(8);
+   int64_t total = 0;
+   conn.parallel_for_each(
+       "orders", "status = 'paid'",
+       [&](std::size_t partition, const ookoto::RowView &row) {
+         sums[partition] += std::atoll(row.get("amount").data());
+       },
+       sums.size(), [&](std::size_t partition) { total += sums[partition]; });
+   @endcode
+
+   @param table 走査するテーブルを指定してください
+   @param predicate WHERE 句に加える条件を指定してください。空文字列なら全件です
+   @param fn 範囲の番号とレコードを受け取る関数を指定してください
+   @param partitions 分割数を指定してください。0 ならハードウェアのスレッド数です
+   @param merge 指定するとすべての走査が終わった後に範囲毎に呼び出します
+   @see Status
+   */
+  Status parallel_for_each(
+      const std::string &table, const std::string &predicate,
+      const std::function<void(std::size_t partition, const RowView &row)> &fn,
+      std::size_t partitions = 0,
+      const std::function<void(std::size_t partition)> &merge = nullptr);
+
+  /**
+   データベースを path へ別スレッドで複写し、その進行を task に格納します
+
+   options.pages_per_step ページずつ複写し、その間だけ書き込みを待たせるため、
+   書き込みを止めずに稼働中のデータベースのスナップショットを取得できます。
+   このコネクションからの書き込みは複写中のバックアップにも反映されます。
+   他のコネクションから書き込まれた場合は、次の複写で最初からやり直します。
+
+   切断するとバックアップは中断されます。
+
+   @code
+   ookoto::BackupOptions options;
+   options.pages_per_step = 128;
+   options.step_interval = 1000;
+   std::unique_ptr<ookoto::BackupTask> task;
+   conn.backup_to("snapshot.db", options, &task);
+   ...
+   auto result = task->wait();
+   @endcode
+
+   @param path 複写先のファイルを指定してください。既存のデータベースは置き換えられます
+   @param options 複写の単位、間隔および進み具合の通知先を指定してください
+   @param task 実行中のバックアップを格納します
+   @see BackupOptions
+   @see BackupTask
+   @see Status
+   */
+  Status backup_to(const std::string &path, const BackupOptions &options,
+                   std::unique_ptr<BackupTask> *task);
+
+  virtual Status execute_sql_cached(
+      const std::string &sql, const std::vector<Value> &params,
+      const std::function<void(const RowView &)> &fn);
+
+  virtual Status prepare(const std::string &sql,
+                         std::shared_ptr<PreparedStatement> *statement);
+  virtual StatementCacheStats statement_cache_stats() const;
+
+  virtual Status create_appender(std::shared_ptr<Schema> schema,
+                                 const BulkInsertOptions &options,
+                                 std::unique_ptr<Appender> *appender);
+  virtual Status bulk_insert(
+      std::shared_ptr<Schema> schema, const std::vector<Appender::Row> &rows,
+      const BulkInsertOptions &options = BulkInsertOptions(),
+      BulkInsertStats *stats = nullptr);
 
  private:
   class Impl;
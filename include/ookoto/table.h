@@ -0,0 +1,92 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "appender.h"
+#include "connection_interface.h"
+#include "row_view.h"
+#include "schema.h"
+#include "status.h"
+
+namespace ookoto {
+
+/**
+ @class Table
+
+ Schema のテーブルに対する INSERT, 主キーによる SELECT, UPDATE, DELETE を、
+ open 時に 1 度だけコンパイルしたステートメントで実行します。
+
+ 値は Appender と同じく文字列で渡し、Schema のカラムの型でバインドします。
+ 文字列型以外のカラムでは空文字列を NULL として扱います。
+
+ Table はコネクションを切断する前に破棄してください。
+
+ @code
+ ookoto::Table users(conn.get(), schema);
+ users.open();
+ users.insert({"alice", "42"});
+ users.find({"1"}, [](const ookoto::RowView &row) { ... });
+ @endcode
+ */
+class Table {
+ public:
+  using Row = Appender::Row;
+
+  /**
+   主キーのカラムの値を Schema に定義した順に並べたものです
+   */
+  using Key = std::vector<std::string>;
+
+  Table(ConnectionInterface *connection, std::shared_ptr<Schema> schema);
+  ~Table();
+
+  /**
+   ステートメントをコンパイルします
+
+   主キーを定義していない Schema では insert だけが使えます。
+
+   @see Status
+   */
+  Status open();
+
+  /**
+   row を書き込みます
+
+   @param row Schema に定義した順のカラムの値です。auto increment なカラムは含めません
+   @see Status
+   */
+  Status insert(const Row &row);
+
+  /**
+   key のレコードを取得して fn を呼び出します
+
+   @retval Status::not_found レコードが存在しない
+   @see Status
+   */
+  Status find(const Key &key, const std::function<void(const RowView &)> &fn);
+
+  /**
+   key のレコードを values で更新します
+
+   @param values 主キー以外のカラムの値を Schema に定義した順に並べてください
+   @see Status
+   */
+  Status update(const Key &key, const Row &values);
+
+  /**
+   key のレコードを削除します
+
+   @see Status
+   */
+  Status remove(const Key &key);
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> _impl;
+
+  Table(const Table &) = delete;
+  Table &operator=(const Table &) = delete;
+};
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "columnar_result.h"
+#include "row_view.h"
+
+namespace ookoto {
+
+/**
+ @class Value
+
+ 1 つのカラムの値をドライバのネイティブな型のまま保持します。
+
+ 整数と浮動小数点数は値として、文字列とバイナリはドライバのバッファへの参照として保持します。
+ 参照先はコールバックから戻るまでの間だけ有効です。
+ */
+class Value {
+ public:
+  using Type = ColumnarResult::Type;
+
+  /**
+   NULL を表す値を生成します
+   */
+  Value() : _integer(0) {}
+
+  static Value integer(int64_t value) {
+    Value v(Type::kInteger);
+    v._integer = value;
+    return v;
+  }
+
+  static Value real(double value) {
+    Value v(Type::kReal);
+    v._real = value;
+    return v;
+  }
+
+  static Value text(const char *data, std::size_t size) {
+    return bytes(Type::kText, data, size);
+  }
+
+  static Value blob(const void *data, std::size_t size) {
+    return bytes(Type::kBlob, static_cast<const char *>(data), size);
+  }
+
+  Type type() const { return _type; }
+  bool is_null() const { return _type == Type::kNull; }
+
+  /**
+   整数として返します。kReal は切り捨て、それ以外は 0 です
+   */
+  int64_t as_integer() const {
+    if (_type == Type::kInteger) {
+      return _integer;
+    }
+    if (_type == Type::kReal) {
+      return static_cast<int64_t>(_real);
+    }
+    return 0;
+  }
+
+  /**
+   浮動小数点数として返します。kInteger は変換し、それ以外は 0 です
+   */
+  double as_real() const {
+    if (_type == Type::kReal) {
+      return _real;
+    }
+    if (_type == Type::kInteger) {
+      return static_cast<double>(_integer);
+    }
+    return 0;
+  }
+
+  /**
+   kText あるいは kBlob の値を返します。途中に 0 を含むこともあります。
+   それ以外は NULL の StringView です
+   */
+  StringView as_bytes() const {
+    if (_type == Type::kText || _type == Type::kBlob) {
+      return StringView(_bytes.data, _bytes.size);
+    }
+    return StringView();
+  }
+
+ private:
+  struct Bytes {
+    const char *data;
+    std::size_t size;
+  };
+
+  Type _type = Type::kNull;
+  union {
+    int64_t _integer;
+    double _real;
+    Bytes _bytes;
+  };
+
+  explicit Value(Type type) : _type(type), _integer(0) {}
+
+  static Value bytes(Type type, const char *data, std::size_t size) {
+    Value v(type);
+    // an empty value still needs a non-null pointer to tell it from NULL
+    v._bytes.data = (data) ? data : "";
+    v._bytes.size = size;
+    return v;
+  }
+};
+
+/**
+ @class ValueRow
+
+ 1 レコードを Value の並びとして参照するビューです。
+ RowView と同じくカラム名の解決は結果セット毎に 1 度だけ行われます。
+ */
+class ValueRow {
+ public:
+  ValueRow(const RowView::Columns &columns, const Value *values)
+      : _columns(&columns), _values(values) {}
+
+  std::size_t size() const { return _columns->size(); }
+
+  const std::string &name(std::size_t index) const {
+    return _columns->name(index);
+  }
+
+  /**
+   name のカラム位置を返します。存在しなければ RowView::kNotFound を返します
+   */
+  int index_of(const std::string &name) const {
+    return _columns->index_of(name);
+  }
+
+  const Value &operator[](std::size_t index) const { return _values[index]; }
+
+  /**
+   name のカラムの値を返します。存在しなければ NULL を返します
+   */
+  Value get(const std::string &name) const {
+    auto index = index_of(name);
+    if (index == RowView::kNotFound) {
+      return Value();
+    }
+    return _values[index];
+  }
+
+ private:
+  const RowView::Columns *_columns = nullptr;
+  const Value *_values = nullptr;
+};
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cppformat/format.h>
+#include <ookoto/ookoto.h>
+#include <string>
+
+namespace ookoto {
+
+// Appends rows to a ColumnarResult one value at a time. Every column gets
+// exactly one append per row; the typed storage of a column whose type is
+// not known yet is padded once its first non-null value arrives.
+class ColumnarBuilder {
+ public:
+  using Type = ColumnarResult::Type;
+
+  explicit ColumnarBuilder(ColumnarResult *result) : _result(result) {
+    *_result = ColumnarResult();
+  }
+
+  void add_column(const std::string &name, Type type = Type::kNull) {
+    ColumnarResult::Column column;
+    column._name = name;
+    column._offsets.push_back(0);
+    _result->_columns.emplace_back(std::move(column));
+    if (type != Type::kNull) {
+      resolve(_result->_columns.size() - 1, type);
+    }
+  }
+
+  // fixes the type of column i on its first non-null value and returns the
+  // type values must be appended as. A column is promoted rather than lose
+  // a value: integers to reals, numbers to text or blobs and text to blobs.
+  Type resolve(std::size_t i, Type type) {
+    auto &column = _result->_columns[i];
+    if (column._type == Type::kNull) {
+      column._type = type;
+      pad(column);
+    } else if (column._type == Type::kInteger && type == Type::kReal) {
+      column._type = Type::kReal;
+      column._reals.assign(column._integers.begin(), column._integers.end());
+      column._integers.clear();
+    } else if (is_number(column._type) && !is_number(type)) {
+      format_numbers(column, type);
+    } else if (column._type == Type::kText && type == Type::kBlob) {
+      column._type = Type::kBlob;
+    }
+    return column._type;
+  }
+
+  void append_null(std::size_t i) {
+    auto &column = next(i, true);
+    switch (column._type) {
+      case Type::kInteger:
+        column._integers.push_back(0);
+        break;
+      case Type::kReal:
+        column._reals.push_back(0);
+        break;
+      case Type::kText:
+      case Type::kBlob:
+        column._offsets.push_back(column._arena.size());
+        break;
+      case Type::kNull:
+        break;
+    }
+  }
+
+  void append_integer(std::size_t i, int64_t value) {
+    next(i, false)._integers.push_back(value);
+  }
+
+  void append_real(std::size_t i, double value) {
+    next(i, false)._reals.push_back(value);
+  }
+
+  void append_bytes(std::size_t i, const char *data, std::size_t size) {
+    auto &column = next(i, false);
+    column._arena.insert(column._arena.end(), data, data + size);
+    column._offsets.push_back(column._arena.size());
+  }
+
+  void end_row() { _result->_row_count += 1; }
+
+ private:
+  ColumnarResult *_result = nullptr;
+
+  ColumnarResult::Column &next(std::size_t i, bool null) {
+    auto &column = _result->_columns[i];
+    if (column._size % 8 == 0) {
+      column._nulls.push_back(0);
+    }
+    if (null) {
+      column._nulls.back() |= 1 << (column._size % 8);
+      column._null_count += 1;
+    }
+    column._size += 1;
+    return column;
+  }
+
+  static bool is_number(Type type) {
+    return type == Type::kInteger || type == Type::kReal;
+  }
+
+  // rewrites the numbers appended so far as text
+  static void format_numbers(ColumnarResult::Column &column, Type type) {
+    for (std::size_t row = 0; row < column._size; row++) {
+      if (!column.is_null(row)) {
+        auto text = (column._type == Type::kInteger)
+                        ? fmt::format("{}", column._integers[row])
+                        : fmt::format("{}", column._reals[row]);
+        column._arena.insert(column._arena.end(), text.begin(), text.end());
+      }
+      column._offsets.push_back(column._arena.size());
+    }
+    column._integers.clear();
+    column._reals.clear();
+    column._type = type;
+  }
+
+  static void pad(ColumnarResult::Column &column) {
+    switch (column._type) {
+      case Type::kInteger:
+        column._integers.resize(column._size);
+        break;
+      case Type::kReal:
+        column._reals.resize(column._size);
+        break;
+      case Type::kText:
+      case Type::kBlob:
+        column._offsets.resize(column._size + 1, 0);
+        break;
+      case Type::kNull:
+        break;
+    }
+  }
+};
+}  // ookoto
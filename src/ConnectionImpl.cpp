@@ -1,11 +1,28 @@
 #include <cppformat/format.h>
 #include <ookoto/ookoto.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
 #include <memory>
+#include <set>
 #include "ConnectionImpl.h"
 
 namespace ookoto {
 
 Status ConnectionImpl::create_table(std::shared_ptr<Schema> schema) {
+  auto &primary_key = schema->primary_key();
+  if (!primary_key.empty()) {
+    bool column_key = false;
+    schema->each_define([&](const Schema::ColumnType &def) {
+      column_key |= std::get<Schema::kColumnProperties>(def)->primary_key();
+    });
+    if (column_key) {
+      return Status::invalid_argument(
+          "a column primary key along with define_primary_key");
+    }
+  }
+
   fmt::MemoryWriter buf;
 
   buf << "CREATE TABLE " << schema->table_name() << " (";
@@ -24,13 +41,511 @@ Status ConnectionImpl::create_table(std::shared_ptr<Schema> schema) {
     }
   });
 
+  if (!primary_key.empty()) {
+    buf << ", PRIMARY KEY (";
+    for (std::size_t i = 0; i < primary_key.size(); i++) {
+      buf << ((0 < i) ? ", " : "") << primary_key[i];
+    }
+    buf << ")";
+  }
+
   buf << ")";
 
-  return execute_sql(buf.str());
+  auto options = table_options_to_string(*schema);
+  if (!options.empty()) {
+    buf << " " << options;
+  }
+
+  auto result = execute_sql(buf.str());
+  if (!result.is_ok()) {
+    return result;
+  }
+  return build_indexes(schema, false);
+}
+
+Status ConnectionImpl::create_indexes(std::shared_ptr<Schema> schema) {
+  return build_indexes(schema, true);
 }
 
 Status ConnectionImpl::drop_table(const std::string &table_name) {
   return execute_sql(fmt::format("DROP TABLE {}", table_name));
 }
 
+std::string ConnectionImpl::index_columns(const Schema::Index &index) {
+  fmt::MemoryWriter buf;
+  for (auto &column : index.columns()) {
+    buf << ((0 < buf.size()) ? ", " : "") << column;
+  }
+  for (auto &column : index.include()) {
+    buf << ((0 < buf.size()) ? ", " : "") << column;
+  }
+  return buf.str();
+}
+
+Status ConnectionImpl::bulk_insert(std::shared_ptr<Schema> schema,
+                                   const std::vector<Appender::Row> &rows,
+                                   const BulkInsertOptions &options,
+                                   BulkInsertStats *stats) {
+  std::unique_ptr<Appender> appender;
+  auto result = create_appender(schema, options, &appender);
+  if (!result.is_ok()) {
+    return result;
+  }
+
+  for (auto &row : rows) {
+    result = appender->append(row);
+    if (!result.is_ok()) {
+      return result;
+    }
+  }
+
+  result = appender->flush();
+  if (stats != nullptr) {
+    *stats = appender->stats();
+  }
+  return result;
+}
+
+Status ConnectionImpl::bind_params(PreparedStatement &statement,
+                                   const std::vector<Value> &params) {
+  for (std::size_t i = 0; i < params.size(); i++) {
+    auto &param = params[i];
+    auto index = static_cast<int>(i + 1);
+
+    Status result;
+    switch (param.type()) {
+      case Value::Type::kInteger:
+        result = statement.bind(index, param.as_integer());
+        break;
+      case Value::Type::kReal:
+        result = statement.bind(index, param.as_real());
+        break;
+      case Value::Type::kText:
+      case Value::Type::kBlob:
+        result = statement.bind(index, param.as_bytes().to_string());
+        break;
+      case Value::Type::kNull:
+        result = statement.bind_null(index);
+        break;
+    }
+
+    if (!result.is_ok()) {
+      return result;
+    }
+  }
+
+  return Status::ok();
+}
+
+bool SqlTables::read(const std::string &sql, std::vector<std::string> *tables) {
+  tables->clear();
+  auto tokens = tokenize(sql);
+  collect(tokens, 0, false, tables);
+  return !tables->empty();
+}
+
+bool SqlTables::written(const std::string &sql,
+                        std::vector<std::string> *tables, bool *rows) {
+  static const std::set<std::string> kNeutral = {
+      "begin", "start",   "commit", "rollback", "savepoint", "release",
+      "set",   "use",     "show",   "select",   "explain",   "describe",
+      "desc",  "analyze", "check",  "checksum", "lock",      "unlock",
+  };
+  static const std::set<std::string> kWrites = {
+      "insert", "replace", "update", "delete", "truncate",
+      "drop",   "alter",   "rename", "create", "load",
+  };
+  static const std::set<std::string> kRowWrites = {
+      "insert", "replace", "update", "delete", "load",
+  };
+
+  tables->clear();
+  if (rows != nullptr) {
+    *rows = false;
+  }
+  auto tokens = tokenize(sql);
+  // every statement of a multi-statement string is classified on its own
+  auto begin = tokens.begin();
+  while (begin != tokens.end()) {
+    auto end = std::find(begin, tokens.end(), ";");
+    if (begin != end && kNeutral.count(*begin) == 0) {
+      if (kWrites.count(*begin) == 0) {
+        return false;
+      }
+      if (rows != nullptr && kRowWrites.count(*begin) != 0) {
+        *rows = true;
+      }
+      std::vector<std::string> statement(begin, end);
+      collect(statement, 1, true, tables);
+    }
+    begin = (end == tokens.end()) ? end : end + 1;
+  }
+  return true;
+}
+
+std::string SqlTables::normalize(const std::string &table) {
+  auto dot = table.find_last_of('.');
+  auto name = (dot == std::string::npos) ? table : table.substr(dot + 1);
+
+  std::string normalized;
+  for (auto c : name) {
+    if (c == '`' || c == '"' || c == '[' || c == ']') {
+      continue;
+    }
+    normalized += std::tolower(static_cast<unsigned char>(c));
+  }
+  return normalized;
+}
+
+// words are lower-cased, quoted identifiers keep their opening quote so they
+// never match a keyword, string literals become a single "'" and comments
+// are dropped
+std::vector<std::string> SqlTables::tokenize(const std::string &sql) {
+  std::vector<std::string> tokens;
+  std::size_t i = 0;
+  auto size = sql.size();
+  while (i < size) {
+    auto c = sql[i];
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      i += 1;
+    } else if (c == '#' || (c == '-' && sql.compare(i, 2, "--") == 0)) {
+      i = sql.find('\n', i);
+    } else if (c == '/' && sql.compare(i, 2, "/*") == 0) {
+      i = sql.find("*/", i + 2);
+      i = (i == std::string::npos) ? i : i + 2;
+    } else if (c == '\'' || c == '`' || c == '"' || c == '[') {
+      auto close = (c == '[') ? ']' : c;
+      auto end = i + 1;
+      while (end < size && sql[end] != close) {
+        end += (sql[end] == '\\') ? 2 : 1;
+      }
+      tokens.push_back((c == '\'') ? std::string(1, c)
+                                   : sql.substr(i, std::min(end, size) - i));
+      i = end + 1;
+    } else if (std::isalnum(static_cast<unsigned char>(c)) || c == '_' ||
+               c == '$') {
+      std::string word;
+      while (i < size && (std::isalnum(static_cast<unsigned char>(sql[i])) ||
+                          sql[i] == '_' || sql[i] == '$')) {
+        word += std::tolower(static_cast<unsigned char>(sql[i]));
+        i += 1;
+      }
+      tokens.push_back(word);
+    } else {
+      tokens.push_back(std::string(1, c));
+      i += 1;
+    }
+  }
+  return tokens;
+}
+
+// collects the names listed after FROM, JOIN and INTO, and from begin on if
+// naming is set. A list ends at any other keyword or punctuation, and
+// restarts at the next FROM or JOIN, so the tables of subqueries are found as
+// well.
+void SqlTables::collect(const std::vector<std::string> &tokens,
+                        std::size_t begin, bool naming,
+                        std::vector<std::string> *tables) {
+  static const std::set<std::string> kStarts = {
+      "from", "join", "straight_join", "into",
+  };
+  static const std::set<std::string> kSkips = {
+      "as",           "inner",        "left",   "right",   "outer",
+      "cross",        "natural",      "full",   "lateral", "table",
+      "tables",       "if",           "exists", "not",     "only",
+      "to",           "temporary",    "ignore", "quick",   "online",
+      "delayed",      "low_priority", "high_priority",
+  };
+  static const std::set<std::string> kEnds = {
+      "where",  "on",     "using",     "group",     "order",     "limit",
+      "having", "union",  "window",    "for",       "lock",      "set",
+      "values", "value",  "select",    "partition", "like",      "except",
+      "intersect", "returning", "default",
+  };
+
+  for (auto i = begin; i < tokens.size(); i++) {
+    auto &token = tokens[i];
+    if (kStarts.count(token) != 0) {
+      naming = true;
+    } else if (!naming || token == "," || token == "." ||
+               kSkips.count(token) != 0) {
+      continue;
+    } else if (kEnds.count(token) != 0 || is_punctuation(token)) {
+      naming = false;
+    } else {
+      auto table = normalize(token);
+      if (!table.empty() && table != "dual" &&
+          std::find(tables->begin(), tables->end(), table) == tables->end()) {
+        tables->push_back(table);
+      }
+    }
+  }
+}
+
+bool SqlTables::is_punctuation(const std::string &token) {
+  return token.size() == 1 && !std::isalnum(static_cast<unsigned char>(token[0])) &&
+         token[0] != '_' && token[0] != '$';
+}
+
+void QueryProfile::stop() {
+  if (!_stopped) {
+    _elapsed = std::chrono::steady_clock::now() - _start;
+    _stopped = true;
+  }
+}
+
+const std::string &QueryProfile::key() {
+  if (_key.empty()) {
+    _key = Profiler::normalize(_sql);
+  }
+  return _key;
+}
+
+bool QueryProfile::claim_plan() {
+  if (!enabled()) {
+    return false;
+  }
+
+  stop();
+  return _profiler->_impl->claim_plan(
+      key(), std::chrono::duration_cast<std::chrono::microseconds>(_elapsed));
+}
+
+void QueryProfile::set_plan(const std::string &plan) {
+  _profiler->_impl->set_plan(key(), plan);
+}
+
+Status QueryProfile::finish(const Status &status) {
+  if (!enabled()) {
+    return status;
+  }
+
+  stop();
+  Profiler::Impl::Sample sample;
+  sample.elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(_elapsed);
+  sample.callback =
+      std::chrono::duration_cast<std::chrono::microseconds>(_callback);
+  sample.rows = _rows;
+  sample.counters = _counters;
+  // an empty result is reported as not_found by sqlite3
+  sample.failed = !status.is_ok() && !status.is_not_found();
+  _profiler->_impl->record(key(), sample);
+  return status;
+}
+
+CachedQuery::CachedQuery(ResultCache &cache, const std::string &sql,
+                         const std::vector<Value> &params)
+    : _cache(*cache._impl), _sql(sql), _key(sql) {
+  // the SQL text, then a type tag and the bytes of every bound value
+  _key += '\0';
+  for (auto &param : params) {
+    _key += static_cast<char>(param.type());
+    switch (param.type()) {
+      case Value::Type::kInteger: {
+        auto integer = param.as_integer();
+        _key.append(reinterpret_cast<const char *>(&integer), sizeof(integer));
+        break;
+      }
+      case Value::Type::kReal: {
+        auto real = param.as_real();
+        _key.append(reinterpret_cast<const char *>(&real), sizeof(real));
+        break;
+      }
+      case Value::Type::kText:
+      case Value::Type::kBlob: {
+        auto bytes = param.as_bytes();
+        auto size = bytes.size();
+        _key.append(reinterpret_cast<const char *>(&size), sizeof(size));
+        _key.append(bytes.data(), size);
+        break;
+      }
+      case Value::Type::kNull:
+        break;
+    }
+  }
+  _generation = _cache.generation();
+}
+
+bool CachedQuery::replay(const std::function<void(const RowView &)> &fn,
+                         Status *status) {
+  auto entry = _cache.lookup(_key);
+  if (entry == nullptr) {
+    return false;
+  }
+
+  using Entry = ResultCache::Impl::Entry;
+  std::vector<StringView> values(entry->columns.size());
+  RowView row(entry->columns, values.data());
+  auto cell = entry->cells.begin();
+  for (std::size_t r = 0; r < entry->rows; r++) {
+    for (auto &value : values) {
+      value = (cell->second == Entry::kNull)
+                  ? StringView()
+                  : StringView(entry->data.data() + cell->first, cell->second);
+      ++cell;
+    }
+    fn(row);
+  }
+
+  *status = (0 < entry->rows) ? Status::ok() : Status::not_found();
+  return true;
+}
+
+std::function<void(const RowView &)> CachedQuery::record(
+    const std::function<void(const RowView &)> &fn) {
+  _entry = std::make_shared<ResultCache::Impl::Entry>();
+  return [this, fn](const RowView &row) {
+    using Entry = ResultCache::Impl::Entry;
+    auto &entry = *_entry;
+    if (entry.rows == 0) {
+      for (std::size_t i = 0; i < row.size(); i++) {
+        entry.columns.add(row.name(i));
+      }
+    }
+    for (std::size_t i = 0; i < row.size(); i++) {
+      auto &value = row[i];
+      if (value.is_null()) {
+        entry.cells.emplace_back(0, Entry::kNull);
+        continue;
+      }
+      entry.cells.emplace_back(entry.data.size(), value.size());
+      entry.data.append(value.data(), value.size());
+    }
+    entry.rows += 1;
+    fn(row);
+  };
+}
+
+void CachedQuery::store(const Status &status,
+                        const std::vector<std::string> &tables) {
+  if (_entry == nullptr || tables.empty() ||
+      !(status.is_ok() || status.is_not_found())) {
+    return;
+  }
+  _cache.store(_key, _generation, tables, _entry);
+}
+
+bool CachedQuery::dependencies(std::vector<std::string> *tables) {
+  return _cache.dependencies(_sql, tables);
+}
+
+void CachedQuery::set_dependencies(const std::vector<std::string> &tables) {
+  _cache.set_dependencies(_sql, tables);
+}
+
+AppenderBase::AppenderBase(std::shared_ptr<Schema> schema,
+                           const BulkInsertOptions &options)
+    : _table_name(schema->table_name()), _options(options) {
+  if (_options.chunk_size == 0) {
+    _options.chunk_size = 1;
+  }
+
+  schema->each_define([&](const Schema::ColumnType &def) {
+    if (std::get<Schema::kColumnProperties>(def)->auto_increment()) {
+      return;
+    }
+    _columns.push_back(
+        {std::get<Schema::kColumnName>(def), std::get<Schema::kColumnType>(def)});
+  });
+}
+
+std::string AppenderBase::insert_prefix() const {
+  fmt::MemoryWriter buf;
+
+  buf << "INSERT INTO " << _table_name << " (";
+  for (std::size_t i = 0; i < _columns.size(); i++) {
+    if (0 < i) {
+      buf << ", ";
+    }
+    buf << _columns[i].name;
+  }
+  buf << ") VALUES ";
+
+  return buf.str();
+}
+
+Status AppenderBase::check_row(const Row &row) {
+  if (row.size() != _columns.size()) {
+    return Status::invalid_argument(
+        fmt::format("expected {} values, got {}", _columns.size(), row.size()));
+  }
+
+  if (!_started) {
+    _started = true;
+    _start = std::chrono::steady_clock::now();
+  }
+  return Status::ok();
+}
+
+Status AppenderBase::bind_row(PreparedStatement &statement,
+                              const Row &row) const {
+  return bind_values(statement, _columns, row);
+}
+
+Status AppenderBase::bind_values(PreparedStatement &statement,
+                                 const std::vector<Column> &columns,
+                                 const Row &values, int offset) {
+  for (std::size_t i = 0; i < columns.size(); i++) {
+    auto &column = columns[i];
+    auto &value = values[i];
+    auto index = offset + static_cast<int>(i + 1);
+
+    Status result;
+    if (is_null(column, value)) {
+      result = statement.bind_null(index);
+    } else if (column.type == Schema::Type::kInteger ||
+               column.type == Schema::Type::kBoolean) {
+      int64_t integer;
+      if (!to_integer(value, &integer)) {
+        return Status::invalid_argument(
+            fmt::format("{} is not an integer: {}", column.name, value));
+      }
+      result = statement.bind(index, integer);
+    } else if (column.type == Schema::Type::kFloat) {
+      double real;
+      if (!to_real(value, &real)) {
+        return Status::invalid_argument(
+            fmt::format("{} is not a number: {}", column.name, value));
+      }
+      result = statement.bind(index, real);
+    } else {
+      result = statement.bind(index, value);
+    }
+
+    if (!result.is_ok()) {
+      return result;
+    }
+  }
+
+  return Status::ok();
+}
+
+void AppenderBase::chunk_committed(std::size_t rows) {
+  _stats.rows += rows;
+  _stats.chunks += 1;
+  _stats.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - _start)
+                       .count();
+}
+
+bool AppenderBase::is_null(const Column &column, const std::string &value) {
+  return value.empty() && column.type != Schema::Type::kString &&
+         column.type != Schema::Type::kText;
+}
+
+bool AppenderBase::to_integer(const std::string &value, int64_t *result) {
+  char *end = nullptr;
+  errno = 0;
+  *result = std::strtoll(value.c_str(), &end, 10);
+  return errno == 0 && end == value.c_str() + value.size();
+}
+
+bool AppenderBase::to_real(const std::string &value, double *result) {
+  char *end = nullptr;
+  errno = 0;
+  *result = std::strtod(value.c_str(), &end);
+  return errno == 0 && end == value.c_str() + value.size();
+}
+
 }  // ookoto
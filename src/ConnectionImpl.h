@@ -1,7 +1,14 @@
+#pragma once
+
 #include <cppformat/format.h>
 #include <ookoto/ookoto.h>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
+#include "Profiler.h"
+#include "ResultCache.h"
 
 namespace ookoto {
 
@@ -10,10 +17,218 @@ class ConnectionImpl {
   virtual ~ConnectionImpl() = default;
 
   Status create_table(std::shared_ptr<Schema> schema);
+  Status create_indexes(std::shared_ptr<Schema> schema);
   Status drop_table(const std::string &table_name);
+  Status bulk_insert(std::shared_ptr<Schema> schema,
+                     const std::vector<Appender::Row> &rows,
+                     const BulkInsertOptions &options, BulkInsertStats *stats);
 
   virtual Status execute_sql(const std::string &sql) = 0;
+  virtual Status create_appender(std::shared_ptr<Schema> schema,
+                                 const BulkInsertOptions &options,
+                                 std::unique_ptr<Appender> *appender) = 0;
   virtual std::string column_type_to_string(Schema::Type type) = 0;
   virtual std::string column_prop_to_string(Schema::PropertyPtr prop) = 0;
+  virtual std::string table_options_to_string(const Schema &schema) = 0;
+
+  // creates the indexes of schema that are deferred, or those that are not
+  virtual Status build_indexes(std::shared_ptr<Schema> schema,
+                               bool deferred) = 0;
+
+  // the key columns of index followed by the columns it includes
+  static std::string index_columns(const Schema::Index &index);
+
+  // binds params[i] to parameter i + 1 according to its type; blobs are
+  // bound as strings
+  static Status bind_params(PreparedStatement &statement,
+                            const std::vector<Value> &params);
+};
+
+// Finds the tables a statement touches by scanning its tokens. The scan is
+// conservative: aliases and other names may be reported as well, which only
+// costs extra invalidations.
+class SqlTables {
+ public:
+  // the tables named after FROM and JOIN; false if there are none
+  static bool read(const std::string &sql, std::vector<std::string> *tables);
+
+  // the tables a write may change; an empty list for statements that change
+  // no rows (BEGIN, SET, ...), false when any of the statements separated by
+  // ';' is not understood. rows is set when a statement changes rows
+  // (INSERT, UPDATE, ...) rather than definitions (CREATE, DROP, ...).
+  static bool written(const std::string &sql, std::vector<std::string> *tables,
+                      bool *rows = nullptr);
+
+  // lower-cased, unquoted and without the database prefix
+  static std::string normalize(const std::string &table);
+
+ private:
+  static std::vector<std::string> tokenize(const std::string &sql);
+  static void collect(const std::vector<std::string> &tokens, std::size_t begin,
+                      bool naming, std::vector<std::string> *tables);
+  static bool is_punctuation(const std::string &token);
+};
+
+// Serves one execute_sql_cached call: replays a hit, or records the rows of a
+// miss and stores them once the query has finished.
+class CachedQuery {
+ public:
+  CachedQuery(ResultCache &cache, const std::string &sql,
+              const std::vector<Value> &params);
+
+  // replays the cached rows into fn; false on a miss
+  bool replay(const std::function<void(const RowView &)> &fn, Status *status);
+
+  // fn, recording each row it is called with
+  std::function<void(const RowView &)> record(
+      const std::function<void(const RowView &)> &fn);
+
+  // stores the recorded rows as depending on tables, unless one of them
+  // changed since the query started
+  void store(const Status &status, const std::vector<std::string> &tables);
+
+  // the tables sql depends on, as remembered by the cache
+  bool dependencies(std::vector<std::string> *tables);
+  void set_dependencies(const std::vector<std::string> &tables);
+
+ private:
+  ResultCache::Impl &_cache;
+  const std::string &_sql;
+  std::string _key;
+  uint64_t _generation = 0;
+  std::shared_ptr<ResultCache::Impl::Entry> _entry;
+};
+
+// Times one statement and reports it to the configured QueryLogger. Without
+// a logger it costs a null check and never reads the clock.
+class QueryLog {
+ public:
+  QueryLog(QueryLogger *logger, const std::string &sql)
+      : _logger(logger), _sql(sql) {
+    if (_logger != nullptr) {
+      _start = std::chrono::steady_clock::now();
+    }
+  }
+
+  Status finish(const Status &status) {
+    if (_logger != nullptr) {
+      _logger->log(_sql,
+                   std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - _start),
+                   status);
+    }
+    return status;
+  }
+
+ private:
+  QueryLogger *_logger = nullptr;
+  const std::string &_sql;
+  std::chrono::steady_clock::time_point _start;
+};
+
+// Profiles one statement for the configured Profiler: the wall time, the
+// part of it spent in the caller's callback, the rows handed over and, for
+// a slow statement, its plan. Without a profiler it costs a null check, like
+// QueryLog.
+class QueryProfile {
+ public:
+  QueryProfile(Profiler *profiler, const std::string &sql)
+      : _profiler(profiler), _sql(sql) {
+    if (_profiler != nullptr) {
+      _start = std::chrono::steady_clock::now();
+    }
+  }
+
+  bool enabled() const { return _profiler != nullptr; }
+
+  // fn, timing each call as callback time and counting the rows it gets
+  template <typename Row>
+  std::function<void(const Row &)> wrap(
+      const std::function<void(const Row &)> &fn) {
+    if (fn == nullptr || !enabled()) {
+      return fn;
+    }
+    return [this, &fn](const Row &row) {
+      auto start = std::chrono::steady_clock::now();
+      fn(row);
+      _callback += std::chrono::steady_clock::now() - start;
+      _rows += rows_in(row);
+    };
+  }
+
+  void add_rows(uint64_t rows) { _rows += rows; }
+
+  void set_counters(const StatementCounters &counters) {
+    _counters = counters;
+  }
+
+  // stops the clock and tells whether the caller should explain the
+  // statement now and hand the plan to set_plan
+  bool claim_plan();
+  void set_plan(const std::string &plan);
+
+  Status finish(const Status &status);
+
+ private:
+  Profiler *_profiler = nullptr;
+  const std::string &_sql;
+  std::string _key;
+  std::chrono::steady_clock::time_point _start;
+  std::chrono::steady_clock::duration _elapsed{0};
+  std::chrono::steady_clock::duration _callback{0};
+  bool _stopped = false;
+  uint64_t _rows = 0;
+  StatementCounters _counters;
+
+  template <typename Row>
+  static uint64_t rows_in(const Row &) {
+    return 1;
+  }
+  static uint64_t rows_in(const RowBatch &batch) { return batch.size(); }
+
+  void stop();
+  const std::string &key();
+};
+
+// Bookkeeping shared by the driver appenders: the insertable columns of the
+// schema, row validation and throughput accounting.
+class AppenderBase : public Appender {
+ public:
+  struct Column {
+    std::string name;
+    Schema::Type type;
+  };
+
+  AppenderBase(std::shared_ptr<Schema> schema,
+               const BulkInsertOptions &options);
+
+  BulkInsertStats stats() const override { return _stats; }
+
+  // binds values[i] to parameter offset + i + 1 as the native type of
+  // columns[i]
+  static Status bind_values(PreparedStatement &statement,
+                            const std::vector<Column> &columns,
+                            const Row &values, int offset = 0);
+
+ protected:
+  std::string _table_name;
+  std::vector<Column> _columns;
+  BulkInsertOptions _options;
+  BulkInsertStats _stats;
+
+  // "INSERT INTO table (a, b) VALUES "
+  std::string insert_prefix() const;
+
+  Status check_row(const Row &row);
+  Status bind_row(PreparedStatement &statement, const Row &row) const;
+  void chunk_committed(std::size_t rows);
+
+  static bool is_null(const Column &column, const std::string &value);
+  static bool to_integer(const std::string &value, int64_t *result);
+  static bool to_real(const std::string &value, double *result);
+
+ private:
+  bool _started = false;
+  std::chrono::steady_clock::time_point _start;
 };
 }  // ookoto
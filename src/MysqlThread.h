@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef OOKOTO_WITHOUT_MYSQL
+#include <mysql.h>
+#endif
+
+namespace ookoto {
+
+// Sets up libmysqlclient's per-thread state for a thread of our own that
+// may drive MySQL connections, and releases it when the thread leaves the
+// scope. Without the mysql driver it does nothing.
+class MysqlThread {
+ public:
+  MysqlThread() {
+#ifndef OOKOTO_WITHOUT_MYSQL
+    mysql_thread_init();
+#endif
+  }
+
+  ~MysqlThread() {
+#ifndef OOKOTO_WITHOUT_MYSQL
+    mysql_thread_end();
+#endif
+  }
+};
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <ookoto/ookoto.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ookoto {
+
+// Totals per normalized statement. One lock covers the table; it is taken
+// once when a statement finishes, and once more before a slow statement
+// asks for its plan.
+class Profiler::Impl {
+ public:
+  // what one execution adds to its statement
+  struct Sample {
+    std::chrono::microseconds elapsed{0};
+    std::chrono::microseconds callback{0};
+    uint64_t rows = 0;
+    StatementCounters counters;
+    bool failed = false;
+  };
+
+  explicit Impl(const ProfilerOptions &options) : _options(options) {}
+
+  void record(const std::string &sql, const Sample &sample) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto entry = find(sql);
+    if (entry == nullptr) {
+      _untracked += 1;
+      return;
+    }
+
+    auto &profile = entry->profile;
+    profile.calls += 1;
+    profile.failures += (sample.failed) ? 1 : 0;
+    profile.rows += sample.rows;
+    profile.total += sample.elapsed;
+    profile.callback += sample.callback;
+    profile.driver = profile.total - profile.callback;
+    profile.max = std::max(profile.max, sample.elapsed);
+    profile.counters.fullscan_steps += sample.counters.fullscan_steps;
+    profile.counters.sorts += sample.counters.sorts;
+    profile.counters.autoindexes += sample.counters.autoindexes;
+    profile.counters.vm_steps += sample.counters.vm_steps;
+  }
+
+  // true once per statement, for the first execution that took at least
+  // the plan threshold; the caller then explains it and calls set_plan
+  bool claim_plan(const std::string &sql, std::chrono::microseconds elapsed) {
+    if (!_options.capture_plans || elapsed < _options.plan_threshold) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto entry = find(sql);
+    if (entry == nullptr || entry->plan_claimed) {
+      return false;
+    }
+    entry->plan_claimed = true;
+    return true;
+  }
+
+  void set_plan(const std::string &sql, const std::string &plan) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(sql);
+    if (it != _entries.end()) {
+      it->second.profile.plan = plan;
+    }
+  }
+
+  std::vector<StatementProfile> top(std::size_t n) const {
+    std::vector<StatementProfile> profiles;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      profiles.reserve(_entries.size());
+      for (auto &entry : _entries) {
+        if (0 < entry.second.profile.calls) {
+          profiles.push_back(entry.second.profile);
+        }
+      }
+    }
+
+    auto count = std::min(n, profiles.size());
+    std::partial_sort(profiles.begin(), profiles.begin() + count,
+                      profiles.end(),
+                      [](const StatementProfile &a, const StatementProfile &b) {
+                        return b.total < a.total;
+                      });
+    profiles.resize(count);
+    return profiles;
+  }
+
+  uint64_t untracked() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _untracked;
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _untracked = 0;
+  }
+
+ private:
+  struct Entry {
+    StatementProfile profile;
+    bool plan_claimed = false;
+  };
+
+  ProfilerOptions _options;
+  mutable std::mutex _mutex;
+  std::unordered_map<std::string, Entry> _entries;
+  uint64_t _untracked = 0;
+
+  // the entry of sql, added while there is room; the caller holds the lock
+  Entry *find(const std::string &sql) {
+    auto it = _entries.find(sql);
+    if (it != _entries.end()) {
+      return &it->second;
+    }
+    if (_options.max_statements <= _entries.size()) {
+      return nullptr;
+    }
+
+    auto &entry = _entries[sql];
+    entry.profile.sql = sql;
+    return &entry;
+  }
+};
+}  // ookoto
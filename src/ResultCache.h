@@ -0,0 +1,195 @@
+#pragma once
+
+#include <ookoto/ookoto.h>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace ookoto {
+
+// LRU cache of result sets keyed by SQL text plus bound values, bounded by
+// bytes. Every entry is indexed by the tables it read so a write drops only
+// the results that depend on it.
+//
+// Entries are immutable and shared, so a hit is replayed without holding the
+// lock. A result read while one of its tables changed is never stored: each
+// invalidation bumps a generation, and store() rejects results whose read
+// started before the last invalidation of any of their tables.
+class ResultCache::Impl {
+ public:
+  struct Entry {
+    RowView::Columns columns;
+    // the values of every row, back to back
+    std::string data;
+    // offset and size of each value in data; size is kNull for NULL
+    std::vector<std::pair<std::size_t, std::size_t>> cells;
+    std::size_t rows = 0;
+
+    static const std::size_t kNull = static_cast<std::size_t>(-1);
+
+    std::size_t bytes() const {
+      auto size = sizeof(Entry) + data.size() +
+                  cells.size() * sizeof(cells[0]);
+      for (std::size_t i = 0; i < columns.size(); i++) {
+        size += columns.name(i).size() * 2 + sizeof(std::string) * 2;
+      }
+      return size;
+    }
+  };
+
+  using EntryPtr = std::shared_ptr<const Entry>;
+
+  // the dependency lists of more statements than this are recomputed
+  static const std::size_t kMaxDependencies = 4096;
+
+  explicit Impl(std::size_t capacity) : _capacity(capacity) {}
+
+  uint64_t generation() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _generation;
+  }
+
+  EntryPtr lookup(const std::string &key) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if (it == _index.end()) {
+      _stats.misses += 1;
+      return nullptr;
+    }
+
+    _stats.hits += 1;
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return it->second->entry;
+  }
+
+  void store(const std::string &key, uint64_t generation,
+             const std::vector<std::string> &tables, EntryPtr entry) {
+    auto bytes = entry->bytes() + key.size();
+    for (auto &table : tables) {
+      bytes += table.size();
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_capacity < bytes || generation < _cleared ||
+        _index.find(key) != _index.end()) {
+      return;
+    }
+    for (auto &table : tables) {
+      auto it = _tables.find(table);
+      if (it != _tables.end() && generation < it->second.generation) {
+        return;
+      }
+    }
+
+    _entries.push_front({key, tables, entry, bytes});
+    _index.emplace(key, _entries.begin());
+    for (auto &table : tables) {
+      _tables[table].keys.insert(key);
+    }
+    _bytes += bytes;
+    evict();
+  }
+
+  void invalidate(const std::string &table) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto &dependents = _tables[table];
+    dependents.generation = ++_generation;
+    auto keys = std::move(dependents.keys);
+    dependents.keys.clear();
+    for (auto &key : keys) {
+      auto it = _index.find(key);
+      if (it != _index.end()) {
+        erase(it->second);
+        _stats.invalidations += 1;
+      }
+    }
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.invalidations += _entries.size();
+    _cleared = ++_generation;
+    _entries.clear();
+    _index.clear();
+    _tables.clear();
+    _dependencies.clear();
+    _bytes = 0;
+  }
+
+  bool dependencies(const std::string &sql, std::vector<std::string> *tables) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _dependencies.find(sql);
+    if (it == _dependencies.end()) {
+      return false;
+    }
+    *tables = it->second;
+    return true;
+  }
+
+  void set_dependencies(const std::string &sql,
+                        const std::vector<std::string> &tables) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (kMaxDependencies <= _dependencies.size()) {
+      _dependencies.clear();
+    }
+    _dependencies[sql] = tables;
+  }
+
+  ResultCacheStats stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto stats = _stats;
+    stats.entries = _entries.size();
+    stats.bytes = _bytes;
+    stats.capacity = _capacity;
+    return stats;
+  }
+
+ private:
+  struct Slot {
+    std::string key;
+    std::vector<std::string> tables;
+    EntryPtr entry;
+    std::size_t bytes;
+  };
+
+  struct Dependents {
+    std::unordered_set<std::string> keys;
+    uint64_t generation = 0;
+  };
+
+  using Iterator = std::list<Slot>::iterator;
+
+  mutable std::mutex _mutex;
+  std::size_t _capacity;
+  std::size_t _bytes = 0;
+  uint64_t _generation = 0;
+  uint64_t _cleared = 0;
+  std::list<Slot> _entries;
+  std::unordered_map<std::string, Iterator> _index;
+  std::unordered_map<std::string, Dependents> _tables;
+  std::unordered_map<std::string, std::vector<std::string>> _dependencies;
+  ResultCacheStats _stats;
+
+  void erase(Iterator it) {
+    for (auto &table : it->tables) {
+      _tables[table].keys.erase(it->key);
+    }
+    _bytes -= it->bytes;
+    _index.erase(it->key);
+    _entries.erase(it);
+  }
+
+  void evict() {
+    while (_capacity < _bytes && !_entries.empty()) {
+      erase(std::prev(_entries.end()));
+      _stats.evictions += 1;
+    }
+  }
+};
+}  // ookoto
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <ookoto/ookoto.h>
+#include <functional>
+#include <string>
+
+namespace ookoto {
+
+// Fills a RowBatch one value at a time and hands it over once batch_size
+// rows are in. Values are copied into the arena by offset, since the arena
+// may grow while the block fills; the views are resolved only when the
+// block is delivered. Nothing is freed between blocks, so once the buffers
+// have grown to the largest block a batch costs no allocation.
+class RowBatchBuilder {
+ public:
+  using Callback = std::function<void(const RowBatch &)>;
+
+  RowBatchBuilder(const RowView::Columns &columns, std::size_t batch_size,
+                  const Callback &fn)
+      : _batch_size(batch_size), _fn(fn) {
+    _batch._columns = &columns;
+    _batch._cells.reserve(batch_size * columns.size());
+    _batch._values.reserve(batch_size * columns.size());
+  }
+
+  void append(const char *data, std::size_t size) {
+    _batch._cells.emplace_back(_batch._arena.size(), size);
+    _batch._arena.append(data, size);
+  }
+
+  void append_null() { _batch._cells.emplace_back(0, kNull); }
+
+  void end_row() {
+    _batch._rows += 1;
+    if (_batch._rows == _batch_size) {
+      deliver();
+    }
+  }
+
+  // hands over the rows collected so far
+  void deliver() {
+    if (_batch._rows == 0) {
+      return;
+    }
+
+    auto arena = _batch._arena.data();
+    _batch._values.clear();
+    for (auto &cell : _batch._cells) {
+      _batch._values.push_back((cell.second == kNull)
+                                   ? StringView()
+                                   : StringView(arena + cell.first,
+                                                cell.second));
+    }
+    _fn(_batch);
+
+    _batch._rows = 0;
+    _batch._cells.clear();
+    _batch._arena.clear();
+  }
+
+ private:
+  // an enumerator, unlike a static member, needs no definition when bound
+  // to a reference
+  enum : std::size_t { kNull = static_cast<std::size_t>(-1) };
+
+  RowBatch _batch;
+  std::size_t _batch_size;
+  const Callback &_fn;
+};
+}  // ookoto
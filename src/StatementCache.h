@@ -0,0 +1,88 @@
+#pragma once
+
+#include <ookoto/ookoto.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace ookoto {
+
+// LRU cache of compiled statements keyed by SQL text.
+//
+// A cached statement is handed out only while nobody else holds it, so two
+// callers never share bindings or a half-consumed result.
+template <typename T>
+class StatementCache {
+ public:
+  static const std::size_t kDefaultCapacity = 64;
+
+  explicit StatementCache(std::size_t capacity = kDefaultCapacity)
+      : _capacity(capacity) {}
+
+  void set_capacity(std::size_t capacity) {
+    _capacity = capacity;
+    evict();
+  }
+
+  // returns the cached statement for sql, or nullptr on miss
+  std::shared_ptr<T> acquire(const std::string &sql) {
+    auto it = _index.find(sql);
+    if (it == _index.end() || it->second->second.use_count() != 1) {
+      _stats.misses += 1;
+      return nullptr;
+    }
+
+    _stats.hits += 1;
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return it->second->second;
+  }
+
+  void insert(const std::string &sql, const std::shared_ptr<T> &statement) {
+    if (_capacity == 0 || _index.find(sql) != _index.end()) {
+      return;
+    }
+
+    _entries.emplace_front(sql, statement);
+    _index.emplace(sql, _entries.begin());
+    evict();
+  }
+
+  void erase(const std::string &sql) {
+    auto it = _index.find(sql);
+    if (it != _index.end()) {
+      _entries.erase(it->second);
+      _index.erase(it);
+    }
+  }
+
+  void clear() {
+    _index.clear();
+    _entries.clear();
+  }
+
+  StatementCacheStats stats() const {
+    auto stats = _stats;
+    stats.size = _entries.size();
+    stats.capacity = _capacity;
+    return stats;
+  }
+
+ private:
+  using Entry = std::pair<std::string, std::shared_ptr<T>>;
+
+  std::size_t _capacity;
+  std::list<Entry> _entries;
+  std::unordered_map<std::string, typename std::list<Entry>::iterator> _index;
+  StatementCacheStats _stats;
+
+  void evict() {
+    while (_capacity < _entries.size()) {
+      _index.erase(_entries.back().first);
+      _entries.pop_back();
+      _stats.evictions += 1;
+    }
+  }
+};
+}  // ookoto
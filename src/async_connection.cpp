@@ -0,0 +1,175 @@
+#include <ookoto/ookoto.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "MysqlThread.h"
+
+namespace ookoto {
+
+// A single executor thread drains the whole queue per wake-up, so tasks
+// submitted back to back run without a context switch between them and the
+// submitting thread is only woken through its future.
+class AsyncConnection::Impl {
+ public:
+  explicit Impl(std::unique_ptr<ConnectionInterface> connection)
+      : _connection(std::move(connection)) {
+    _worker = std::thread(&Impl::run, this);
+  }
+
+  ~Impl() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+    }
+    _ready.notify_one();
+    _worker.join();
+  }
+
+  std::future<Status> submit(const Task &task) {
+    std::vector<Job> jobs;
+    jobs.emplace_back(bind(task));
+    auto future = jobs.back().get_future();
+    enqueue(&jobs);
+    return future;
+  }
+
+  std::vector<std::future<Status>> submit_all(const std::vector<Task> &tasks) {
+    std::vector<Job> jobs;
+    std::vector<std::future<Status>> futures;
+    for (auto &task : tasks) {
+      jobs.emplace_back(bind(task));
+      futures.emplace_back(jobs.back().get_future());
+    }
+    enqueue(&jobs);
+    return futures;
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idle.wait(lock, [&]() { return _stats.completed == _stats.submitted; });
+  }
+
+  AsyncConnectionStats stats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+  }
+
+ private:
+  using Job = std::packaged_task<Status()>;
+
+  std::unique_ptr<ConnectionInterface> _connection;
+  mutable std::mutex _mutex;
+  std::condition_variable _ready;
+  std::condition_variable _idle;
+  std::deque<Job> _queue;
+  bool _stopping = false;
+  AsyncConnectionStats _stats;
+  std::thread _worker;
+
+  Job bind(const Task &task) {
+    auto connection = _connection.get();
+    return Job([task, connection]() -> Status {
+      if (task == nullptr) {
+        return Status::invalid_argument();
+      }
+      return task(*connection);
+    });
+  }
+
+  void enqueue(std::vector<Job> *jobs) {
+    bool wake;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      // the executor only sleeps on an empty queue
+      wake = _queue.empty();
+      for (auto &job : *jobs) {
+        _queue.emplace_back(std::move(job));
+      }
+      _stats.submitted += jobs->size();
+      _stats.peak_queue_depth =
+          std::max(_stats.peak_queue_depth, _queue.size());
+    }
+    if (wake) {
+      _ready.notify_one();
+    }
+  }
+
+  void run() {
+    // the jobs may drive a MySQL connection
+    MysqlThread thread;
+    std::deque<Job> batch;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _ready.wait(lock, [&]() { return _stopping || !_queue.empty(); });
+        if (_queue.empty()) {
+          break;
+        }
+        batch.swap(_queue);
+        _stats.batches += 1;
+      }
+
+      for (auto &job : batch) {
+        job();
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stats.completed += batch.size();
+      }
+      batch.clear();
+      _idle.notify_all();
+    }
+  }
+};
+
+AsyncConnection::AsyncConnection(
+    std::unique_ptr<ConnectionInterface> connection)
+    : _impl(new Impl(std::move(connection))) {}
+
+AsyncConnection::~AsyncConnection() = default;
+
+std::future<Status> AsyncConnection::execute_sql(const std::string &sql) {
+  return _impl->submit(
+      [sql](ConnectionInterface &conn) { return conn.execute_sql(sql); });
+}
+
+std::future<Status> AsyncConnection::execute_sql_for_each(
+    const std::string &sql, const std::function<void(const RowView &)> &fn) {
+  return _impl->submit([sql, fn](ConnectionInterface &conn) {
+    return conn.execute_sql_for_each(sql, fn);
+  });
+}
+
+std::future<Status> AsyncConnection::transaction(const Task &t) {
+  if (t == nullptr) {
+    return submit(nullptr);
+  }
+  return _impl->submit([t](ConnectionInterface &conn) {
+    return conn.transaction([&]() { return t(conn); });
+  });
+}
+
+std::future<Status> AsyncConnection::submit(const Task &task) {
+  return _impl->submit(task);
+}
+
+std::vector<std::future<Status>> AsyncConnection::pipeline(
+    const std::vector<std::string> &sqls) {
+  std::vector<Task> tasks;
+  tasks.reserve(sqls.size());
+  for (auto &sql : sqls) {
+    tasks.emplace_back(
+        [sql](ConnectionInterface &conn) { return conn.execute_sql(sql); });
+  }
+  return _impl->submit_all(tasks);
+}
+
+void AsyncConnection::wait() { _impl->wait(); }
+
+AsyncConnectionStats AsyncConnection::stats() const { return _impl->stats(); }
+
+}  // ookoto
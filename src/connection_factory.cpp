@@ -0,0 +1,30 @@
+#include <ookoto/ookoto.h>
+#include <memory>
+
+namespace ookoto {
+
+Status open_connection(const Config &config,
+                       std::unique_ptr<ConnectionInterface> *connection) {
+  if (connection == nullptr) {
+    return Status::invalid_argument();
+  }
+
+  std::unique_ptr<ConnectionInterface> created;
+  if (config.driver == "sqlite3") {
+    created.reset(new SqliteConnection);
+#ifndef OOKOTO_WITHOUT_MYSQL
+  } else if (config.driver == "mysql") {
+    created.reset(new MysqlConnection);
+#endif
+  } else {
+    return Status::invalid_argument(config.driver);
+  }
+
+  auto result = created->connect(config);
+  if (result.is_ok()) {
+    *connection = std::move(created);
+  }
+  return result;
+}
+
+}  // ookoto
@@ -0,0 +1,193 @@
+#include <ookoto/ookoto.h>
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+namespace ookoto {
+
+ConnectionPool::Handle::Handle(ConnectionPool *pool,
+                               std::unique_ptr<ConnectionInterface> connection)
+    : _pool(pool), _connection(std::move(connection)) {}
+
+ConnectionPool::Handle::Handle(Handle &&other)
+    : _pool(other._pool), _connection(std::move(other._connection)) {
+  other._pool = nullptr;
+}
+
+ConnectionPool::Handle &ConnectionPool::Handle::operator=(Handle &&other) {
+  if (this != &other) {
+    release();
+    _pool = other._pool;
+    _connection = std::move(other._connection);
+    other._pool = nullptr;
+  }
+  return *this;
+}
+
+ConnectionPool::Handle::~Handle() { release(); }
+
+void ConnectionPool::Handle::release() {
+  if (_pool != nullptr && _connection != nullptr) {
+    _pool->checkin(std::move(_connection));
+  }
+  _pool = nullptr;
+}
+
+ConnectionPool::ConnectionPool(const Config &config,
+                               const ConnectionPoolOptions &options)
+    : _config(config), _options(options) {
+  if (_options.max_size == 0) {
+    _options.max_size = 1;
+  }
+  _options.min_size = std::min(_options.min_size, _options.max_size);
+}
+
+ConnectionPool::~ConnectionPool() { close(); }
+
+Status ConnectionPool::open() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _closed = false;
+  while (_stats.size < _options.min_size) {
+    _stats.size += 1;
+    lock.unlock();
+
+    std::unique_ptr<ConnectionInterface> connection;
+    auto result = open_connection(_config, &connection);
+
+    lock.lock();
+    if (!result.is_ok()) {
+      _stats.size -= 1;
+      return result;
+    }
+    _stats.connects += 1;
+    _stats.idle += 1;
+    _idle.emplace_back(std::move(connection));
+    _available.notify_one();
+  }
+
+  return Status::ok();
+}
+
+void ConnectionPool::close() {
+  std::vector<std::unique_ptr<ConnectionInterface>> idle;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+    idle.swap(_idle);
+    _stats.size -= idle.size();
+    _stats.idle = 0;
+  }
+  _available.notify_all();
+
+  for (auto &connection : idle) {
+    connection->disconnect();
+  }
+}
+
+Status ConnectionPool::checkout(Handle *handle) {
+  if (handle == nullptr) {
+    return Status::invalid_argument();
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<ConnectionInterface> connection;
+  bool create = false;
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _stats.waiting += 1;
+    auto ready = _available.wait_until(
+        lock, start + _options.checkout_timeout, [&]() {
+          return _closed || !_idle.empty() || _stats.size < _options.max_size;
+        });
+    _stats.waiting -= 1;
+
+    if (_closed) {
+      return Status::status_ailment("connection pool is closed");
+    }
+    if (!ready) {
+      _stats.timeouts += 1;
+      return Status::status_ailment("connection pool checkout timed out");
+    }
+
+    if (_idle.empty()) {
+      create = true;
+      _stats.size += 1;
+    } else {
+      connection = std::move(_idle.back());
+      _idle.pop_back();
+      _stats.idle -= 1;
+    }
+    _stats.in_use += 1;
+    _stats.peak_in_use = std::max(_stats.peak_in_use, _stats.in_use);
+  }
+
+  // connecting and validating happen outside the lock
+  auto result = (create) ? open_connection(_config, &connection)
+                         : validate(connection.get());
+  auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!result.is_ok()) {
+      _stats.size -= 1;
+      _stats.in_use -= 1;
+      _available.notify_one();
+      return result;
+    }
+
+    _stats.checkouts += 1;
+    _stats.total_wait += wait;
+    _stats.max_wait = std::max(_stats.max_wait, wait);
+    if (create) {
+      _stats.connects += 1;
+    }
+  }
+
+  *handle = Handle(this, std::move(connection));
+  return Status::ok();
+}
+
+ConnectionPoolStats ConnectionPool::stats() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
+
+void ConnectionPool::checkin(std::unique_ptr<ConnectionInterface> connection) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.in_use -= 1;
+    if (!_closed) {
+      _stats.idle += 1;
+      _idle.emplace_back(std::move(connection));
+    } else {
+      _stats.size -= 1;
+    }
+  }
+  _available.notify_one();
+
+  if (connection != nullptr) {
+    connection->disconnect();
+  }
+}
+
+Status ConnectionPool::validate(ConnectionInterface *connection) {
+  auto healthy = connection->has_connection();
+  if (healthy && !_options.validation_query.empty()) {
+    auto result = connection->execute_sql_for_each(
+        _options.validation_query, [](const RowView &) {});
+    healthy = result.is_ok() || result.is_not_found();
+  }
+  if (healthy) {
+    return Status::ok();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.reconnects += 1;
+  }
+  connection->disconnect();
+  return connection->connect(_config);
+}
+
+}  // ookoto
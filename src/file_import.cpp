@@ -0,0 +1,676 @@
+#include <cppformat/format.h>
+#include <fcntl.h>
+#include <ookoto/ookoto.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ConnectionImpl.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ookoto {
+
+namespace {
+
+using Column = AppenderBase::Column;
+
+// sqlite3 builds before 3.32 accept at most 999 parameters per statement
+const std::size_t kMaxParameters = 999;
+
+// batches parsed ahead of the writer for every range
+const std::size_t kQueuedBatches = 4;
+
+// a read-only mapping of a whole file
+class MappedFile {
+ public:
+  ~MappedFile() {
+    if (_data) {
+      munmap(_data, _size);
+    }
+  }
+
+  Status open(const std::string &path) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return Status::invalid_argument(
+          fmt::format("cannot open {}: {}", path, std::strerror(errno)));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      return Status::status_ailment(std::strerror(errno));
+    }
+    _size = static_cast<std::size_t>(st.st_size);
+    if (0 < _size) {
+      auto data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        return Status::status_ailment(std::strerror(errno));
+      }
+      _data = data;
+#ifdef MADV_SEQUENTIAL
+      madvise(_data, _size, MADV_SEQUENTIAL);
+#endif
+    }
+    ::close(fd);
+    return Status::ok();
+  }
+
+  const char *data() const { return static_cast<const char *>(_data); }
+  std::size_t size() const { return _size; }
+
+ private:
+  void *_data = nullptr;
+  std::size_t _size = 0;
+};
+
+// returns the first a or b in [p, end), or end; 16 bytes are compared at a
+// time where SSE2 is available
+const char *find_either(const char *p, const char *end, char a, char b) {
+#if defined(__SSE2__)
+  auto va = _mm_set1_epi8(a);
+  auto vb = _mm_set1_epi8(b);
+  while (16 <= end - p) {
+    auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    auto mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p < end && *p != a && *p != b) {
+    p++;
+  }
+  return p;
+}
+
+const char *find(const char *p, const char *end, char c) {
+  auto found = std::memchr(p, c, end - p);
+  return (found) ? static_cast<const char *>(found) : end;
+}
+
+bool parse_integer(const char *data, std::size_t size, int64_t *result) {
+  auto p = data;
+  auto end = data + size;
+  auto negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  if (p == end) {
+    return false;
+  }
+
+  // accumulated as a negative number so INT64_MIN fits
+  int64_t value = 0;
+  auto min = std::numeric_limits<int64_t>::min();
+  for (; p < end; p++) {
+    if (*p < '0' || '9' < *p) {
+      return false;
+    }
+    int digit = *p - '0';
+    if (value < (min + digit) / 10) {
+      return false;
+    }
+    value = value * 10 - digit;
+  }
+  if (!negative && value == min) {
+    return false;
+  }
+  *result = (negative) ? value : -value;
+  return true;
+}
+
+bool parse_real(const char *data, std::size_t size, double *result) {
+  // strtod needs a terminated string
+  char buf[64];
+  std::string long_value;
+  const char *text = buf;
+  if (size < sizeof(buf)) {
+    std::memcpy(buf, data, size);
+    buf[size] = '\0';
+  } else {
+    long_value.assign(data, size);
+    text = long_value.c_str();
+  }
+
+  char *end = nullptr;
+  errno = 0;
+  *result = std::strtod(text, &end);
+  return 0 < size && errno == 0 && end == text + size;
+}
+
+struct Batch {
+  // the values of every row, back to back; text refers to the mapped file
+  // or to copies
+  std::vector<Value> values;
+  // quoted fields with doubled quotes, unescaped; a deque keeps them in place
+  std::deque<std::string> copies;
+  std::size_t rows = 0;
+};
+
+// splits records into fields and converts each to the type of its column
+class Parser {
+ public:
+  using Emit = std::function<bool(std::unique_ptr<Batch>)>;
+
+  Parser(const std::vector<Column> &columns, const ImportOptions &options,
+         const char *origin)
+      : _columns(columns), _options(options), _origin(origin) {}
+
+  // emits batches of batch_rows rows until emit returns false
+  Status parse(const char *p, const char *end, const Emit &emit) {
+    auto width = _columns.size();
+    auto batch = new_batch();
+    while (p < end) {
+      if (*p == '\n') {
+        p++;
+        continue;
+      }
+      if (*p == '\r' && p + 1 < end && p[1] == '\n') {
+        p += 2;
+        continue;
+      }
+
+      for (std::size_t c = 0; c < width; c++) {
+        auto start = p;
+        const char *data = nullptr;
+        std::size_t size = 0;
+        auto quoted =
+            _options.quote != '\0' && p < end && *p == _options.quote;
+        if (quoted) {
+          auto result = unquote(&p, end, batch.get(), &data, &size);
+          if (!result.is_ok()) {
+            return result;
+          }
+        } else {
+          auto next = find_either(p, end, _options.delimiter, '\n');
+          data = p;
+          size = next - p;
+          if (c + 1 == width && 0 < size && data[size - 1] == '\r') {
+            size--;
+          }
+          p = next;
+        }
+
+        if (c + 1 < width) {
+          if (end <= p || *p != _options.delimiter) {
+            return field_count_error(start);
+          }
+          p++;
+        } else {
+          if (p < end && *p == '\r') {
+            p++;
+          }
+          if (p < end && *p++ != '\n') {
+            return field_count_error(start);
+          }
+        }
+
+        Value value;
+        auto result = convert(_columns[c], data, size, quoted, &value, start);
+        if (!result.is_ok()) {
+          return result;
+        }
+        batch->values.push_back(value);
+      }
+
+      batch->rows += 1;
+      if (batch->rows == _options.batch_rows) {
+        if (!emit(std::move(batch))) {
+          return Status::ok();
+        }
+        batch = new_batch();
+      }
+    }
+
+    if (0 < batch->rows) {
+      emit(std::move(batch));
+    }
+    return Status::ok();
+  }
+
+ private:
+  const std::vector<Column> &_columns;
+  const ImportOptions &_options;
+  const char *_origin;
+
+  std::unique_ptr<Batch> new_batch() const {
+    std::unique_ptr<Batch> batch(new Batch);
+    batch->values.reserve(_options.batch_rows * _columns.size());
+    return batch;
+  }
+
+  Status unquote(const char **p, const char *end, Batch *batch,
+                 const char **data, std::size_t *size) const {
+    auto quote = _options.quote;
+    auto start = *p;
+    auto from = *p + 1;
+    std::string *copy = nullptr;
+    while (true) {
+      auto found = find(from, end, quote);
+      if (found == end) {
+        return Status::invalid_argument(
+            fmt::format("unterminated quote at byte {}", start - _origin));
+      }
+      if (found + 1 < end && found[1] == quote) {
+        if (copy == nullptr) {
+          batch->copies.emplace_back();
+          copy = &batch->copies.back();
+        }
+        copy->append(from, found + 1 - from);
+        from = found + 2;
+        continue;
+      }
+
+      if (copy) {
+        copy->append(from, found - from);
+        *data = copy->data();
+        *size = copy->size();
+      } else {
+        *data = start + 1;
+        *size = found - start - 1;
+      }
+      *p = found + 1;
+      return Status::ok();
+    }
+  }
+
+  Status convert(const Column &column, const char *data, std::size_t size,
+                 bool quoted, Value *value, const char *at) const {
+    auto &null = _options.null_value;
+    if (!quoted && !null.empty() && size == null.size() &&
+        std::memcmp(data, null.data(), size) == 0) {
+      return Status::ok();
+    }
+    if (size == 0 && column.type != Schema::Type::kString &&
+        column.type != Schema::Type::kText) {
+      return Status::ok();
+    }
+
+    switch (column.type) {
+      case Schema::Type::kInteger:
+      case Schema::Type::kBoolean: {
+        int64_t integer;
+        if (!parse_integer(data, size, &integer)) {
+          return Status::invalid_argument(
+              fmt::format("{} is not an integer at byte {}", column.name,
+                          at - _origin));
+        }
+        *value = Value::integer(integer);
+        break;
+      }
+      case Schema::Type::kFloat: {
+        double real;
+        if (!parse_real(data, size, &real)) {
+          return Status::invalid_argument(fmt::format(
+              "{} is not a number at byte {}", column.name, at - _origin));
+        }
+        *value = Value::real(real);
+        break;
+      }
+      case Schema::Type::kBinary:
+        *value = Value::blob(data, size);
+        break;
+      default:
+        *value = Value::text(data, size);
+        break;
+    }
+    return Status::ok();
+  }
+
+  Status field_count_error(const char *at) const {
+    return Status::invalid_argument(fmt::format(
+        "expected {} fields at byte {}", _columns.size(), at - _origin));
+  }
+};
+
+// Parses one range of the file per worker thread. The writer takes the
+// batches range by range, so rows are inserted in file order while later
+// ranges are parsed ahead, up to kQueuedBatches batches each.
+class Importer {
+ public:
+  Importer(ConnectionInterface *connection, std::shared_ptr<Schema> schema,
+           const ImportOptions &options)
+      : _connection(connection), _schema(schema), _options(options) {
+    if (_options.batch_rows == 0) {
+      _options.batch_rows = 1;
+    }
+    if (_options.threads == 0) {
+      _options.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    schema->each_define([&](const Schema::ColumnType &def) {
+      if (std::get<Schema::kColumnProperties>(def)->auto_increment()) {
+        return;
+      }
+      _columns.push_back({std::get<Schema::kColumnName>(def),
+                          std::get<Schema::kColumnType>(def)});
+    });
+
+    auto limit = std::max<std::size_t>(1, kMaxParameters /
+                                              std::max<std::size_t>(
+                                                  1, _columns.size()));
+    _rows_per_insert =
+        std::max<std::size_t>(1, std::min(_options.rows_per_insert, limit));
+    // whole statements per transaction leave a short one only at the end
+    auto statements = std::max<std::size_t>(
+        1, (_options.transaction_rows + _rows_per_insert - 1) /
+               _rows_per_insert);
+    _transaction_rows = statements * _rows_per_insert;
+  }
+
+  Status run(const std::string &path, ImportStats *stats) {
+    if (_columns.empty()) {
+      return Status::invalid_argument("no columns to import");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file;
+    auto result = file.open(path);
+    if (!result.is_ok()) {
+      return result;
+    }
+    stats->bytes = file.size();
+
+    split(file);
+    std::vector<std::thread> workers;
+    for (auto &range : _ranges) {
+      auto target = &range;
+      workers.emplace_back([&file, target, this]() {
+        parse(file.data(), *target);
+      });
+    }
+
+    // the drivers may throw, e.g. on a failed COMMIT, and the parsers have
+    // to be joined before the exception leaves
+    try {
+      result = write(stats);
+      if (result.is_ok()) {
+        // indexes are quicker to build over the loaded rows than to keep up
+        // to date row by row
+        result = _connection->create_indexes(_schema);
+      }
+    } catch (...) {
+      stop(&workers);
+      throw;
+    }
+    stop(&workers);
+
+    stats->seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    return result;
+  }
+
+ private:
+  struct Range {
+    const char *begin = nullptr;
+    const char *end = nullptr;
+    std::deque<std::unique_ptr<Batch>> batches;
+    bool done = false;
+    Status status = Status::ok();
+  };
+
+  ConnectionInterface *_connection;
+  std::shared_ptr<Schema> _schema;
+  ImportOptions _options;
+  std::vector<Column> _columns;
+  std::size_t _rows_per_insert = 1;
+  std::size_t _transaction_rows = 1;
+
+  std::mutex _mutex;
+  std::condition_variable _ready;
+  std::condition_variable _space;
+  std::deque<Range> _ranges;
+  bool _stopped = false;
+
+  // cuts the file into equal ranges, each moved forward to the start of
+  // the next record. Without quotes every newline ends a record; with them
+  // a newline may sit inside a field, so the records are walked from the
+  // start instead.
+  void split(const MappedFile &file) {
+    auto begin = file.data();
+    auto end = begin + file.size();
+    if (_options.header && begin < end) {
+      begin = next_record(begin, end);
+    }
+
+    auto size = static_cast<std::size_t>(end - begin);
+    auto from = begin;
+    for (std::size_t i = 1; i <= _options.threads; i++) {
+      auto to = end;
+      if (i < _options.threads) {
+        to = std::max(from, begin + size / _options.threads * i);
+        if (_options.quote == '\0') {
+          auto line = find(to, end, '\n');
+          to = (line < end) ? line + 1 : end;
+        } else {
+          auto record = from;
+          while (record < to) {
+            record = next_record(record, end);
+          }
+          to = record;
+        }
+      }
+      _ranges.emplace_back();
+      _ranges.back().begin = from;
+      _ranges.back().end = to;
+      from = to;
+    }
+  }
+
+  // the start of the record after the one starting at p, skipping the
+  // quoted fields the way the parser reads them
+  const char *next_record(const char *p, const char *end) const {
+    auto quote = _options.quote;
+    while (p < end) {
+      if (quote != '\0' && *p == quote) {
+        p = find(p + 1, end, quote);
+        // a doubled quote stands for one quote inside the field
+        while (2 <= end - p && p[1] == quote) {
+          p = find(p + 2, end, quote);
+        }
+        p = (p < end) ? p + 1 : end;
+        continue;
+      }
+      p = find_either(p, end, _options.delimiter, '\n');
+      if (p < end && *p++ == '\n') {
+        return p;
+      }
+    }
+    return end;
+  }
+
+  void parse(const char *origin, Range &range) {
+    Parser parser(_columns, _options, origin);
+    auto result =
+        parser.parse(range.begin, range.end, [&](std::unique_ptr<Batch> batch) {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _space.wait(lock, [&]() {
+            return range.batches.size() < kQueuedBatches || _stopped;
+          });
+          if (_stopped) {
+            return false;
+          }
+          range.batches.push_back(std::move(batch));
+          lock.unlock();
+          _ready.notify_all();
+          return true;
+        });
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      range.status = result;
+      range.done = true;
+    }
+    _ready.notify_all();
+  }
+
+  void stop(std::vector<std::thread> *workers) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopped = true;
+    }
+    _space.notify_all();
+    for (auto &worker : *workers) {
+      worker.join();
+    }
+  }
+
+  // the next batch in file order, or nullptr after the last one
+  Status take(std::size_t *index, std::unique_ptr<Batch> *batch) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (*index < _ranges.size()) {
+      auto &range = _ranges[*index];
+      _ready.wait(lock, [&]() { return !range.batches.empty() || range.done; });
+      if (!range.batches.empty()) {
+        *batch = std::move(range.batches.front());
+        range.batches.pop_front();
+        lock.unlock();
+        _space.notify_all();
+        return Status::ok();
+      }
+      if (!range.status.is_ok()) {
+        return range.status;
+      }
+      *index += 1;
+    }
+    batch->reset();
+    return Status::ok();
+  }
+
+  std::string insert_sql(std::size_t rows) const {
+    fmt::MemoryWriter buf;
+    buf << "INSERT INTO " << _schema->table_name() << " (";
+    for (std::size_t i = 0; i < _columns.size(); i++) {
+      buf << ((0 < i) ? ", " : "") << _columns[i].name;
+    }
+    buf << ") VALUES ";
+    for (std::size_t r = 0; r < rows; r++) {
+      buf << ((0 < r) ? ", (" : "(");
+      for (std::size_t i = 0; i < _columns.size(); i++) {
+        buf << ((0 < i) ? ", ?" : "?");
+      }
+      buf << ")";
+    }
+    return buf.str();
+  }
+
+  Status insert(std::shared_ptr<PreparedStatement> *statement,
+                std::size_t rows, const std::vector<Value> &params) {
+    if (*statement == nullptr) {
+      auto result = _connection->prepare(insert_sql(rows), statement);
+      if (!result.is_ok()) {
+        return result;
+      }
+    }
+    auto result = ConnectionImpl::bind_params(**statement, params);
+    if (result.is_ok()) {
+      result = (*statement)->execute();
+    }
+    return result;
+  }
+
+  Status write(ImportStats *stats) {
+    std::shared_ptr<PreparedStatement> full;
+    std::shared_ptr<PreparedStatement> tail;
+    std::vector<Value> params;
+    params.reserve(_rows_per_insert * _columns.size());
+
+    std::size_t index = 0;
+    std::unique_ptr<Batch> batch;
+    std::size_t row = 0;
+    // batches whose unescaped copies are still bound in params
+    std::vector<std::unique_ptr<Batch>> held;
+    auto finished = false;
+    while (!finished) {
+      std::size_t rows = 0;
+      // a failed COMMIT is reported here as well, and its rows not counted
+      auto result = _connection->transaction([&]() -> Status {
+        auto status = Status::ok();
+        params.clear();
+        while (rows + params.size() / _columns.size() < _transaction_rows) {
+          if (batch == nullptr || row == batch->rows) {
+            row = 0;
+            if (batch && !params.empty()) {
+              held.push_back(std::move(batch));
+            }
+            status = take(&index, &batch);
+            if (!status.is_ok()) {
+              return status;
+            }
+            if (batch == nullptr) {
+              finished = true;
+              break;
+            }
+            continue;
+          }
+
+          auto values = batch->values.data() + row * _columns.size();
+          params.insert(params.end(), values, values + _columns.size());
+          row += 1;
+          if (params.size() == _rows_per_insert * _columns.size()) {
+            status = insert(&full, _rows_per_insert, params);
+            if (!status.is_ok()) {
+              return status;
+            }
+            rows += _rows_per_insert;
+            params.clear();
+            held.clear();
+          }
+        }
+
+        if (!params.empty()) {
+          auto count = params.size() / _columns.size();
+          status = insert(&tail, count, params);
+          if (!status.is_ok()) {
+            return status;
+          }
+          rows += count;
+        }
+        return status;
+      });
+      if (!result.is_ok()) {
+        return result;
+      }
+      stats->rows += rows;
+    }
+    return Status::ok();
+  }
+};
+}
+
+Status import_file(ConnectionInterface *connection, const std::string &path,
+                   std::shared_ptr<Schema> schema, const ImportOptions &options,
+                   ImportStats *stats) {
+  if (connection == nullptr || schema == nullptr || path.empty()) {
+    return Status::invalid_argument();
+  }
+
+  ImportStats result_stats;
+  Importer importer(connection, schema, options);
+  auto result = importer.run(path, &result_stats);
+  if (stats) {
+    *stats = result_stats;
+  }
+  return result;
+}
+}  // ookoto
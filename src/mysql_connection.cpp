@@ -1,112 +1,1589 @@
 #include <cppformat/format.h>
 #include <mysql.h>
 #include <ookoto/ookoto.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
 #include <exception>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <type_traits>
+#include "ColumnarBuilder.h"
 #include "ConnectionImpl.h"
+#include "RowBatchBuilder.h"
+#include "StatementCache.h"
 
 namespace ookoto {
 
 class MysqlConnection::Impl : public ConnectionImpl {
  public:
+  using Clock = std::chrono::steady_clock;
+
+  static double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  // reads a mysql_use_result result set on a background thread, copying the
+  // rows into chunks while the callback consumes the previous ones. Up to
+  // budget bytes are read ahead so the server is released early; past the
+  // budget the reader waits for the callback like a plain stream
+  class Prefetcher {
+   public:
+    Prefetcher(MYSQL *connection, MYSQL_RES *res,
+               const MysqlFetchOptions &options, Clock::time_point start)
+        : _connection(connection),
+          _res(res),
+          _columns(mysql_num_fields(res)),
+          _budget(std::max<std::size_t>(options.budget, 1)),
+          _chunk_size(std::max<std::size_t>(options.chunk_size, 1)),
+          _start(start),
+          _row(_columns),
+          _lengths(_columns) {
+      _thread = std::thread([this]() { read(); });
+    }
+
+    ~Prefetcher() { stop(); }
+
+    bool next(MYSQL_ROW *row, unsigned long **lengths) {
+      while (_chunk == nullptr || _chunk->rows <= _index) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _readable.wait(lock, [this]() { return !_chunks.empty() || _done; });
+        if (_chunks.empty()) {
+          _chunk.reset();
+          return false;
+        }
+        _chunk = std::move(_chunks.front());
+        _chunks.pop_front();
+        _buffered_bytes -= _chunk->bytes();
+        _buffered_rows -= _chunk->rows;
+        _index = 0;
+        lock.unlock();
+        _writable.notify_one();
+      }
+
+      auto cell = _index * _columns;
+      for (std::size_t i = 0; i < _columns; i++) {
+        auto offset = _chunk->offsets[cell + i];
+        _row[i] = (offset == kNull) ? nullptr : &_chunk->data[offset];
+        _lengths[i] = _chunk->lengths[cell + i];
+      }
+      _index += 1;
+      *row = _row.data();
+      *lengths = _lengths.data();
+      return true;
+    }
+
+    // waits for the reader and reports how the result was read
+    Status finish(MysqlFetchStats *stats) {
+      stop();
+      stats->buffered_rows = _peak_rows;
+      stats->buffered_bytes = _peak_bytes;
+      stats->server_seconds = _server_seconds;
+      return _status;
+    }
+
+   private:
+    static const std::size_t kNull = static_cast<std::size_t>(-1);
+
+    // values are NUL terminated like MYSQL_ROW, so numbers parse in place
+    struct Chunk {
+      std::string data;
+      std::vector<std::size_t> offsets;
+      std::vector<unsigned long> lengths;
+      std::size_t rows = 0;
+
+      std::size_t bytes() const {
+        return data.size() + offsets.size() * (sizeof(std::size_t) +
+                                               sizeof(unsigned long));
+      }
+    };
+
+    MYSQL *_connection;
+    MYSQL_RES *_res;
+    std::size_t _columns;
+    std::size_t _budget;
+    std::size_t _chunk_size;
+    Clock::time_point _start;
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _readable;
+    std::condition_variable _writable;
+    std::deque<std::unique_ptr<Chunk>> _chunks;
+    std::size_t _buffered_bytes = 0;
+    uint64_t _buffered_rows = 0;
+    bool _done = false;
+    bool _stopped = false;
+
+    std::size_t _peak_bytes = 0;
+    uint64_t _peak_rows = 0;
+    double _server_seconds = 0;
+    Status _status = Status::ok();
+
+    // owned by the callback thread
+    std::unique_ptr<Chunk> _chunk;
+    std::size_t _index = 0;
+    std::vector<char *> _row;
+    std::vector<unsigned long> _lengths;
+
+    void stop() {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+      }
+      _writable.notify_all();
+      if (_thread.joinable()) {
+        _thread.join();
+      }
+    }
+
+    void read() {
+      mysql_thread_init();
+      std::unique_ptr<Chunk> chunk(new Chunk);
+      MYSQL_ROW row;
+      while ((row = mysql_fetch_row(_res)) != nullptr) {
+        auto lengths = mysql_fetch_lengths(_res);
+        for (std::size_t i = 0; i < _columns; i++) {
+          if (row[i] == nullptr) {
+            chunk->offsets.push_back(kNull);
+            chunk->lengths.push_back(0);
+            continue;
+          }
+          chunk->offsets.push_back(chunk->data.size());
+          chunk->lengths.push_back(lengths[i]);
+          chunk->data.append(row[i], lengths[i]);
+          chunk->data.push_back('\0');
+        }
+        chunk->rows += 1;
+
+        if (_chunk_size <= chunk->bytes()) {
+          if (!push(&chunk, true)) {
+            break;
+          }
+          chunk.reset(new Chunk);
+        }
+      }
+
+      auto failed = mysql_errno(_connection) != 0;
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _server_seconds = seconds_since(_start);
+        if (failed) {
+          _status = Status::status_ailment(mysql_error(_connection));
+        }
+      }
+      if (chunk && 0 < chunk->rows) {
+        push(&chunk, false);
+      }
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done = true;
+      }
+      _readable.notify_all();
+      mysql_thread_end();
+    }
+
+    bool push(std::unique_ptr<Chunk> *chunk, bool wait) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (wait) {
+        _writable.wait(lock, [this]() {
+          return _buffered_bytes < _budget || _stopped;
+        });
+      }
+      if (_stopped) {
+        return false;
+      }
+      _buffered_bytes += (*chunk)->bytes();
+      _buffered_rows += (*chunk)->rows;
+      _peak_bytes = std::max(_peak_bytes, _buffered_bytes);
+      _peak_rows = std::max(_peak_rows, _buffered_rows);
+      _chunks.push_back(std::move(*chunk));
+      lock.unlock();
+      _readable.notify_one();
+      return true;
+    }
+  };
+
   class MysqlResultSet {
    public:
     MysqlResultSet(MYSQL_RES *res) : _res(res) {
       MYSQL_FIELD *schema;
       while ((schema = mysql_fetch_field(_res)) != nullptr) {
-        _schemas.emplace_back(schema);
+        _columns.add(schema->name);
+        _types.push_back(to_columnar_type(*schema));
+      }
+    }
+
+    void each(const std::function<void(const RowView &)> &fn) {
+      std::vector<StringView> values(_columns.size());
+      RowView view(_columns, values.data());
+      MYSQL_ROW row;
+      unsigned long *lengths;
+      while (fetch(&row, &lengths)) {
+        for (std::size_t i = 0; i < values.size(); i++) {
+          values[i] = row[i] ? StringView(row[i], lengths[i]) : StringView();
+        }
+        fn(view);
+      }
+    }
+
+    // the text protocol sends numbers as digits; they are parsed once here
+    // according to the field type, binary strings become blobs
+    void each(const std::function<void(const ValueRow &)> &fn) {
+      std::vector<Value> values(_columns.size());
+      ValueRow view(_columns, values.data());
+      MYSQL_ROW row;
+      unsigned long *lengths;
+      while (fetch(&row, &lengths)) {
+        for (std::size_t i = 0; i < values.size(); i++) {
+          values[i] = to_value(_types[i], row[i], lengths[i]);
+        }
+        fn(view);
+      }
+    }
+
+    void each(const std::function<void(const ColumnReader &)> &fn) {
+      Reader reader(_columns);
+      while (fetch(&reader.row, &reader.lengths)) {
+        fn(reader);
+      }
+    }
+
+    void each(std::size_t batch_size,
+              const std::function<void(const RowBatch &)> &fn) {
+      RowBatchBuilder builder(_columns, batch_size, fn);
+      MYSQL_ROW row;
+      unsigned long *lengths;
+      while (fetch(&row, &lengths)) {
+        for (std::size_t i = 0; i < _types.size(); i++) {
+          if (row[i]) {
+            builder.append(row[i], lengths[i]);
+          } else {
+            builder.append_null();
+          }
+        }
+        builder.end_row();
+      }
+      builder.deliver();
+    }
+
+    // reads the rows from prefetcher instead of the result set
+    void set_prefetcher(Prefetcher *prefetcher) { _prefetcher = prefetcher; }
+
+    // counts the bytes of every row read, for a stored result
+    void set_count_bytes(bool count) { _count_bytes = count; }
+
+    uint64_t rows() const { return _rows; }
+    std::size_t bytes() const { return _bytes; }
+
+   private:
+    // MYSQL_ROW values are NUL terminated, so numbers parse in place
+    class Reader : public ColumnReader {
+     public:
+      explicit Reader(const RowView::Columns &columns) : _columns(columns) {}
+
+      const RowView::Columns &columns() const override { return _columns; }
+
+      bool is_null(int index) const override { return row[index] == nullptr; }
+
+      int64_t get_int64(int index) const override {
+        return (row[index]) ? std::strtoll(row[index], nullptr, 10) : 0;
+      }
+
+      double get_double(int index) const override {
+        return (row[index]) ? std::strtod(row[index], nullptr) : 0;
+      }
+
+      StringView get_text(int index) const override {
+        return (row[index]) ? StringView(row[index], lengths[index])
+                            : StringView();
+      }
+
+      MYSQL_ROW row = nullptr;
+      unsigned long *lengths = nullptr;
+
+     private:
+      const RowView::Columns &_columns;
+    };
+
+    MYSQL_RES *_res = nullptr;
+    RowView::Columns _columns;
+    std::vector<ColumnarResult::Type> _types;
+    Prefetcher *_prefetcher = nullptr;
+    bool _count_bytes = false;
+    uint64_t _rows = 0;
+    std::size_t _bytes = 0;
+
+    bool fetch(MYSQL_ROW *row, unsigned long **lengths) {
+      if (_prefetcher) {
+        if (!_prefetcher->next(row, lengths)) {
+          return false;
+        }
+      } else {
+        *row = mysql_fetch_row(_res);
+        if (*row == nullptr) {
+          return false;
+        }
+        *lengths = mysql_fetch_lengths(_res);
+      }
+
+      _rows += 1;
+      if (_count_bytes) {
+        for (std::size_t i = 0; i < _types.size(); i++) {
+          _bytes += (*lengths)[i];
+        }
+      }
+      return true;
+    }
+
+    static Value to_value(ColumnarResult::Type type, const char *data,
+                          unsigned long length) {
+      if (data == nullptr) {
+        return Value();
+      }
+      switch (type) {
+        case ColumnarResult::Type::kInteger:
+          return Value::integer(std::strtoll(data, nullptr, 10));
+        case ColumnarResult::Type::kReal:
+          return Value::real(std::strtod(data, nullptr));
+        case ColumnarResult::Type::kBlob:
+          return Value::blob(data, length);
+        default:
+          return Value::text(data, length);
+      }
+    }
+  };
+
+  class Statement : public PreparedStatement {
+   public:
+    explicit Statement(MYSQL_STMT *stmt) : _stmt(stmt) {
+      auto count = mysql_stmt_param_count(_stmt);
+      _params.resize(count);
+      _binds.resize(count);
+      clear_bindings();
+    }
+
+    virtual ~Statement() { mysql_stmt_close(_stmt); }
+
+    Status bind(int index, int64_t value) override {
+      auto bind = bind_at(index, MYSQL_TYPE_LONGLONG);
+      if (bind == nullptr) {
+        return Status::invalid_argument();
+      }
+      _params[index - 1].integer = value;
+      bind->buffer = &_params[index - 1].integer;
+      return Status::ok();
+    }
+
+    Status bind(int index, double value) override {
+      auto bind = bind_at(index, MYSQL_TYPE_DOUBLE);
+      if (bind == nullptr) {
+        return Status::invalid_argument();
+      }
+      _params[index - 1].real = value;
+      bind->buffer = &_params[index - 1].real;
+      return Status::ok();
+    }
+
+    Status bind(int index, const std::string &value) override {
+      auto bind = bind_at(index, MYSQL_TYPE_STRING);
+      if (bind == nullptr) {
+        return Status::invalid_argument();
+      }
+      auto &param = _params[index - 1];
+      param.text = value;
+      param.length = value.size();
+      bind->buffer = &param.text[0];
+      bind->buffer_length = param.length;
+      bind->length = &param.length;
+      return Status::ok();
+    }
+
+    Status bind_null(int index) override {
+      return (bind_at(index, MYSQL_TYPE_NULL) == nullptr)
+                 ? Status::invalid_argument()
+                 : Status::ok();
+    }
+
+    Status clear_bindings() override {
+      for (std::size_t i = 0; i < _binds.size(); i++) {
+        bind_at(i + 1, MYSQL_TYPE_NULL);
+      }
+      return Status::ok();
+    }
+
+    Status execute() override {
+      auto result = run();
+      mysql_stmt_free_result(_stmt);
+      if (_written) {
+        _written();
+      }
+      return result;
+    }
+
+    Status execute_for_each(
+        const std::function<void(const RowView &)> &fn) override {
+      if (fn == nullptr) {
+        return Status::status_ailment();
+      }
+
+      auto result = run();
+      if (result.is_ok()) {
+        try {
+          result = fetch(fn);
+        } catch (...) {
+          // fn threw; the rows left must not stay on the connection
+          mysql_stmt_free_result(_stmt);
+          throw;
+        }
+      }
+      mysql_stmt_free_result(_stmt);
+      if (_written) {
+        _written();
+      }
+      return result;
+    }
+
+    // executes the statement through a read-only server side cursor which
+    // transfers fetch_size rows per round trip
+    Status open_cursor(unsigned long fetch_size) {
+      unsigned long type = CURSOR_TYPE_READ_ONLY;
+      if (mysql_stmt_attr_set(_stmt, STMT_ATTR_CURSOR_TYPE, &type) ||
+          mysql_stmt_attr_set(_stmt, STMT_ATTR_PREFETCH_ROWS, &fetch_size)) {
+        return Status::status_ailment(err2str());
+      }
+
+      auto result = run();
+      if (result.is_ok()) {
+        result = bind_results();
+      }
+      return result;
+    }
+
+    // fetches the next row into view(); returns not_found at the end
+    Status fetch_row() {
+      auto rc = mysql_stmt_fetch(_stmt);
+      if (rc == MYSQL_NO_DATA) {
+        return Status::not_found();
+      }
+      if (rc == 1) {
+        return Status::status_ailment(err2str());
+      }
+      if (rc == MYSQL_DATA_TRUNCATED) {
+        auto result = refetch_truncated();
+        if (!result.is_ok()) {
+          return result;
+        }
+      }
+
+      for (std::size_t i = 0; i < _results.size(); i++) {
+        auto &column = _results[i];
+        _values[i] = column.is_null
+                         ? StringView()
+                         : StringView(column.buffer.data(), column.length);
+      }
+      return Status::ok();
+    }
+
+    // also closes the server side cursor without reading the remaining rows
+    void free_result() { mysql_stmt_free_result(_stmt); }
+
+    RowView view() const { return RowView(_columns, _values.data()); }
+
+    // called after every execution of a statement that may write
+    void set_written(const std::function<void()> &fn) { _written = fn; }
+
+   private:
+    using Flag = std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type;
+
+    static const unsigned long kInitialBufferSize = 256;
+
+    struct Param {
+      int64_t integer = 0;
+      double real = 0;
+      std::string text;
+      unsigned long length = 0;
+    };
+
+    struct Column {
+      std::vector<char> buffer;
+      unsigned long length = 0;
+      Flag is_null = 0;
+      Flag error = 0;
+    };
+
+    MYSQL_STMT *_stmt = nullptr;
+    std::vector<Param> _params;
+    std::vector<MYSQL_BIND> _binds;
+    bool _described = false;
+    RowView::Columns _columns;
+    std::vector<Column> _results;
+    std::vector<MYSQL_BIND> _result_binds;
+    std::vector<StringView> _values;
+    std::function<void()> _written;
+
+    std::string err2str() const { return mysql_stmt_error(_stmt); }
+
+    MYSQL_BIND *bind_at(std::size_t index, enum_field_types type) {
+      if (index < 1 || _binds.size() < index) {
+        return nullptr;
+      }
+      auto &bind = _binds[index - 1];
+      bind = MYSQL_BIND();
+      bind.buffer_type = type;
+      return &bind;
+    }
+
+    Status run() {
+      if (!_binds.empty() && mysql_stmt_bind_param(_stmt, _binds.data())) {
+        return Status::status_ailment(err2str());
+      }
+      if (mysql_stmt_execute(_stmt) != 0) {
+        return Status::status_ailment(err2str());
+      }
+      return Status::ok();
+    }
+
+    // result buffers are described once and reused by every execution
+    bool describe() {
+      if (_described) {
+        return true;
+      }
+
+      auto meta = mysql_stmt_result_metadata(_stmt);
+      if (meta == nullptr) {
+        return false;
+      }
+
+      MYSQL_FIELD *field;
+      while ((field = mysql_fetch_field(meta)) != nullptr) {
+        _columns.add(field->name);
+      }
+      mysql_free_result(meta);
+
+      _results.resize(_columns.size());
+      _result_binds.resize(_columns.size());
+      _values.resize(_columns.size());
+      for (std::size_t i = 0; i < _results.size(); i++) {
+        _results[i].buffer.resize(kInitialBufferSize);
+        bind_result(i);
+      }
+      _described = true;
+      return true;
+    }
+
+    Status bind_results() {
+      if (!describe()) {
+        return Status::not_found();
+      }
+      if (mysql_stmt_bind_result(_stmt, _result_binds.data())) {
+        return Status::status_ailment(err2str());
+      }
+      return Status::ok();
+    }
+
+    void bind_result(std::size_t i) {
+      auto &column = _results[i];
+      auto &bind = _result_binds[i];
+      bind = MYSQL_BIND();
+      bind.buffer_type = MYSQL_TYPE_STRING;
+      bind.buffer = column.buffer.data();
+      bind.buffer_length = column.buffer.size();
+      bind.length = &column.length;
+      bind.is_null = &column.is_null;
+      bind.error = &column.error;
+    }
+
+    Status fetch(const std::function<void(const RowView &)> &fn) {
+      auto result = bind_results();
+      if (!result.is_ok()) {
+        return result;
+      }
+
+      bool loaded = false;
+      auto row = view();
+      while ((result = fetch_row()).is_ok()) {
+        loaded = true;
+        fn(row);
+      }
+      if (!result.is_not_found()) {
+        return result;
+      }
+
+      return (loaded) ? Status::ok() : Status::not_found();
+    }
+
+    // grows the buffers of truncated columns and fetches them again
+    Status refetch_truncated() {
+      bool rebound = false;
+      for (std::size_t i = 0; i < _results.size(); i++) {
+        auto &column = _results[i];
+        if (!column.error) {
+          continue;
+        }
+        column.buffer.resize(column.length + 1);
+        bind_result(i);
+        rebound = true;
+        if (mysql_stmt_fetch_column(_stmt, &_result_binds[i], i, 0) != 0) {
+          return Status::status_ailment(err2str());
+        }
+      }
+      if (rebound && mysql_stmt_bind_result(_stmt, _result_binds.data())) {
+        return Status::status_ailment(err2str());
+      }
+      return Status::ok();
+    }
+  };
+
+  // streams a mysql_use_result result set; the rows left unread are
+  // drained by mysql_free_result when the cursor is closed
+  class ResultCursor : public Cursor {
+   public:
+    ResultCursor(MYSQL *connection, MYSQL_RES *res)
+        : _connection(connection), _res(res), _row(_columns, nullptr) {
+      MYSQL_FIELD *field;
+      while ((field = mysql_fetch_field(_res)) != nullptr) {
+        _columns.add(field->name);
+      }
+      _values.resize(_columns.size());
+      _row = RowView(_columns, _values.data());
+    }
+
+    virtual ~ResultCursor() { close(); }
+
+    bool next() override {
+      if (_res == nullptr) {
+        return false;
+      }
+
+      auto row = mysql_fetch_row(_res);
+      if (row == nullptr) {
+        if (mysql_errno(_connection) != 0) {
+          _status = Status::status_ailment(mysql_error(_connection));
+        }
+        close();
+        return false;
+      }
+
+      auto lengths = mysql_fetch_lengths(_res);
+      for (std::size_t i = 0; i < _values.size(); i++) {
+        _values[i] = row[i] ? StringView(row[i], lengths[i]) : StringView();
+      }
+      return true;
+    }
+
+    const RowView &row() const override { return _row; }
+
+    Status status() const override { return _status; }
+
+    void close() override {
+      if (_res) {
+        mysql_free_result(_res);
+        _res = nullptr;
+      }
+    }
+
+   private:
+    MYSQL *_connection = nullptr;
+    MYSQL_RES *_res = nullptr;
+    RowView::Columns _columns;
+    std::vector<StringView> _values;
+    RowView _row;
+    Status _status = Status::ok();
+  };
+
+  // fetches from a server side cursor; the statement is owned by the
+  // cursor and never shared through the statement cache
+  class StatementCursor : public Cursor {
+   public:
+    explicit StatementCursor(std::unique_ptr<Statement> statement)
+        : _statement(std::move(statement)), _row(_statement->view()) {}
+
+    virtual ~StatementCursor() { close(); }
+
+    bool next() override {
+      if (_statement == nullptr) {
+        return false;
+      }
+
+      auto result = _statement->fetch_row();
+      if (result.is_ok()) {
+        return true;
+      }
+      if (!result.is_not_found()) {
+        _status = result;
+      }
+      close();
+      return false;
+    }
+
+    const RowView &row() const override { return _row; }
+
+    Status status() const override { return _status; }
+
+    void close() override {
+      if (_statement) {
+        _statement->free_result();
+        _statement.reset();
+      }
+    }
+
+   private:
+    std::unique_ptr<Statement> _statement;
+    RowView _row;
+    Status _status = Status::ok();
+  };
+
+  class BulkAppender : public AppenderBase {
+   public:
+    // headroom left for the packet header when sizing a batch
+    static const std::size_t kPacketMargin = 1024;
+
+    BulkAppender(Impl *impl, std::shared_ptr<Schema> schema,
+                 const BulkInsertOptions &options, std::size_t packet_size)
+        : AppenderBase(schema, options),
+          _impl(impl),
+          _prefix(insert_prefix()),
+          _packet_size(packet_size) {
+      _impl->_appenders.insert(this);
+    }
+
+    virtual ~BulkAppender() {
+      flush();
+      if (_impl) {
+        _impl->_appenders.erase(this);
+      }
+    }
+
+    // called by disconnect(); the rows not sent yet are dropped
+    void detach() {
+      _pending = 0;
+      _impl = nullptr;
+    }
+
+    Status append(const Row &row) override {
+      if (_impl == nullptr) {
+        return Status::status_ailment("not connected");
+      }
+      auto result = check_row(row);
+      if (!result.is_ok()) {
+        return result;
+      }
+
+      _tuple.clear();
+      result = encode(row, &_tuple);
+      if (!result.is_ok()) {
+        return result;
+      }
+
+      if (0 < _pending &&
+          _packet_size < _buffer.size() + 1 + _tuple.size()) {
+        result = flush();
+        if (!result.is_ok()) {
+          return result;
+        }
+      }
+
+      if (_pending == 0) {
+        _buffer = _prefix;
+      } else {
+        _buffer += ',';
+      }
+      _buffer += _tuple;
+      _pending += 1;
+
+      return (_pending < _options.chunk_size) ? Status::ok() : flush();
+    }
+
+    Status flush() override {
+      if (_impl == nullptr) {
+        return Status::status_ailment("not connected");
+      }
+      if (_pending == 0) {
+        return Status::ok();
+      }
+
+      auto pending = _pending;
+      _pending = 0;
+      if (mysql_real_query(_impl->_connection, _buffer.data(),
+                           _buffer.size()) != 0) {
+        return Status::status_ailment(_impl->err2str());
+      }
+
+      _impl->wrote(true, {_table_name});
+      chunk_committed(pending);
+      return Status::ok();
+    }
+
+   private:
+    Impl *_impl = nullptr;
+    std::string _prefix;
+    std::size_t _packet_size = 0;
+    std::string _buffer;
+    std::string _tuple;
+    std::size_t _pending = 0;
+
+    Status encode(const Row &row, std::string *tuple) {
+      *tuple += '(';
+      for (std::size_t i = 0; i < _columns.size(); i++) {
+        auto &column = _columns[i];
+        auto &value = row[i];
+        if (0 < i) {
+          *tuple += ',';
+        }
+
+        if (is_null(column, value)) {
+          *tuple += "NULL";
+        } else if (column.type == Schema::Type::kInteger ||
+                   column.type == Schema::Type::kBoolean) {
+          int64_t integer;
+          if (!to_integer(value, &integer)) {
+            return Status::invalid_argument(
+                fmt::format("{} is not an integer: {}", column.name, value));
+          }
+          *tuple += std::to_string(integer);
+        } else if (column.type == Schema::Type::kFloat) {
+          double real;
+          if (!to_real(value, &real)) {
+            return Status::invalid_argument(
+                fmt::format("{} is not a number: {}", column.name, value));
+          }
+          *tuple += fmt::format("{:.17g}", real);
+        } else {
+          _impl->quote(value, tuple);
+        }
+      }
+      *tuple += ')';
+      return Status::ok();
+    }
+  };
+
+  static const std::size_t kDefaultMaxPacketSize = 4 * 1024 * 1024;
+
+  Impl() { _connection = mysql_init(nullptr); }
+
+  virtual ~Impl() {
+    detach_appenders();
+    // statements must be closed while the connection is still alive
+    _statements.clear();
+    mysql_close(_connection);
+  }
+
+  Status connect(const Config &config) {
+    unsigned port =
+        config.port.size() == 0 ? 0 : std::atoi(config.port.c_str());
+
+    unsigned long flags =
+        config.mysql.multi_statements ? CLIENT_MULTI_STATEMENTS : 0;
+    if (!mysql_real_connect(_connection, config.host.c_str(),
+                            config.username.c_str(), config.password.c_str(),
+                            config.database.c_str(), port, nullptr, flags)) {
+      return Status::status_ailment();
+    }
+    _multi_statements = config.mysql.multi_statements;
+    _fetch = config.mysql.fetch;
+
+    _statements.set_capacity(config.statement_cache_capacity);
+    _logger = config.query_logger;
+    _result_cache = config.result_cache;
+    _profiler = config.profiler;
+    auto result = start_auto_transaction();
+    if (!result.is_ok()) {
+      disconnect();
+      return result;
+    }
+
+    return result;
+  }
+
+  Status disconnect() {
+    detach_appenders();
+    _statements.clear();
+    _logger.reset();
+    _result_cache.reset();
+    _profiler.reset();
+    _dirty_tables.clear();
+    _dirty_all = false;
+    _multi_statements = false;
+    _fetch = MysqlFetchOptions();
+    mysql_close(_connection);
+    _connection = mysql_init(nullptr);
+    return Status::ok();
+  }
+
+  Status transaction(const std::function<Status()> &t) {
+    if (t == nullptr) return Status::invalid_argument();
+
+    // START TRANSACTION suspends autocommit by itself, so switching it off
+    // and on again around the transaction would only add round trips
+    return do_transaction(t);
+  }
+
+  Status execute_sql(const std::string &sql) override {
+    QueryLog log(_logger.get(), sql);
+    QueryProfile profile(_profiler.get(), sql);
+
+    auto failed = mysql_query(_connection, sql.c_str()) != 0;
+    if (!failed) {
+      failed = !drain_results().is_ok();
+    }
+    // a failed batch may still have written some of its statements
+    if (_result_cache) {
+      std::vector<std::string> tables;
+      auto known = SqlTables::written(sql, &tables);
+      wrote(known, tables);
+    }
+
+    if (failed) {
+      return log.finish(profile.finish(Status::status_ailment(err2str())));
+    }
+
+    if (profile.claim_plan()) {
+      profile.set_plan(explain(sql));
+    }
+    return log.finish(profile.finish(Status::ok()));
+  }
+
+  Status execute_batch(const std::vector<std::string> &sqls,
+                       std::vector<Status> *results, bool transactional) {
+    std::vector<Status> statuses(
+        sqls.size(),
+        Status::status_ailment("not executed: an earlier statement failed"));
+    if (sqls.empty()) {
+      if (results) {
+        results->swap(statuses);
+      }
+      return Status::ok();
+    }
+
+    // START TRANSACTION and COMMIT travel in the same packet as the batch.
+    // Inside a transaction opened by the caller START TRANSACTION would
+    // commit it, so the batch becomes a savepoint of that transaction.
+    auto nested = transactional && in_transaction();
+    fmt::MemoryWriter buf;
+    std::size_t first = 0;
+    if (transactional) {
+      buf << ((nested) ? "SAVEPOINT ookoto_batch;\n" : "START TRANSACTION;\n");
+      first = 1;
+    }
+    // the terminator gets a line of its own so a trailing "-- comment" in
+    // sql cannot swallow it
+    for (auto &sql : sqls) {
+      buf << trim_statement(sql) << "\n;\n";
+    }
+    if (transactional) {
+      buf << ((nested) ? "RELEASE SAVEPOINT ookoto_batch" : "COMMIT");
+    }
+    auto batch = buf.str();
+
+    if (!_multi_statements &&
+        mysql_set_server_option(_connection, MYSQL_OPTION_MULTI_STATEMENTS_ON)) {
+      return Status::status_ailment(err2str());
+    }
+
+    QueryLog log(_logger.get(), batch);
+    std::size_t executed = 0;
+    Status result;
+    if (mysql_real_query(_connection, batch.data(), batch.size()) != 0) {
+      result = Status::status_ailment(err2str());
+    } else {
+      int next = 0;
+      do {
+        auto res = mysql_store_result(_connection);
+        if (res) {
+          mysql_free_result(res);
+        } else if (mysql_field_count(_connection) != 0) {
+          result = Status::status_ailment(err2str());
+          break;
+        }
+        executed += 1;
+        next = mysql_next_result(_connection);
+        if (0 < next) {
+          result = Status::status_ailment(err2str());
+        }
+      } while (next == 0);
+    }
+
+    // results of the statements after a failed one are never sent
+    for (std::size_t i = 0; i < sqls.size(); i++) {
+      auto n = first + i;
+      if (n < executed) {
+        statuses[i] = Status::ok();
+      } else if (n == executed && !result.is_ok()) {
+        statuses[i] = result;
+      }
+    }
+    if (transactional && !result.is_ok() && first <= executed) {
+      // the failure skipped COMMIT, so the transaction is still open
+      if (nested) {
+        mysql_query(_connection, "ROLLBACK TO SAVEPOINT ookoto_batch");
+        mysql_query(_connection, "RELEASE SAVEPOINT ookoto_batch");
+      } else {
+        mysql_query(_connection, "ROLLBACK");
+      }
+    }
+
+    if (!_multi_statements) {
+      mysql_set_server_option(_connection, MYSQL_OPTION_MULTI_STATEMENTS_OFF);
+    }
+
+    if (_result_cache) {
+      for (std::size_t i = 0; i < sqls.size(); i++) {
+        if (transactional || first + i <= executed) {
+          std::vector<std::string> tables;
+          auto known = SqlTables::written(sqls[i], &tables);
+          wrote(known, tables);
+        }
+      }
+    }
+
+    if (results) {
+      results->swap(statuses);
+    }
+    return log.finish(result);
+  }
+
+  Status execute_sql_cached(const std::string &sql,
+                            const std::vector<Value> &params,
+                            const std::function<void(const RowView &)> &fn) {
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+
+    if (_result_cache == nullptr) {
+      QueryLog log(_logger.get(), sql);
+      QueryProfile profile(_profiler.get(), sql);
+      return log.finish(
+          profile.finish(execute_bound(sql, params, profile.wrap(fn))));
+    }
+
+    CachedQuery query(*_result_cache, sql, params);
+    Status result;
+    if (query.replay(fn, &result)) {
+      return result;
+    }
+
+    // a result whose tables cannot be told from the SQL is not stored
+    std::vector<std::string> tables;
+    if (!query.dependencies(&tables)) {
+      SqlTables::read(sql, &tables);
+      query.set_dependencies(tables);
+    }
+
+    QueryLog log(_logger.get(), sql);
+    QueryProfile profile(_profiler.get(), sql);
+    auto record = query.record(fn);
+    result = profile.finish(execute_bound(sql, params, profile.wrap(record)));
+    if (!in_transaction()) {
+      query.store(result, tables);
+    }
+    return log.finish(result);
+  }
+
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const RowType &)> &fn) {
+    return execute_sql_for_each(sql, [&](const RowView &view) {
+      RowType row;
+      for (std::size_t i = 0; i < view.size(); i++) {
+        auto value = view[i].is_null() ? "NULL" : view[i].to_string();
+        row.emplace(std::make_pair(view.name(i), value));
       }
+      fn(row);
+    });
+  }
+
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const RowView &)> &fn) {
+    return query_each(sql, fn);
+  }
+
+  Status execute_sql_for_each(
+      const std::string &sql,
+      const std::function<void(const ColumnReader &)> &fn) {
+    return query_each(sql, fn);
+  }
+
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const ValueRow &)> &fn) {
+    return query_each(sql, fn);
+  }
+
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const RowView &)> &fn,
+                              const MysqlFetchOptions &options,
+                              MysqlFetchStats *stats) {
+    MysqlFetchStats fetched;
+    auto result = query_each(sql, fn, options, &fetched);
+    if (stats) {
+      *stats = fetched;
     }
+    return result;
+  }
 
-    void each(const std::function<void(const RowType &)> &fn) {
-      MYSQL_ROW row;
-      while ((row = mysql_fetch_row(_res)) != nullptr) {
-        RowType row2;
-        for (auto i = 0; i < _schemas.size(); i++) {
-          auto value = row[i] ? row[i] : "NULL";
-          row2.emplace(std::make_pair(_schemas[i]->name, value));
+  Status execute_sql_for_each_batch(
+      const std::string &sql, std::size_t batch_size,
+      const std::function<void(const RowBatch &)> &fn) {
+    if (batch_size == 0) {
+      return Status::invalid_argument();
+    }
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+
+    MysqlFetchStats stats;
+    return query_results(
+        sql, _fetch, &stats,
+        [&](MysqlResultSet &results, QueryProfile &profile) {
+          results.each(batch_size, profile.wrap(fn));
+        });
+  }
+
+  Status execute_sql_columnar(const std::string &sql,
+                              ColumnarResult *result) {
+    if (result == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    QueryLog log(_logger.get(), sql);
+    QueryProfile profile(_profiler.get(), sql);
+
+    if (mysql_query(_connection, sql.c_str()) != 0) {
+      return log.finish(profile.finish(Status::status_ailment(err2str())));
+    }
+
+    auto res = mysql_use_result(_connection);
+    if (res == nullptr) {
+      return log.finish(profile.finish(Status::status_ailment(err2str())));
+    }
+
+    ColumnarBuilder builder(result);
+    std::vector<ColumnarResult::Type> types;
+    MYSQL_FIELD *field;
+    while ((field = mysql_fetch_field(res)) != nullptr) {
+      types.emplace_back(to_columnar_type(*field));
+      builder.add_column(field->name, types.back());
+    }
+
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(res)) != nullptr) {
+      auto lengths = mysql_fetch_lengths(res);
+      for (std::size_t i = 0; i < types.size(); i++) {
+        if (row[i] == nullptr) {
+          builder.append_null(i);
+          continue;
+        }
+        switch (types[i]) {
+          case ColumnarResult::Type::kInteger:
+            builder.append_integer(i, std::strtoll(row[i], nullptr, 10));
+            break;
+          case ColumnarResult::Type::kReal:
+            builder.append_real(i, std::strtod(row[i], nullptr));
+            break;
+          case ColumnarResult::Type::kText:
+          case ColumnarResult::Type::kBlob:
+            builder.append_bytes(i, row[i], lengths[i]);
+            break;
+          case ColumnarResult::Type::kNull:
+            builder.append_null(i);
+            break;
         }
-        fn(row2);
       }
+      builder.end_row();
     }
 
-   private:
-    MYSQL_RES *_res = nullptr;
-    std::vector<MYSQL_FIELD *> _schemas;
-  };
+    auto failed = mysql_errno(_connection) != 0;
+    auto status = (failed) ? Status::status_ailment(err2str()) : Status::ok();
+    mysql_free_result(res);
 
-  Impl() { _connection = mysql_init(nullptr); }
+    profile.add_rows(result->row_count());
+    if (status.is_ok() && profile.claim_plan()) {
+      profile.set_plan(explain(sql));
+    }
+    return log.finish(profile.finish(status));
+  }
 
-  virtual ~Impl() { mysql_close(_connection); }
+  Status query(const std::string &sql, std::unique_ptr<Cursor> *cursor,
+               const CursorOptions &options) {
+    if (cursor == nullptr) {
+      return Status::invalid_argument();
+    }
 
-  Status connect(const Config &config) {
-    unsigned port =
-        config.port.size() == 0 ? 0 : std::atoi(config.port.c_str());
+    QueryLog log(_logger.get(), sql);
 
-    if (!mysql_real_connect(_connection, config.host.c_str(),
-                            config.username.c_str(), config.password.c_str(),
-                            config.database.c_str(), port, nullptr, 0)) {
-      return Status::status_ailment();
+    if (0 < options.fetch_size) {
+      std::unique_ptr<Statement> statement;
+      auto result = compile(sql, &statement);
+      if (result.is_ok()) {
+        result = statement->open_cursor(options.fetch_size);
+      }
+      if (result.is_ok()) {
+        cursor->reset(new StatementCursor(std::move(statement)));
+      }
+      return log.finish(result);
     }
 
-    auto result = start_auto_transaction();
+    if (mysql_query(_connection, sql.c_str()) != 0) {
+      return log.finish(Status::status_ailment(err2str()));
+    }
+
+    auto res = mysql_use_result(_connection);
+    if (res == nullptr) {
+      return log.finish(Status::status_ailment(err2str()));
+    }
+
+    cursor->reset(new ResultCursor(_connection, res));
+    return log.finish(Status::ok());
+  }
+
+  Status prepare(const std::string &sql,
+                 std::shared_ptr<PreparedStatement> *statement) {
+    if (statement == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    auto cached = _statements.acquire(sql);
+    if (cached) {
+      *statement = cached;
+      return cached->clear_bindings();
+    }
+
+    std::unique_ptr<Statement> compiled;
+    auto result = compile(sql, &compiled);
     if (!result.is_ok()) {
-      disconnect();
       return result;
     }
 
-    return result;
+    cached.reset(compiled.release());
+    if (_result_cache) {
+      std::vector<std::string> tables;
+      auto known = SqlTables::written(sql, &tables);
+      if (!known || !tables.empty()) {
+        cached->set_written([this, known, tables]() { wrote(known, tables); });
+      }
+    }
+    _statements.insert(sql, cached);
+    *statement = cached;
+    return Status::ok();
   }
 
-  Status disconnect() {
-    mysql_close(_connection);
-    _connection = mysql_init(nullptr);
+  StatementCacheStats statement_cache_stats() const {
+    return _statements.stats();
+  }
+
+  Status create_appender(std::shared_ptr<Schema> schema,
+                         const BulkInsertOptions &options,
+                         std::unique_ptr<Appender> *appender) override {
+    if (schema == nullptr || appender == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    auto packet_size = options.max_packet_size;
+    if (packet_size == 0) {
+      packet_size = max_allowed_packet();
+    }
+    if (BulkAppender::kPacketMargin < packet_size) {
+      packet_size -= BulkAppender::kPacketMargin;
+    }
+
+    appender->reset(new BulkAppender(this, schema, options, packet_size));
     return Status::ok();
   }
 
-  Status transaction(const std::function<Status()> &t) {
-    if (t == nullptr) return Status::invalid_argument();
+ private:
+  MYSQL *_connection = nullptr;
+  StatementCache<Statement> _statements;
+  std::set<BulkAppender *> _appenders;
+  std::shared_ptr<QueryLogger> _logger;
+  std::shared_ptr<ResultCache> _result_cache;
+  std::shared_ptr<Profiler> _profiler;
+  bool _multi_statements = false;
+  MysqlFetchOptions _fetch;
 
-    auto result =
-        do_auto_transaction([&]() -> Status { return do_transaction(t); });
+  // tables written by the open transaction, invalidated again once it ends
+  // so other connections cannot cache the rows they read before the commit
+  std::set<std::string> _dirty_tables;
+  bool _dirty_all = false;
 
-    return result;
+  std::string err2str() const { return mysql_error(_connection); }
+
+  // frees the result sets left by the last query and reports the first
+  // statement that failed
+  Status drain_results() {
+    auto res = mysql_store_result(_connection);
+    if (res) {
+      mysql_free_result(res);
+    }
+    while (mysql_more_results(_connection)) {
+      if (mysql_next_result(_connection) != 0) {
+        return Status::status_ailment(err2str());
+      }
+      res = mysql_store_result(_connection);
+      if (res) {
+        mysql_free_result(res);
+      }
+    }
+    return Status::ok();
   }
 
-  Status execute_sql(const std::string &sql) override {
-    fmt::print("SQL: {}\n", sql);
+  void detach_appenders() {
+    for (auto appender : _appenders) {
+      appender->detach();
+    }
+    _appenders.clear();
+  }
 
-    if (mysql_query(_connection, sql.c_str()) != 0) {
+  // drops the trailing terminators so every statement adds one result
+  static std::string trim_statement(const std::string &sql) {
+    auto end = sql.find_last_not_of(" \t\r\n;");
+    return (end == std::string::npos) ? std::string() : sql.substr(0, end + 1);
+  }
+
+  bool in_transaction() const {
+    return (_connection->server_status & SERVER_STATUS_IN_TRANS) != 0;
+  }
+
+  // invalidates the results depending on tables, or every result when the
+  // written tables are not known
+  void wrote(bool known, const std::vector<std::string> &tables) {
+    if (_result_cache == nullptr) {
+      return;
+    }
+
+    if (!known) {
+      _result_cache->clear();
+      _dirty_all = _dirty_all || in_transaction();
+    }
+    for (auto &table : tables) {
+      _result_cache->invalidate(table);
+      if (in_transaction()) {
+        _dirty_tables.insert(table);
+      }
+    }
+    if (!in_transaction()) {
+      transaction_ended();
+    }
+  }
+
+  void transaction_ended() {
+    if (_result_cache == nullptr) {
+      return;
+    }
+
+    if (_dirty_all) {
+      _result_cache->clear();
+    } else {
+      for (auto &table : _dirty_tables) {
+        _result_cache->invalidate(table);
+      }
+    }
+    _dirty_tables.clear();
+    _dirty_all = false;
+  }
+
+  Status execute_bound(const std::string &sql, const std::vector<Value> &params,
+                       const std::function<void(const RowView &)> &fn) {
+    std::shared_ptr<PreparedStatement> statement;
+    auto result = prepare(sql, &statement);
+    if (result.is_ok()) {
+      result = bind_params(*statement, params);
+    }
+    if (result.is_ok()) {
+      result = statement->execute_for_each(fn);
+    }
+    return result;
+  }
+
+  Status compile(const std::string &sql, std::unique_ptr<Statement> *statement) {
+    auto stmt = mysql_stmt_init(_connection);
+    if (stmt == nullptr) {
       return Status::status_ailment(err2str());
     }
+    if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size()) != 0) {
+      std::string message = mysql_stmt_error(stmt);
+      mysql_stmt_close(stmt);
+      return Status::status_ailment(message);
+    }
 
+    statement->reset(new Statement(stmt));
     return Status::ok();
   }
 
-  Status execute_sql_for_each(const std::string &sql,
-                              const std::function<void(const RowType &)> &fn) {
-    fmt::print("SQL: {}\n", sql);
+  template <typename Row>
+  Status query_each(const std::string &sql,
+                    const std::function<void(const Row &)> &fn) {
+    MysqlFetchStats stats;
+    return query_each(sql, fn, _fetch, &stats);
+  }
+
+  template <typename Row>
+  Status query_each(const std::string &sql,
+                    const std::function<void(const Row &)> &fn,
+                    const MysqlFetchOptions &options, MysqlFetchStats *stats) {
+    return query_results(
+        sql, options, stats,
+        [&](MysqlResultSet &results, QueryProfile &profile) {
+          results.each(profile.wrap(fn));
+        });
+  }
+
+  // runs sql and hands its result set to read, fetching as options say
+  Status query_results(
+      const std::string &sql, const MysqlFetchOptions &options,
+      MysqlFetchStats *stats,
+      const std::function<void(MysqlResultSet &, QueryProfile &)> &read) {
+    QueryLog log(_logger.get(), sql);
+    QueryProfile profile(_profiler.get(), sql);
+    auto start = Clock::now();
 
     if (mysql_query(_connection, sql.c_str()) != 0) {
-      return Status::status_ailment(err2str());
+      return log.finish(profile.finish(Status::status_ailment(err2str())));
     }
 
-    auto res = mysql_use_result(_connection);
+    auto buffered = options.mode == MysqlFetchMode::kBuffer;
+    auto res = (buffered) ? mysql_store_result(_connection)
+                          : mysql_use_result(_connection);
     if (res == nullptr) {
-      return Status::status_ailment(err2str());
+      return log.finish(profile.finish(Status::status_ailment(err2str())));
     }
 
+    auto status = Status::ok();
     MysqlResultSet results(res);
-    results.each(fn);
+    try {
+      if (options.mode == MysqlFetchMode::kHybrid) {
+        Prefetcher prefetcher(_connection, res, options, start);
+        results.set_prefetcher(&prefetcher);
+        read(results, profile);
+        status = prefetcher.finish(stats);
+      } else if (buffered) {
+        // the server is released as soon as the rows are stored
+        stats->server_seconds = seconds_since(start);
+        results.set_count_bytes(true);
+        read(results, profile);
+        stats->buffered_rows = results.rows();
+        stats->buffered_bytes = results.bytes();
+      } else {
+        read(results, profile);
+        if (mysql_errno(_connection) != 0) {
+          status = Status::status_ailment(err2str());
+        }
+      }
+    } catch (...) {
+      // the callback threw; the prefetcher has stopped by now, and freeing
+      // the result reads the rows left so the connection stays usable
+      mysql_free_result(res);
+      throw;
+    }
     mysql_free_result(res);
+    stats->rows = results.rows();
+    if (options.mode == MysqlFetchMode::kStream) {
+      stats->server_seconds = seconds_since(start);
+    }
 
-    return Status::ok();
+    if (status.is_ok() && profile.claim_plan()) {
+      profile.set_plan(explain(sql));
+    }
+    return log.finish(profile.finish(status));
   }
 
- private:
-  MYSQL *_connection = nullptr;
+  // the EXPLAIN of sql, one row per line as name=value pairs; empty when
+  // sql cannot be explained. Batches are never explained, since the
+  // statements after the first would run.
+  std::string explain(const std::string &sql) {
+    auto statement = trim_statement(sql);
+    if (statement.find(';') != std::string::npos) {
+      return std::string();
+    }
 
-  std::string err2str() const { return mysql_error(_connection); }
+    auto query = "EXPLAIN " + statement;
+    if (mysql_real_query(_connection, query.data(), query.size()) != 0) {
+      return std::string();
+    }
+    auto res = mysql_store_result(_connection);
+    if (res == nullptr) {
+      return std::string();
+    }
+
+    std::vector<std::string> names;
+    MYSQL_FIELD *field;
+    while ((field = mysql_fetch_field(res)) != nullptr) {
+      names.emplace_back(field->name);
+    }
+
+    fmt::MemoryWriter plan;
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(res)) != nullptr) {
+      for (std::size_t i = 0; i < names.size(); i++) {
+        plan << ((i == 0) ? "" : " ") << names[i] << '='
+             << ((row[i]) ? row[i] : "NULL");
+      }
+      plan << '\n';
+    }
+    mysql_free_result(res);
+    return plan.str();
+  }
+
+  static ColumnarResult::Type to_columnar_type(const MYSQL_FIELD &field) {
+    // charset 63 marks binary strings
+    static const unsigned int kBinaryCharset = 63;
+
+    switch (field.type) {
+      case MYSQL_TYPE_TINY:
+      case MYSQL_TYPE_SHORT:
+      case MYSQL_TYPE_LONG:
+      case MYSQL_TYPE_INT24:
+      case MYSQL_TYPE_LONGLONG:
+      case MYSQL_TYPE_YEAR:
+        return ColumnarResult::Type::kInteger;
+      case MYSQL_TYPE_FLOAT:
+      case MYSQL_TYPE_DOUBLE:
+      case MYSQL_TYPE_DECIMAL:
+      case MYSQL_TYPE_NEWDECIMAL:
+        return ColumnarResult::Type::kReal;
+      case MYSQL_TYPE_NULL:
+        return ColumnarResult::Type::kNull;
+      case MYSQL_TYPE_BIT:
+        return ColumnarResult::Type::kBlob;
+      case MYSQL_TYPE_TINY_BLOB:
+      case MYSQL_TYPE_MEDIUM_BLOB:
+      case MYSQL_TYPE_LONG_BLOB:
+      case MYSQL_TYPE_BLOB:
+      case MYSQL_TYPE_STRING:
+      case MYSQL_TYPE_VAR_STRING:
+        return (field.charsetnr == kBinaryCharset)
+                   ? ColumnarResult::Type::kBlob
+                   : ColumnarResult::Type::kText;
+      default:
+        return ColumnarResult::Type::kText;
+    }
+  }
+
+  std::size_t max_allowed_packet() {
+    std::size_t size = 0;
+    execute_sql_for_each("SELECT @@max_allowed_packet",
+                         [&](const RowView &row) {
+                           if (!row[0].is_null()) {
+                             size = std::strtoull(row[0].data(), nullptr, 10);
+                           }
+                         });
+    if (size == 0) {
+      size = kDefaultMaxPacketSize;
+    }
+    return size;
+  }
+
+  // appends value to buf as an escaped, single-quoted string literal
+  void quote(const std::string &value, std::string *buf) {
+    auto offset = buf->size();
+    buf->resize(offset + value.size() * 2 + 3);
+    (*buf)[offset] = '\'';
+    auto length = mysql_real_escape_string(_connection, &(*buf)[offset + 1],
+                                           value.data(), value.size());
+    (*buf)[offset + 1 + length] = '\'';
+    buf->resize(offset + length + 2);
+  }
 
   std::string column_type_to_string(Schema::Type type) override {
     static std::map<Schema::Type, std::string> mapping = {
@@ -120,6 +1597,59 @@ class MysqlConnection::Impl : public ConnectionImpl {
     return mapping[type];
   }
 
+  std::string table_options_to_string(const Schema &schema) override {
+    fmt::MemoryWriter buf;
+    if (!schema.engine().empty()) {
+      buf << "ENGINE=" << schema.engine();
+    }
+    if (!schema.row_format().empty()) {
+      buf << ((0 < buf.size()) ? " " : "")
+          << "ROW_FORMAT=" << schema.row_format();
+    }
+    return buf.str();
+  }
+
+  // all indexes go into one ALTER TABLE, so that the table is read once to
+  // build them
+  Status build_indexes(std::shared_ptr<Schema> schema,
+                       bool deferred) override {
+    auto table = schema->table_name();
+    std::set<std::string> existing;
+    if (deferred) {
+      auto result = execute_sql_for_each(
+          fmt::format("SHOW INDEX FROM {}", table),
+          [&](const RowView &row) {
+            existing.insert(row.get("Key_name").to_string());
+          });
+      if (!result.is_ok() && !result.is_not_found()) {
+        return result;
+      }
+    }
+
+    fmt::MemoryWriter buf;
+    Status result;
+    schema->each_index([&](const Schema::Index &index) {
+      if (index.deferred() != deferred || existing.count(index.name())) {
+        return;
+      }
+      // a unique index over all rows is stricter than the partial one
+      if (index.unique() && !index.where().empty()) {
+        result = Status::invalid_argument(
+            fmt::format("{} is a partial unique index", index.name()));
+        return;
+      }
+
+      buf << ((0 < buf.size()) ? ", " : "ALTER TABLE " + table + " ")
+          << "ADD " << ((index.unique()) ? "UNIQUE " : "") << "INDEX "
+          << index.name() << " (" << index_columns(index) << ")";
+    });
+
+    if (!result.is_ok() || buf.size() == 0) {
+      return result;
+    }
+    return execute_sql(buf.str());
+  }
+
   std::string column_prop_to_string(Schema::PropertyPtr prop) override {
     std::vector<std::string> results;
     if (prop->not_null()) {
@@ -148,53 +1678,49 @@ class MysqlConnection::Impl : public ConnectionImpl {
     return buf.str();
   }
 
+  // mysql_autocommit, mysql_commit and mysql_rollback return zero on success
   Status start_auto_transaction() {
-    if (!mysql_autocommit(_connection, 1)) {
-      return Status::status_ailment();
-    }
-    return Status::ok();
-  }
-
-  Status stop_auto_transaction() {
-    if (!mysql_autocommit(_connection, 0)) {
-      return Status::status_ailment();
+    if (mysql_autocommit(_connection, 1)) {
+      return Status::status_ailment(err2str());
     }
     return Status::ok();
   }
 
-  Status do_auto_transaction(const std::function<Status()> &t) {
-    stop_auto_transaction();
-    auto result = t();
-    start_auto_transaction();
-
-    return result;
-  }
-
   Status start_transaction() { return execute_sql("START TRANSACTION"); }
 
   Status commit() {
-    if (!mysql_commit(_connection)) {
-      return Status::status_ailment();
-    }
-    return Status::ok();
+    auto failed = mysql_commit(_connection) != 0;
+    transaction_ended();
+    return (failed) ? Status::status_ailment() : Status::ok();
   }
 
   Status rollback() {
-    if (!mysql_rollback(_connection)) {
-      return Status::status_ailment();
-    }
-    return Status::ok();
+    auto failed = mysql_rollback(_connection) != 0;
+    transaction_ended();
+    return (failed) ? Status::status_ailment() : Status::ok();
   }
 
   Status do_transaction(const std::function<Status()> &t) {
-    start_transaction();
-    auto result = t();
-    return (result.is_ok()) ? commit() : rollback();
+    auto result = start_transaction();
+    if (!result.is_ok()) {
+      return result;
+    }
+
+    result = t();
+    if (!result.is_ok()) {
+      rollback();
+      return result;
+    }
+    return commit();
   }
 };
 
+const std::size_t MysqlConnection::Impl::Prefetcher::kNull;
+
 MysqlConnection::MysqlConnection() { _impl.reset(new Impl); }
 
+MysqlConnection::~MysqlConnection() = default;
+
 bool MysqlConnection::exists_table(const std::string &table_name) const {
   return false;
 }
@@ -202,15 +1728,29 @@ bool MysqlConnection::exists_table(const std::string &table_name) const {
 int64_t MysqlConnection::last_row_id() const { return 0; }
 
 Status MysqlConnection::connect(const Config &config) {
-  return _impl->connect(config);
+  auto result = _impl->connect(config);
+  if (result.is_ok()) {
+    _has_connection = true;
+  }
+  return result;
 }
 
-Status MysqlConnection::disconnect() { return _impl->disconnect(); }
+Status MysqlConnection::disconnect() {
+  auto result = _impl->disconnect();
+  if (result.is_ok()) {
+    _has_connection = false;
+  }
+  return result;
+}
 
 Status MysqlConnection::create_table(std::shared_ptr<Schema> schema) {
   return _impl->create_table(schema);
 }
 
+Status MysqlConnection::create_indexes(std::shared_ptr<Schema> schema) {
+  return _impl->create_indexes(schema);
+}
+
 Status MysqlConnection::drop_table(const std::string &table_name) {
   return _impl->drop_table(table_name);
 }
@@ -227,4 +1767,77 @@ Status MysqlConnection::execute_sql_for_each(
     const std::string &sql, const std::function<void(const RowType &)> &fn) {
   return _impl->execute_sql_for_each(sql, fn);
 }
+
+Status MysqlConnection::execute_sql_for_each(
+    const std::string &sql, const std::function<void(const RowView &)> &fn) {
+  return _impl->execute_sql_for_each(sql, fn);
+}
+
+Status MysqlConnection::execute_sql_for_each(
+    const std::string &sql,
+    const std::function<void(const ColumnReader &)> &fn) {
+  return _impl->execute_sql_for_each(sql, fn);
+}
+
+Status MysqlConnection::execute_sql_for_each(
+    const std::string &sql, const std::function<void(const ValueRow &)> &fn) {
+  return _impl->execute_sql_for_each(sql, fn);
+}
+
+Status MysqlConnection::execute_sql_for_each(
+    const std::string &sql, const std::function<void(const RowView &)> &fn,
+    const MysqlFetchOptions &options, MysqlFetchStats *stats) {
+  return _impl->execute_sql_for_each(sql, fn, options, stats);
+}
+
+Status MysqlConnection::execute_sql_for_each_batch(
+    const std::string &sql, std::size_t batch_size,
+    const std::function<void(const RowBatch &)> &fn) {
+  return _impl->execute_sql_for_each_batch(sql, batch_size, fn);
+}
+
+Status MysqlConnection::execute_sql_columnar(const std::string &sql,
+                                             ColumnarResult *result) {
+  return _impl->execute_sql_columnar(sql, result);
+}
+
+Status MysqlConnection::query(const std::string &sql,
+                              std::unique_ptr<Cursor> *cursor,
+                              const CursorOptions &options) {
+  return _impl->query(sql, cursor, options);
+}
+
+Status MysqlConnection::execute_batch(const std::vector<std::string> &sqls,
+                                      std::vector<Status> *results,
+                                      bool transactional) {
+  return _impl->execute_batch(sqls, results, transactional);
+}
+
+Status MysqlConnection::execute_sql_cached(
+    const std::string &sql, const std::vector<Value> &params,
+    const std::function<void(const RowView &)> &fn) {
+  return _impl->execute_sql_cached(sql, params, fn);
+}
+
+Status MysqlConnection::prepare(const std::string &sql,
+                                std::shared_ptr<PreparedStatement> *statement) {
+  return _impl->prepare(sql, statement);
+}
+
+StatementCacheStats MysqlConnection::statement_cache_stats() const {
+  return _impl->statement_cache_stats();
+}
+
+Status MysqlConnection::create_appender(std::shared_ptr<Schema> schema,
+                                        const BulkInsertOptions &options,
+                                        std::unique_ptr<Appender> *appender) {
+  return _impl->create_appender(schema, options, appender);
+}
+
+Status MysqlConnection::bulk_insert(std::shared_ptr<Schema> schema,
+                                    const std::vector<Appender::Row> &rows,
+                                    const BulkInsertOptions &options,
+                                    BulkInsertStats *stats) {
+  return _impl->bulk_insert(schema, rows, options, stats);
+}
 }  // ookoto
@@ -0,0 +1,107 @@
+#include <ookoto/ookoto.h>
+#include <cctype>
+#include "Profiler.h"
+
+namespace ookoto {
+
+namespace {
+
+bool is_identifier_char(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+// appends a placeholder; a list of them, as in IN (1, 2, 3), folds into the
+// first one so that lists of any length count as one statement
+void append_placeholder(std::string *out) {
+  out->push_back('?');
+
+  auto n = out->size() - 1;
+  auto at = [&](std::size_t i) { return (i < n) ? (*out)[i] : '\0'; };
+  auto i = n - 1;
+  if (at(i) == ' ') {
+    i--;
+  }
+  if (at(i) != ',') {
+    return;
+  }
+  i--;
+  if (at(i) == ' ') {
+    i--;
+  }
+  if (at(i) == '?') {
+    out->resize(i + 1);
+  }
+}
+}
+
+Profiler::Profiler(const ProfilerOptions &options)
+    : _impl(new Impl(options)) {}
+
+Profiler::~Profiler() = default;
+
+std::vector<StatementProfile> Profiler::top(std::size_t n) const {
+  return _impl->top(n);
+}
+
+uint64_t Profiler::untracked() const { return _impl->untracked(); }
+
+void Profiler::reset() { _impl->reset(); }
+
+std::string Profiler::normalize(const std::string &sql) {
+  std::string out;
+  out.reserve(sql.size());
+
+  bool space = false;
+  std::size_t i = 0;
+  while (i < sql.size()) {
+    auto c = sql[i];
+    if (std::isspace(static_cast<unsigned char>(c))) {
+      space = true;
+      i++;
+      continue;
+    }
+    if (space && !out.empty()) {
+      out.push_back(' ');
+    }
+    space = false;
+
+    if (c == '\'') {
+      // '' and, for mysql, \' escape the quote
+      for (i++; i < sql.size(); i++) {
+        if (sql[i] == '\\') {
+          i++;
+        } else if (sql[i] == '\'') {
+          if (i + 1 < sql.size() && sql[i + 1] == '\'') {
+            i++;
+          } else {
+            break;
+          }
+        }
+      }
+      i++;
+      append_placeholder(&out);
+    } else if (c == '"' || c == '`') {
+      // quoted names are kept as they are
+      auto end = sql.find(c, i + 1);
+      end = (end == std::string::npos) ? sql.size() : end + 1;
+      out.append(sql, i, end - i);
+      i = end;
+    } else if (std::isdigit(static_cast<unsigned char>(c)) &&
+               (out.empty() || !is_identifier_char(out.back()))) {
+      // 12, 1.5, 1e3 and 0x1f
+      while (i < sql.size() && (is_identifier_char(sql[i]) || sql[i] == '.')) {
+        i++;
+      }
+      append_placeholder(&out);
+    } else if (c == '?') {
+      i++;
+      append_placeholder(&out);
+    } else {
+      out.push_back(c);
+      i++;
+    }
+  }
+  return out;
+}
+
+}  // ookoto
@@ -0,0 +1,177 @@
+#include <cppformat/format.h>
+#include <ookoto/ookoto.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace ookoto {
+
+// Bounded multi-producer / single-consumer ring buffer (after D. Vyukov).
+// Each slot keeps a preallocated SQL buffer, so producers neither lock nor
+// allocate; when the ring is full the entry is dropped instead of waiting.
+class AsyncQueryLogger::Impl {
+ public:
+  explicit Impl(const AsyncQueryLoggerOptions &options) : _options(options) {
+    std::size_t capacity = 2;
+    while (capacity < _options.capacity) {
+      capacity <<= 1;
+    }
+    _mask = capacity - 1;
+    _slots.reset(new Slot[capacity]);
+    for (std::size_t i = 0; i < capacity; i++) {
+      _slots[i].sequence.store(i, std::memory_order_relaxed);
+      _slots[i].sql.reserve(_options.max_sql_length);
+    }
+
+    if (_options.sample_every == 0) {
+      _options.sample_every = 1;
+    }
+    if (_options.sink == nullptr) {
+      _options.sink = [](const QueryLogEntry &entry) {
+        fmt::print("SQL: {} ({}us{})\n", entry.sql, entry.elapsed.count(),
+                   (entry.ok) ? "" : ", failed");
+      };
+    }
+
+    _worker = std::thread(&Impl::run, this);
+  }
+
+  ~Impl() {
+    _stopping.store(true, std::memory_order_release);
+    _worker.join();
+  }
+
+  void log(const std::string &sql, std::chrono::microseconds elapsed,
+           const Status &status) {
+    if (!should_log(elapsed, status)) {
+      _skipped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    auto pos = _tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &_slots[pos & _mask];
+      auto sequence = slot->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (_tail.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        pos = _tail.load(std::memory_order_relaxed);
+      }
+    }
+
+    slot->sql.assign(sql, 0, std::min(sql.size(), _options.max_sql_length));
+    slot->elapsed = elapsed;
+    slot->ok = status.is_ok();
+    slot->sequence.store(pos + 1, std::memory_order_release);
+  }
+
+  void flush() {
+    auto target = _tail.load(std::memory_order_acquire);
+    while (_head.load(std::memory_order_acquire) < target) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  Stats stats() const {
+    Stats stats;
+    stats.written = _written.load(std::memory_order_relaxed);
+    stats.dropped = _dropped.load(std::memory_order_relaxed);
+    stats.skipped = _skipped.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<std::size_t> sequence;
+    std::string sql;
+    std::chrono::microseconds elapsed;
+    bool ok = true;
+  };
+
+  AsyncQueryLoggerOptions _options;
+  std::unique_ptr<Slot[]> _slots;
+  std::size_t _mask = 0;
+  std::atomic<std::size_t> _tail{0};
+  std::atomic<std::size_t> _head{0};
+  std::atomic<uint32_t> _sampled{0};
+  std::atomic<uint64_t> _written{0};
+  std::atomic<uint64_t> _dropped{0};
+  std::atomic<uint64_t> _skipped{0};
+  std::atomic<bool> _stopping{false};
+  std::thread _worker;
+
+  bool should_log(std::chrono::microseconds elapsed, const Status &status) {
+    if (!status.is_ok() && _options.always_log_failures) {
+      return true;
+    }
+    if (elapsed < _options.slow_query_threshold) {
+      return false;
+    }
+    return _options.sample_every == 1 ||
+           _sampled.fetch_add(1, std::memory_order_relaxed) %
+                   _options.sample_every ==
+               0;
+  }
+
+  bool pop(QueryLogEntry *entry) {
+    auto head = _head.load(std::memory_order_relaxed);
+    auto &slot = _slots[head & _mask];
+    if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+      return false;
+    }
+
+    entry->sql.assign(slot.sql);
+    entry->elapsed = slot.elapsed;
+    entry->ok = slot.ok;
+    slot.sequence.store(head + _mask + 1, std::memory_order_release);
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  void run() {
+    QueryLogEntry entry;
+    while (true) {
+      while (pop(&entry)) {
+        _options.sink(entry);
+        _written.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (_stopping.load(std::memory_order_acquire)) {
+        break;
+      }
+      std::this_thread::sleep_for(_options.flush_interval);
+    }
+
+    // entries published before stopping was observed
+    while (pop(&entry)) {
+      _options.sink(entry);
+      _written.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+};
+
+AsyncQueryLogger::AsyncQueryLogger(const AsyncQueryLoggerOptions &options)
+    : _impl(new Impl(options)) {}
+
+AsyncQueryLogger::~AsyncQueryLogger() = default;
+
+void AsyncQueryLogger::log(const std::string &sql,
+                           std::chrono::microseconds elapsed,
+                           const Status &status) {
+  _impl->log(sql, elapsed, status);
+}
+
+void AsyncQueryLogger::flush() { _impl->flush(); }
+
+AsyncQueryLogger::Stats AsyncQueryLogger::stats() const {
+  return _impl->stats();
+}
+
+}  // ookoto
@@ -0,0 +1,21 @@
+#include <ookoto/ookoto.h>
+#include "ConnectionImpl.h"
+#include "ResultCache.h"
+
+namespace ookoto {
+
+const std::size_t ResultCache::Impl::Entry::kNull;
+
+ResultCache::ResultCache(std::size_t capacity) : _impl(new Impl(capacity)) {}
+
+ResultCache::~ResultCache() = default;
+
+void ResultCache::invalidate(const std::string &table) {
+  _impl->invalidate(SqlTables::normalize(table));
+}
+
+void ResultCache::clear() { _impl->clear(); }
+
+ResultCacheStats ResultCache::stats() const { return _impl->stats(); }
+
+}  // ookoto
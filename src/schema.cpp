@@ -0,0 +1,124 @@
+#include <ookoto/ookoto.h>
+#include <memory>
+
+namespace ookoto {
+
+Schema::Property::Property() = default;
+
+Schema::Property &Schema::Property::set_limit(int size) {
+  _limit = size;
+  return *this;
+}
+
+Schema::Property &Schema::Property::set_not_null() {
+  _not_null = true;
+  return *this;
+}
+
+Schema::Property &Schema::Property::set_unique() {
+  _unique = true;
+  return *this;
+}
+
+Schema::Property &Schema::Property::set_primary_key() {
+  _primary_key = true;
+  return *this;
+}
+
+Schema::Property &Schema::Property::set_auto_increment() {
+  _auto_increment = true;
+  return *this;
+}
+
+Schema::Index::Index(const std::string &name,
+                     const std::vector<std::string> &columns)
+    : _name(name), _columns(columns) {}
+
+Schema::Index &Schema::Index::set_unique() {
+  _unique = true;
+  return *this;
+}
+
+Schema::Index &Schema::Index::set_include(
+    const std::vector<std::string> &columns) {
+  _include = columns;
+  return *this;
+}
+
+Schema::Index &Schema::Index::set_where(const std::string &predicate) {
+  _where = predicate;
+  return *this;
+}
+
+Schema::Index &Schema::Index::set_deferred() {
+  _deferred = true;
+  return *this;
+}
+
+Schema::Schema() = default;
+
+void Schema::define_table_name(const std::string &name) { _table_name = name; }
+
+void Schema::define_column(const std::string &name, Type type,
+                           const std::function<void(PropertyPtr)> &fn) {
+  auto prop = std::make_shared<Property>();
+  if (fn != nullptr) {
+    fn(prop);
+  }
+  _column_defs.emplace_back(name, type, prop);
+}
+
+void Schema::define_timestamps() {
+  define_column("created_at", Type::kDateTime);
+  define_column("updated_at", Type::kDateTime);
+}
+
+void Schema::define_primary_key(const std::vector<std::string> &columns) {
+  _primary_key = columns;
+}
+
+void Schema::define_index(const std::string &name,
+                          const std::vector<std::string> &columns,
+                          const std::function<void(IndexPtr)> &fn) {
+  auto index = std::make_shared<Index>(name, columns);
+  if (fn != nullptr) {
+    fn(index);
+  }
+  _indexes.emplace_back(index);
+}
+
+void Schema::define_without_rowid() { _without_rowid = true; }
+
+void Schema::define_engine(const std::string &engine) { _engine = engine; }
+
+void Schema::define_row_format(const std::string &row_format) {
+  _row_format = row_format;
+}
+
+std::string Schema::table_name() const { return _table_name; }
+
+int Schema::defined_column_size() const {
+  return static_cast<int>(_column_defs.size());
+}
+
+void Schema::each_column(
+    const std::function<void(const std::string &column_name)> &fn) {
+  for (auto &def : _column_defs) {
+    fn(std::get<kColumnName>(def));
+  }
+}
+
+void Schema::each_define(const std::function<void(const ColumnType &def)> &fn) {
+  for (auto &def : _column_defs) {
+    fn(def);
+  }
+}
+
+void Schema::each_index(
+    const std::function<void(const Index &index)> &fn) const {
+  for (auto &index : _indexes) {
+    fn(*index);
+  }
+}
+
+}  // ookoto
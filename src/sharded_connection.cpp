@@ -0,0 +1,1272 @@
+#include <cppformat/format.h>
+#include <ookoto/ookoto.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "ColumnarBuilder.h"
+#include "ConnectionImpl.h"
+#include "MysqlThread.h"
+#include "RowBatchBuilder.h"
+
+namespace ookoto {
+
+ShardFunction hash_shard(std::size_t shards) {
+  return [shards](const std::string &key) -> std::size_t {
+    // FNV-1a; std::hash may differ between builds and would move the keys
+    uint64_t hash = 14695981039346656037ULL;
+    for (auto c : key) {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ULL;
+    }
+    return (shards == 0) ? 0 : static_cast<std::size_t>(hash % shards);
+  };
+}
+
+ShardFunction range_shard(const std::vector<int64_t> &bounds) {
+  return [bounds](const std::string &key) -> std::size_t {
+    auto value = std::strtoll(key.c_str(), nullptr, 10);
+    return std::upper_bound(bounds.begin(), bounds.end(), value) -
+           bounds.begin();
+  };
+}
+
+namespace {
+
+// Runs the fan-outs of one ShardedConnection, one thread per shard. A
+// fan-out queues one task per shard and is over only when all of them have
+// finished, so no shard connection is ever used by two threads at once.
+class ShardWorkers {
+ public:
+  ~ShardWorkers() { stop(); }
+
+  void start(std::size_t threads) {
+    _stopping = false;
+    for (std::size_t i = 0; i < threads; i++) {
+      _threads.emplace_back(&ShardWorkers::run, this);
+    }
+  }
+
+  // finishes the queued tasks first
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+    }
+    _ready.notify_all();
+    for (auto &thread : _threads) {
+      thread.join();
+    }
+    _threads.clear();
+  }
+
+  void post(const std::function<void()> &task) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _queue.push_back(task);
+    }
+    _ready.notify_one();
+  }
+
+ private:
+  std::mutex _mutex;
+  std::condition_variable _ready;
+  std::deque<std::function<void()>> _queue;
+  std::vector<std::thread> _threads;
+  bool _stopping = false;
+
+  void run() {
+    // a shard may be a MySQL connection
+    MysqlThread thread;
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _ready.wait(lock, [&]() { return _stopping || !_queue.empty(); });
+        if (_queue.empty()) {
+          return;
+        }
+        task = std::move(_queue.front());
+        _queue.pop_front();
+      }
+      task();
+    }
+  }
+};
+
+// the status of a fan-out: the first failure in shard order, not_found
+// only when every shard found nothing
+Status merge_statuses(const std::vector<Status> &statuses) {
+  bool found = false;
+  for (auto &status : statuses) {
+    if (status.is_ok()) {
+      found = true;
+    } else if (!status.is_not_found()) {
+      return status;
+    }
+  }
+  return (found || statuses.empty()) ? Status::ok() : Status::not_found();
+}
+
+// thrown through a shard's read once its Gather was cancelled, so the
+// driver stops reading the rows nobody will take
+struct ShardCancelled {};
+
+// the status of fn, run on a worker thread where an exception would
+// terminate the process; the SQLite driver throws SQLite::Exception, a
+// std::exception
+Status run_shard(const std::function<Status()> &fn) {
+  try {
+    return fn();
+  } catch (const ShardCancelled &) {
+    return Status::status_ailment("cancelled");
+  } catch (const std::exception &e) {
+    return Status::status_ailment(e.what());
+  } catch (...) {
+    return Status::status_ailment("unknown exception");
+  }
+}
+
+// Rows of every shard on their way to the caller. The shards copy their
+// rows into blocks and the caller takes the blocks in the order they were
+// filled, resolving the views of a block while it holds it. The blocks in
+// flight are bounded, so a slow caller holds the shards back rather than
+// buffering their whole results, and blocks are recycled once read.
+class Gather {
+ public:
+  enum : std::size_t { kBlockRows = 256 };
+
+  struct Cell {
+    Value::Type type;
+    int64_t integer;
+    double real;
+    std::size_t offset;
+    std::size_t size;
+  };
+
+  struct Block {
+    std::string arena;
+    std::vector<Cell> cells;
+    std::size_t rows = 0;
+  };
+
+  using BlockPtr = std::unique_ptr<Block>;
+
+  Gather(std::size_t shards, std::size_t capacity)
+      : _statuses(shards), _running(shards), _capacity(capacity) {}
+
+  const RowView::Columns &columns() const { return _columns; }
+
+  BlockPtr take() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_free.empty()) {
+      return BlockPtr(new Block);
+    }
+    auto block = std::move(_free.back());
+    _free.pop_back();
+    return block;
+  }
+
+  // the first shard to see a row names the columns for all of them
+  void set_columns(const RowView::Columns &columns) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_has_columns) {
+      _columns = columns;
+      _has_columns = true;
+    }
+  }
+
+  // false once the caller has stopped reading
+  bool push(BlockPtr block) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _space.wait(lock,
+                [&]() { return _cancelled || _queue.size() < _capacity; });
+    if (_cancelled) {
+      return false;
+    }
+    _queue.push_back(std::move(block));
+    lock.unlock();
+    _filled.notify_one();
+    return true;
+  }
+
+  bool cancelled() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _cancelled;
+  }
+
+  void finish(std::size_t shard, const Status &status) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _statuses[shard] = status;
+      _running -= 1;
+    }
+    _filled.notify_all();
+  }
+
+  // the next block; false once every shard has finished and all blocks
+  // have been taken
+  bool pop(BlockPtr *block) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _filled.wait(lock, [&]() { return !_queue.empty() || _running == 0; });
+    if (_queue.empty()) {
+      return false;
+    }
+    *block = std::move(_queue.front());
+    _queue.pop_front();
+    lock.unlock();
+    _space.notify_one();
+    return true;
+  }
+
+  void recycle(BlockPtr block) {
+    block->arena.clear();
+    block->cells.clear();
+    block->rows = 0;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _free.push_back(std::move(block));
+  }
+
+  // drops the rows not read yet and waits for the shards to finish
+  void cancel() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cancelled = true;
+    _queue.clear();
+    _space.notify_all();
+    _filled.wait(lock, [&]() { return _running == 0; });
+  }
+
+  Status status() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return merge_statuses(_statuses);
+  }
+
+ private:
+  mutable std::mutex _mutex;
+  std::condition_variable _filled;
+  std::condition_variable _space;
+  std::deque<BlockPtr> _queue;
+  std::vector<BlockPtr> _free;
+  RowView::Columns _columns;
+  bool _has_columns = false;
+  std::vector<Status> _statuses;
+  std::size_t _running = 0;
+  std::size_t _capacity = 0;
+  bool _cancelled = false;
+};
+
+// cancels a Gather when the reading scope is left, so the shards are not
+// left blocked on rows nobody takes when fn throws. Once every row has been
+// taken there is nothing left to cancel.
+class GatherGuard {
+ public:
+  explicit GatherGuard(Gather &gather) : _gather(gather) {}
+  ~GatherGuard() { _gather.cancel(); }
+
+ private:
+  Gather &_gather;
+};
+
+// Copies the rows of one shard into the blocks of a Gather. Runs on the
+// worker thread of the shard.
+class ShardReader {
+ public:
+  explicit ShardReader(Gather &gather) : _gather(gather) {}
+
+  void add(const RowView &row) {
+    if (!begin_row(row)) {
+      return;
+    }
+    for (std::size_t i = 0; i < row.size(); i++) {
+      auto value = row[i];
+      if (value.is_null()) {
+        add_cell(Value::Type::kNull, 0, 0);
+      } else {
+        add_bytes(Value::Type::kText, value.data(), value.size());
+      }
+    }
+    end_row();
+  }
+
+  void add(const ValueRow &row) {
+    if (!begin_row(row)) {
+      return;
+    }
+    for (std::size_t i = 0; i < row.size(); i++) {
+      auto value = row[i];
+      switch (value.type()) {
+        case Value::Type::kInteger:
+          add_cell(value.type(), value.as_integer(), 0);
+          break;
+        case Value::Type::kReal:
+          add_cell(value.type(), 0, value.as_real());
+          break;
+        case Value::Type::kText:
+        case Value::Type::kBlob: {
+          auto bytes = value.as_bytes();
+          add_bytes(value.type(), bytes.data(), bytes.size());
+          break;
+        }
+        case Value::Type::kNull:
+          add_cell(value.type(), 0, 0);
+          break;
+      }
+    }
+    end_row();
+  }
+
+  // hands over the rows of the last, partly filled block
+  void flush() {
+    if (_block && 0 < _block->rows) {
+      _stopped = !_gather.push(std::move(_block));
+    }
+    _block.reset();
+  }
+
+ private:
+  Gather &_gather;
+  Gather::BlockPtr _block;
+  bool _named = false;
+  bool _stopped = false;
+
+  template <typename Row>
+  bool begin_row(const Row &row) {
+    if (_stopped) {
+      return false;
+    }
+    if (!_named) {
+      RowView::Columns columns;
+      for (std::size_t i = 0; i < row.size(); i++) {
+        columns.add(row.name(i));
+      }
+      _gather.set_columns(columns);
+      _named = true;
+    }
+    if (_block == nullptr) {
+      _block = _gather.take();
+    }
+    return true;
+  }
+
+  void add_cell(Value::Type type, int64_t integer, double real) {
+    _block->cells.push_back(Gather::Cell{type, integer, real, 0, 0});
+  }
+
+  void add_bytes(Value::Type type, const char *data, std::size_t size) {
+    _block->cells.push_back(
+        Gather::Cell{type, 0, 0, _block->arena.size(), size});
+    _block->arena.append(data, size);
+  }
+
+  void end_row() {
+    _block->rows += 1;
+    if (_block->rows == Gather::kBlockRows) {
+      flush();
+      if (_stopped) {
+        throw ShardCancelled();
+      }
+    }
+  }
+};
+
+StringView cell_bytes(const Gather::Block &block, const Gather::Cell &cell) {
+  return StringView(block.arena.data() + cell.offset, cell.size);
+}
+
+Value cell_value(const Gather::Block &block, const Gather::Cell &cell) {
+  switch (cell.type) {
+    case Value::Type::kInteger:
+      return Value::integer(cell.integer);
+    case Value::Type::kReal:
+      return Value::real(cell.real);
+    case Value::Type::kText:
+      return Value::text(block.arena.data() + cell.offset, cell.size);
+    case Value::Type::kBlob:
+      return Value::blob(block.arena.data() + cell.offset, cell.size);
+    default:
+      return Value();
+  }
+}
+
+// the value of a cell as text, for readers that ask numbers for text
+std::string cell_text(const Gather::Block &block, const Gather::Cell &cell) {
+  switch (cell.type) {
+    case Value::Type::kInteger:
+      return fmt::format("{}", cell.integer);
+    case Value::Type::kReal:
+      return fmt::format("{}", cell.real);
+    case Value::Type::kText:
+    case Value::Type::kBlob:
+      return std::string(block.arena.data() + cell.offset, cell.size);
+    default:
+      return std::string();
+  }
+}
+
+// reads the current row of a gathered block as Values
+class BlockReader : public ColumnReader {
+ public:
+  explicit BlockReader(const RowView::Columns &columns)
+      : _columns(columns), _values(columns.size()), _texts(columns.size()) {}
+
+  void load(const Gather::Block &block, std::size_t row) {
+    _block = &block;
+    _cells = block.cells.data() + row * _values.size();
+    for (std::size_t i = 0; i < _values.size(); i++) {
+      _values[i] = cell_value(block, _cells[i]);
+    }
+  }
+
+  ValueRow row() const { return ValueRow(_columns, _values.data()); }
+
+  const RowView::Columns &columns() const override { return _columns; }
+
+  bool is_null(int index) const override { return _values[index].is_null(); }
+
+  int64_t get_int64(int index) const override {
+    auto &value = _values[index];
+    if (value.type() == Value::Type::kText) {
+      return std::strtoll(cell_text(*_block, _cells[index]).c_str(), nullptr,
+                          10);
+    }
+    return value.as_integer();
+  }
+
+  double get_double(int index) const override {
+    auto &value = _values[index];
+    if (value.type() == Value::Type::kText) {
+      return std::strtod(cell_text(*_block, _cells[index]).c_str(), nullptr);
+    }
+    return value.as_real();
+  }
+
+  StringView get_text(int index) const override {
+    auto &value = _values[index];
+    switch (value.type()) {
+      case Value::Type::kNull:
+        return StringView();
+      case Value::Type::kText:
+      case Value::Type::kBlob:
+        return value.as_bytes();
+      default:
+        _texts[index] = cell_text(*_block, _cells[index]);
+        return StringView(_texts[index].data(), _texts[index].size());
+    }
+  }
+
+ private:
+  const RowView::Columns &_columns;
+  std::vector<Value> _values;
+  mutable std::vector<std::string> _texts;
+  const Gather::Block *_block = nullptr;
+  const Gather::Cell *_cells = nullptr;
+};
+
+// hands every gathered row to fn as a RowView, on the calling thread
+Status read_views(Gather &gather,
+                 const std::function<void(const RowView &)> &fn) {
+  GatherGuard guard(gather);
+  std::vector<StringView> values;
+  Gather::BlockPtr block;
+  while (gather.pop(&block)) {
+    auto &columns = gather.columns();
+    auto width = columns.size();
+    values.resize(width);
+    RowView view(columns, values.data());
+    for (std::size_t row = 0; row < block->rows; row++) {
+      auto cells = block->cells.data() + row * width;
+      for (std::size_t i = 0; i < width; i++) {
+        values[i] = (cells[i].type == Value::Type::kNull)
+                        ? StringView()
+                        : cell_bytes(*block, cells[i]);
+      }
+      fn(view);
+    }
+    gather.recycle(std::move(block));
+  }
+  return gather.status();
+}
+
+// reads every shard through one cursor
+class GatherCursor : public Cursor {
+ public:
+  explicit GatherCursor(std::shared_ptr<Gather> gather)
+      : _gather(std::move(gather)), _row(_gather->columns(), nullptr) {}
+
+  virtual ~GatherCursor() { close(); }
+
+  bool next() override {
+    if (_gather == nullptr) {
+      return false;
+    }
+
+    if (_block == nullptr || _block->rows <= ++_index) {
+      if (_block) {
+        _gather->recycle(std::move(_block));
+      }
+      if (!_gather->pop(&_block)) {
+        auto status = _gather->status();
+        if (_gather->cancelled()) {
+          _status = Status::status_ailment("closed by another operation");
+        } else if (!status.is_not_found()) {
+          _status = status;
+        }
+        close();
+        return false;
+      }
+      _index = 0;
+    }
+
+    auto width = _gather->columns().size();
+    _values.resize(width);
+    auto cells = _block->cells.data() + _index * width;
+    for (std::size_t i = 0; i < width; i++) {
+      _values[i] = (cells[i].type == Value::Type::kNull)
+                       ? StringView()
+                       : cell_bytes(*_block, cells[i]);
+    }
+    _row = RowView(_gather->columns(), _values.data());
+    return true;
+  }
+
+  const RowView &row() const override { return _row; }
+
+  Status status() const override { return _status; }
+
+  void close() override {
+    if (_gather) {
+      _gather->cancel();
+      _gather.reset();
+      _block.reset();
+    }
+  }
+
+ private:
+  std::shared_ptr<Gather> _gather;
+  Gather::BlockPtr _block;
+  std::size_t _index = 0;
+  std::vector<StringView> _values;
+  RowView _row;
+  Status _status = Status::ok();
+};
+
+// routes each row to the appender of the shard its key falls on
+class ShardedAppender : public Appender {
+ public:
+  ShardedAppender(std::vector<std::unique_ptr<Appender>> appenders,
+                  std::size_t key_index, const ShardFunction &shard)
+      : _appenders(std::move(appenders)),
+        _key_index(key_index),
+        _shard(shard) {}
+
+  virtual ~ShardedAppender() = default;
+
+  Status append(const Row &row) override {
+    if (row.size() <= _key_index) {
+      return Status::invalid_argument();
+    }
+    auto index = _shard(row[_key_index]);
+    if (_appenders.size() <= index) {
+      return Status::invalid_argument();
+    }
+    return _appenders[index]->append(row);
+  }
+
+  Status flush() override {
+    std::vector<Status> statuses;
+    for (auto &appender : _appenders) {
+      statuses.push_back(appender->flush());
+    }
+    return merge_statuses(statuses);
+  }
+
+  BulkInsertStats stats() const override {
+    BulkInsertStats total;
+    for (auto &appender : _appenders) {
+      auto stats = appender->stats();
+      total.rows += stats.rows;
+      total.chunks += stats.chunks;
+      total.seconds = std::max(total.seconds, stats.seconds);
+    }
+    return total;
+  }
+
+ private:
+  std::vector<std::unique_ptr<Appender>> _appenders;
+  std::size_t _key_index = 0;
+  ShardFunction _shard;
+};
+}
+
+class ShardedConnection::Impl {
+ public:
+  Impl(const std::vector<Config> &configs, const ShardingOptions &options)
+      : _configs(configs), _options(options) {
+    if (_options.shard == nullptr) {
+      _options.shard = hash_shard(_configs.size());
+    }
+    if (_options.prefetch_rows == 0) {
+      _options.prefetch_rows = Gather::kBlockRows;
+    }
+  }
+
+  ~Impl() { disconnect(); }
+
+  std::size_t shard_count() const { return _configs.size(); }
+
+  std::size_t shard_of(const std::string &key) const {
+    return _options.shard(key);
+  }
+
+  ConnectionInterface *shard(std::size_t index) const {
+    return (index < _shards.size()) ? _shards[index].get() : nullptr;
+  }
+
+  bool exists_table(const std::string &table_name) const {
+    close_cursor();
+    if (_shards.empty()) {
+      return false;
+    }
+    for (auto &shard : _shards) {
+      if (!shard->exists_table(table_name)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  int64_t last_row_id() const {
+    close_cursor();
+    auto routed = shard(_last_shard);
+    return (routed) ? routed->last_row_id() : 0;
+  }
+
+  Status connect() {
+    if (_configs.empty()) {
+      return Status::invalid_argument();
+    }
+    disconnect();
+
+    for (auto &config : _configs) {
+      std::unique_ptr<ConnectionInterface> connection;
+      auto result = open_connection(config, &connection);
+      if (!result.is_ok()) {
+        disconnect();
+        return result;
+      }
+      _shards.emplace_back(std::move(connection));
+    }
+    _workers.start(_shards.size());
+    return Status::ok();
+  }
+
+  Status disconnect() {
+    close_cursor();
+    _workers.stop();
+
+    for (auto &shard : _shards) {
+      shard->disconnect();
+    }
+    _shards.clear();
+    _last_shard = 0;
+    return Status::ok();
+  }
+
+  Status route(const std::string &key, ConnectionInterface **connection) {
+    close_cursor();
+    auto index = _options.shard(key);
+    if (_shards.size() <= index) {
+      return Status::invalid_argument();
+    }
+    _last_shard = index;
+    *connection = _shards[index].get();
+    return Status::ok();
+  }
+
+  // runs fn on every shard at once and waits for all of them
+  Status fan_out(
+      const std::function<Status(std::size_t, ConnectionInterface &)> &fn) {
+    close_cursor();
+    if (_shards.empty()) {
+      return Status::status_ailment("not connected");
+    }
+
+    std::vector<Status> statuses(_shards.size());
+    std::mutex mutex;
+    std::condition_variable finished;
+    auto running = _shards.size();
+    for (std::size_t i = 0; i < _shards.size(); i++) {
+      auto shard = _shards[i].get();
+      _workers.post([&, i, shard]() {
+        auto status = run_shard([&]() { return fn(i, *shard); });
+        std::lock_guard<std::mutex> lock(mutex);
+        statuses[i] = status;
+        if (--running == 0) {
+          finished.notify_one();
+        }
+      });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&]() { return running == 0; });
+    return merge_statuses(statuses);
+  }
+
+  // starts read on every shard, copying the rows into the returned Gather
+  std::shared_ptr<Gather> scatter(
+      const std::function<Status(ConnectionInterface &, ShardReader &)> &read) {
+    close_cursor();
+    auto capacity = std::max<std::size_t>(
+        1, _shards.size() * _options.prefetch_rows / Gather::kBlockRows);
+    auto gather = std::make_shared<Gather>(_shards.size(), capacity);
+    for (std::size_t i = 0; i < _shards.size(); i++) {
+      auto shard = _shards[i].get();
+      _workers.post([gather, read, i, shard]() {
+        ShardReader reader(*gather);
+        auto status = run_shard([&]() {
+          auto status = read(*shard, reader);
+          reader.flush();
+          return status;
+        });
+        gather->finish(i, status);
+      });
+    }
+    return gather;
+  }
+
+  Status each_view(
+      const std::function<Status(ConnectionInterface &, ShardReader &)> &read,
+      const std::function<void(const RowView &)> &fn) {
+    if (_shards.empty()) {
+      return Status::status_ailment("not connected");
+    }
+    return read_views(*scatter(read), fn);
+  }
+
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const RowType &)> &fn) {
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+
+    return execute_sql_for_each(sql, [&](const RowView &view) {
+      RowType row;
+      for (std::size_t i = 0; i < view.size(); i++) {
+        row.emplace(std::make_pair(view.name(i), view[i].to_string()));
+      }
+      fn(row);
+    });
+  }
+
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const RowView &)> &fn) {
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+
+    return each_view(
+        [&](ConnectionInterface &shard, ShardReader &reader) {
+          return shard.execute_sql_for_each(
+              sql, [&](const RowView &row) { reader.add(row); });
+        },
+        fn);
+  }
+
+  Status execute_sql_for_each(
+      const std::string &sql,
+      const std::function<void(const ColumnReader &)> &fn) {
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+
+    return each_value(sql, [&](const BlockReader &reader) { fn(reader); });
+  }
+
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const ValueRow &)> &fn) {
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+
+    return each_value(sql,
+                      [&](const BlockReader &reader) { fn(reader.row()); });
+  }
+
+  Status execute_sql_for_each_batch(
+      const std::string &sql, std::size_t batch_size,
+      const std::function<void(const RowBatch &)> &fn) {
+    if (batch_size == 0) {
+      return Status::invalid_argument();
+    }
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+    if (_shards.empty()) {
+      return Status::status_ailment("not connected");
+    }
+
+    auto gather = scatter([&](ConnectionInterface &shard, ShardReader &reader) {
+      return shard.execute_sql_for_each(
+          sql, [&](const RowView &row) { reader.add(row); });
+    });
+    GatherGuard guard(*gather);
+
+    // the columns are known once the first block arrives
+    std::unique_ptr<RowBatchBuilder> builder;
+    Gather::BlockPtr block;
+    while (gather->pop(&block)) {
+      auto width = gather->columns().size();
+      if (builder == nullptr) {
+        builder.reset(new RowBatchBuilder(gather->columns(), batch_size, fn));
+      }
+      for (std::size_t row = 0; row < block->rows; row++) {
+        auto cells = block->cells.data() + row * width;
+        for (std::size_t i = 0; i < width; i++) {
+          if (cells[i].type == Value::Type::kNull) {
+            builder->append_null();
+          } else {
+            builder->append(block->arena.data() + cells[i].offset,
+                            cells[i].size);
+          }
+        }
+        builder->end_row();
+      }
+      gather->recycle(std::move(block));
+    }
+    if (builder) {
+      builder->deliver();
+    }
+    return gather->status();
+  }
+
+  Status execute_sql_columnar(const std::string &sql,
+                              ColumnarResult *result) {
+    if (result == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    ColumnarBuilder builder(result);
+    bool named = false;
+    auto status = each_value(sql, [&](const BlockReader &reader) {
+      auto &columns = reader.columns();
+      if (!named) {
+        for (std::size_t i = 0; i < columns.size(); i++) {
+          builder.add_column(columns.name(i));
+        }
+        named = true;
+      }
+
+      auto row = reader.row();
+      for (std::size_t i = 0; i < columns.size(); i++) {
+        auto value = row[i];
+        if (value.is_null()) {
+          builder.append_null(i);
+          continue;
+        }
+
+        auto index = static_cast<int>(i);
+        switch (builder.resolve(i, value.type())) {
+          case ColumnarResult::Type::kInteger:
+            builder.append_integer(i, reader.get_int64(index));
+            break;
+          case ColumnarResult::Type::kReal:
+            builder.append_real(i, reader.get_double(index));
+            break;
+          case ColumnarResult::Type::kNull:
+            builder.append_null(i);
+            break;
+          default: {
+            auto bytes = reader.get_text(index);
+            builder.append_bytes(i, bytes.data(), bytes.size());
+            break;
+          }
+        }
+      }
+      builder.end_row();
+    });
+    return (status.is_not_found()) ? Status::ok() : status;
+  }
+
+  Status query(const std::string &sql, std::unique_ptr<Cursor> *cursor,
+               const CursorOptions &options) {
+    if (cursor == nullptr) {
+      return Status::invalid_argument();
+    }
+    if (_shards.empty()) {
+      return Status::status_ailment("not connected");
+    }
+
+    // the shards may still be reading after this call returns; each reads
+    // through a cursor of its own so fetch_size applies per shard
+    auto gather = scatter([sql, options](ConnectionInterface &shard,
+                                         ShardReader &reader) {
+      std::unique_ptr<Cursor> cursor;
+      auto result = shard.query(sql, &cursor, options);
+      if (!result.is_ok()) {
+        return result;
+      }
+      while (cursor->next()) {
+        reader.add(cursor->row());
+      }
+      return cursor->status();
+    });
+    _cursor = gather;
+    cursor->reset(new GatherCursor(gather));
+    return Status::ok();
+  }
+
+  Status execute_sql_cached(const std::string &sql,
+                            const std::vector<Value> &params,
+                            const std::function<void(const RowView &)> &fn) {
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+
+    return each_view(
+        [&](ConnectionInterface &shard, ShardReader &reader) {
+          return shard.execute_sql_cached(
+              sql, params, [&](const RowView &row) { reader.add(row); });
+        },
+        fn);
+  }
+
+  StatementCacheStats statement_cache_stats() const {
+    close_cursor();
+    StatementCacheStats total;
+    for (auto &shard : _shards) {
+      auto stats = shard->statement_cache_stats();
+      total.hits += stats.hits;
+      total.misses += stats.misses;
+      total.evictions += stats.evictions;
+      total.size += stats.size;
+      total.capacity += stats.capacity;
+    }
+    return total;
+  }
+
+  Status create_appender(std::shared_ptr<Schema> schema,
+                         const BulkInsertOptions &options,
+                         std::unique_ptr<Appender> *appender) {
+    if (schema == nullptr || appender == nullptr) {
+      return Status::invalid_argument();
+    }
+    close_cursor();
+    if (_shards.empty()) {
+      return Status::status_ailment("not connected");
+    }
+
+    std::size_t key_index = 0;
+    auto result = find_key(schema, &key_index);
+    if (!result.is_ok()) {
+      return result;
+    }
+
+    std::vector<std::unique_ptr<Appender>> appenders(_shards.size());
+    for (std::size_t i = 0; i < _shards.size(); i++) {
+      result = _shards[i]->create_appender(schema, options, &appenders[i]);
+      if (!result.is_ok()) {
+        return result;
+      }
+    }
+    appender->reset(
+        new ShardedAppender(std::move(appenders), key_index, _options.shard));
+    return Status::ok();
+  }
+
+  Status bulk_insert(std::shared_ptr<Schema> schema,
+                     const std::vector<Appender::Row> &rows,
+                     const BulkInsertOptions &options,
+                     BulkInsertStats *stats) {
+    if (schema == nullptr) {
+      return Status::invalid_argument();
+    }
+    if (_shards.empty()) {
+      return Status::status_ailment("not connected");
+    }
+
+    std::size_t key_index = 0;
+    auto result = find_key(schema, &key_index);
+    if (!result.is_ok()) {
+      return result;
+    }
+
+    std::vector<std::vector<Appender::Row>> parts(_shards.size());
+    for (auto &row : rows) {
+      if (row.size() <= key_index) {
+        return Status::invalid_argument();
+      }
+      auto index = _options.shard(row[key_index]);
+      if (parts.size() <= index) {
+        return Status::invalid_argument();
+      }
+      parts[index].push_back(row);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BulkInsertStats> written(_shards.size());
+    result = fan_out([&](std::size_t i, ConnectionInterface &shard) {
+      return (parts[i].empty())
+                 ? Status::ok()
+                 : shard.bulk_insert(schema, parts[i], options, &written[i]);
+    });
+
+    if (stats) {
+      *stats = BulkInsertStats();
+      for (auto &shard : written) {
+        stats->rows += shard.rows;
+        stats->chunks += shard.chunks;
+      }
+      stats->seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    }
+    return result;
+  }
+
+ private:
+  std::vector<Config> _configs;
+  ShardingOptions _options;
+  std::vector<std::unique_ptr<ConnectionInterface>> _shards;
+  std::size_t _last_shard = 0;
+  ShardWorkers _workers;
+  // the shards of an open cursor may still be reading; it is closed
+  // before anything else uses them
+  mutable std::weak_ptr<Gather> _cursor;
+
+  void close_cursor() const {
+    if (auto gather = _cursor.lock()) {
+      gather->cancel();
+    }
+    _cursor.reset();
+  }
+
+  Status each_value(const std::string &sql,
+                    const std::function<void(const BlockReader &)> &fn) {
+    if (_shards.empty()) {
+      return Status::status_ailment("not connected");
+    }
+
+    auto gather = scatter([&](ConnectionInterface &shard, ShardReader &reader) {
+      return shard.execute_sql_for_each(
+          sql, [&](const ValueRow &row) { reader.add(row); });
+    });
+    GatherGuard guard(*gather);
+
+    std::unique_ptr<BlockReader> reader;
+    Gather::BlockPtr block;
+    while (gather->pop(&block)) {
+      if (reader == nullptr) {
+        reader.reset(new BlockReader(gather->columns()));
+      }
+      for (std::size_t row = 0; row < block->rows; row++) {
+        reader->load(*block, row);
+        fn(*reader);
+      }
+      gather->recycle(std::move(block));
+    }
+    return gather->status();
+  }
+
+  // the position of the key column in Appender::Row
+  Status find_key(std::shared_ptr<Schema> schema, std::size_t *key_index) {
+    if (_options.key_column.empty()) {
+      *key_index = 0;
+      return Status::ok();
+    }
+
+    std::size_t index = 0;
+    bool found = false;
+    schema->each_define([&](const Schema::ColumnType &def) {
+      if (found ||
+          std::get<Schema::kColumnProperties>(def)->auto_increment()) {
+        return;
+      }
+      if (std::get<Schema::kColumnName>(def) == _options.key_column) {
+        found = true;
+        *key_index = index;
+      }
+      index++;
+    });
+    return (found) ? Status::ok()
+                   : Status::invalid_argument(_options.key_column);
+  }
+};
+
+ShardedConnection::ShardedConnection(const std::vector<Config> &shards,
+                                     const ShardingOptions &options)
+    : _impl(new Impl(shards, options)) {}
+
+ShardedConnection::~ShardedConnection() = default;
+
+std::size_t ShardedConnection::shard_count() const {
+  return _impl->shard_count();
+}
+
+std::size_t ShardedConnection::shard_of(const std::string &key) const {
+  return _impl->shard_of(key);
+}
+
+ConnectionInterface *ShardedConnection::shard(std::size_t index) const {
+  return _impl->shard(index);
+}
+
+bool ShardedConnection::exists_table(const std::string &table_name) const {
+  return _impl->exists_table(table_name);
+}
+
+int64_t ShardedConnection::last_row_id() const { return _impl->last_row_id(); }
+
+Status ShardedConnection::connect(const Config &) { return connect(); }
+
+Status ShardedConnection::connect() {
+  auto result = _impl->connect();
+  if (result.is_ok()) {
+    _has_connection = true;
+  }
+  return result;
+}
+
+Status ShardedConnection::disconnect() {
+  auto result = _impl->disconnect();
+  if (result.is_ok()) {
+    _has_connection = false;
+  }
+  return result;
+}
+
+Status ShardedConnection::create_table(std::shared_ptr<Schema> schema) {
+  return _impl->fan_out([&](std::size_t, ConnectionInterface &shard) {
+    return shard.create_table(schema);
+  });
+}
+
+Status ShardedConnection::create_indexes(std::shared_ptr<Schema> schema) {
+  return _impl->fan_out([&](std::size_t, ConnectionInterface &shard) {
+    return shard.create_indexes(schema);
+  });
+}
+
+Status ShardedConnection::drop_table(const std::string &table_name) {
+  return _impl->fan_out([&](std::size_t, ConnectionInterface &shard) {
+    return shard.drop_table(table_name);
+  });
+}
+
+Status ShardedConnection::transaction(const std::function<Status()> &) {
+  return Status::status_ailment("a transaction needs a shard key");
+}
+
+Status ShardedConnection::transaction(const std::string &key,
+                                      const std::function<Status()> &t) {
+  ConnectionInterface *connection = nullptr;
+  auto result = _impl->route(key, &connection);
+  return (result.is_ok()) ? connection->transaction(t) : result;
+}
+
+Status ShardedConnection::execute_sql(const std::string &sql) {
+  // a row change sent to every shard would be applied once per shard
+  std::vector<std::string> tables;
+  bool rows = false;
+  if (!SqlTables::written(sql, &tables, &rows) || rows) {
+    return Status::invalid_argument("a write needs a shard key");
+  }
+  return _impl->fan_out([&](std::size_t, ConnectionInterface &shard) {
+    return shard.execute_sql(sql);
+  });
+}
+
+Status ShardedConnection::execute_sql(const std::string &key,
+                                      const std::string &sql) {
+  ConnectionInterface *connection = nullptr;
+  auto result = _impl->route(key, &connection);
+  return (result.is_ok()) ? connection->execute_sql(sql) : result;
+}
+
+Status ShardedConnection::execute_sql_for_each(
+    const std::string &sql, const std::function<void(const RowType &)> &fn) {
+  return _impl->execute_sql_for_each(sql, fn);
+}
+
+Status ShardedConnection::execute_sql_for_each(
+    const std::string &sql, const std::function<void(const RowView &)> &fn) {
+  return _impl->execute_sql_for_each(sql, fn);
+}
+
+Status ShardedConnection::execute_sql_for_each(
+    const std::string &sql,
+    const std::function<void(const ColumnReader &)> &fn) {
+  return _impl->execute_sql_for_each(sql, fn);
+}
+
+Status ShardedConnection::execute_sql_for_each(
+    const std::string &sql, const std::function<void(const ValueRow &)> &fn) {
+  return _impl->execute_sql_for_each(sql, fn);
+}
+
+Status ShardedConnection::execute_sql_for_each(
+    const std::string &key, const std::string &sql,
+    const std::function<void(const RowView &)> &fn) {
+  ConnectionInterface *connection = nullptr;
+  auto result = _impl->route(key, &connection);
+  return (result.is_ok()) ? connection->execute_sql_for_each(sql, fn) : result;
+}
+
+Status ShardedConnection::execute_sql_for_each_batch(
+    const std::string &sql, std::size_t batch_size,
+    const std::function<void(const RowBatch &)> &fn) {
+  return _impl->execute_sql_for_each_batch(sql, batch_size, fn);
+}
+
+Status ShardedConnection::execute_sql_columnar(const std::string &sql,
+                                               ColumnarResult *result) {
+  return _impl->execute_sql_columnar(sql, result);
+}
+
+Status ShardedConnection::query(const std::string &sql,
+                                std::unique_ptr<Cursor> *cursor,
+                                const CursorOptions &options) {
+  return _impl->query(sql, cursor, options);
+}
+
+Status ShardedConnection::execute_sql_cached(
+    const std::string &sql, const std::vector<Value> &params,
+    const std::function<void(const RowView &)> &fn) {
+  return _impl->execute_sql_cached(sql, params, fn);
+}
+
+Status ShardedConnection::prepare(const std::string &,
+                                  std::shared_ptr<PreparedStatement> *) {
+  return Status::status_ailment("a prepared statement needs a shard key");
+}
+
+Status ShardedConnection::prepare(
+    const std::string &key, const std::string &sql,
+    std::shared_ptr<PreparedStatement> *statement) {
+  ConnectionInterface *connection = nullptr;
+  auto result = _impl->route(key, &connection);
+  return (result.is_ok()) ? connection->prepare(sql, statement) : result;
+}
+
+StatementCacheStats ShardedConnection::statement_cache_stats() const {
+  return _impl->statement_cache_stats();
+}
+
+Status ShardedConnection::create_appender(std::shared_ptr<Schema> schema,
+                                          const BulkInsertOptions &options,
+                                          std::unique_ptr<Appender> *appender) {
+  return _impl->create_appender(schema, options, appender);
+}
+
+Status ShardedConnection::bulk_insert(std::shared_ptr<Schema> schema,
+                                      const std::vector<Appender::Row> &rows,
+                                      const BulkInsertOptions &options,
+                                      BulkInsertStats *stats) {
+  return _impl->bulk_insert(schema, rows, options, stats);
+}
+
+}  // ookoto
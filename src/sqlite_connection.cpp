@@ -1,17 +1,728 @@
+#include <SQLiteCpp/Backup.h>
 #include <SQLiteCpp/SQLiteCpp.h>
 #include <cppformat/format.h>
 #include <ookoto/ookoto.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <map>
 #include <exception>
+#include <mutex>
+#include <set>
+#include <thread>
+#include "ColumnarBuilder.h"
 #include "ConnectionImpl.h"
+#include "RowBatchBuilder.h"
+#include "StatementCache.h"
 
 namespace ookoto {
 
 class SqliteConnection::Impl : public ConnectionImpl {
  public:
+  class Statement : public PreparedStatement {
+   public:
+    Statement(SQLite::Database &db, const std::string &sql)
+        : _query(db, sql), _handle(db.getHandle()) {
+      auto count = _query.getColumnCount();
+      for (int i = 0; i < count; i++) {
+        _columns.add(_query.getColumnName(i));
+      }
+      _values.resize(count);
+
+      // SQLiteCpp keeps the native statement to itself; sqlite3 lists the
+      // newest statement of a handle first
+      _stmt = sqlite3_next_stmt(_handle, nullptr);
+      if (_stmt != nullptr && _query.getQuery() != sqlite3_sql(_stmt)) {
+        _stmt = nullptr;
+      }
+    }
+
+    Status bind(int index, int64_t value) override {
+      return guard(
+          [&]() { _query.bind(index, static_cast<sqlite3_int64>(value)); });
+    }
+
+    Status bind(int index, double value) override {
+      return guard([&]() { _query.bind(index, value); });
+    }
+
+    Status bind(int index, const std::string &value) override {
+      return guard([&]() { _query.bind(index, value); });
+    }
+
+    Status bind_null(int index) override {
+      return guard([&]() { _query.bind(index); });
+    }
+
+    Status clear_bindings() override {
+      return guard([&]() { _query.clearBindings(); });
+    }
+
+    Status execute() override {
+      return guard([&]() {
+        Rewind rewind(_query);
+        while (_query.executeStep()) {
+        }
+      });
+    }
+
+    Status execute_for_each(
+        const std::function<void(const RowView &)> &fn) override {
+      if (fn == nullptr) {
+        return Status::status_ailment();
+      }
+
+      auto row = view();
+      return step([&](SQLite::Statement &) {
+        load();
+        fn(row);
+      });
+    }
+
+    Status read_each(const std::function<void(const ColumnReader &)> &fn) {
+      if (fn == nullptr) {
+        return Status::status_ailment();
+      }
+
+      Reader reader(_query, _columns);
+      return step([&](SQLite::Statement &) { fn(reader); });
+    }
+
+    Status read_values(const std::function<void(const ValueRow &)> &fn) {
+      if (fn == nullptr) {
+        return Status::status_ailment();
+      }
+
+      std::vector<Value> values(_columns.size());
+      ValueRow row(_columns, values.data());
+      auto count = static_cast<int>(values.size());
+      return step([&](SQLite::Statement &query) {
+        for (int i = 0; i < count; i++) {
+          values[i] = to_value(query.getColumn(i));
+        }
+        fn(row);
+      });
+    }
+
+    Status read_batches(std::size_t batch_size,
+                        const std::function<void(const RowBatch &)> &fn) {
+      if (fn == nullptr) {
+        return Status::status_ailment();
+      }
+
+      RowBatchBuilder builder(_columns, batch_size, fn);
+      auto count = static_cast<int>(_columns.size());
+      auto status = step([&](SQLite::Statement &query) {
+        for (int i = 0; i < count; i++) {
+          auto column = query.getColumn(i);
+          if (column.isNull()) {
+            builder.append_null();
+            continue;
+          }
+          // getText() first, so that getBytes() measures the converted text
+          auto t = column.getText();
+          builder.append(t, column.getBytes());
+        }
+        builder.end_row();
+      });
+      if (status.is_ok()) {
+        builder.deliver();
+      }
+      return status;
+    }
+
+    Status execute_columnar(ColumnarResult *result) {
+      ColumnarBuilder builder(result);
+      for (std::size_t i = 0; i < _columns.size(); i++) {
+        builder.add_column(_columns.name(i));
+      }
+
+      auto count = static_cast<int>(_columns.size());
+      auto status = step([&](SQLite::Statement &query) {
+        for (int i = 0; i < count; i++) {
+          auto column = query.getColumn(i);
+          auto type = column.getType();
+          if (type == SQLITE_NULL) {
+            builder.append_null(i);
+            continue;
+          }
+
+          switch (builder.resolve(i, to_columnar_type(type))) {
+            case ColumnarResult::Type::kInteger:
+              builder.append_integer(i, column.getInt64());
+              break;
+            case ColumnarResult::Type::kReal:
+              builder.append_real(i, column.getDouble());
+              break;
+            case ColumnarResult::Type::kText: {
+              auto t = column.getText();
+              builder.append_bytes(i, t, column.getBytes());
+              break;
+            }
+            default: {
+              auto b = static_cast<const char *>(column.getBlob());
+              builder.append_bytes(i, b, column.getBytes());
+              break;
+            }
+          }
+        }
+        builder.end_row();
+      });
+
+      return (status.is_not_found()) ? Status::ok() : status;
+    }
+
+    // steps one row for a cursor, leaving the statement open in between;
+    // returns not_found at the end of the result
+    Status fetch() {
+      bool loaded = false;
+      auto result = guard([&]() { loaded = _query.executeStep(); });
+      if (!result.is_ok()) {
+        return result;
+      }
+      if (columns_changed()) {
+        return schema_changed();
+      }
+      if (!loaded) {
+        return Status::not_found();
+      }
+
+      load();
+      return Status::ok();
+    }
+
+    // releases the read lock of a statement stepped by fetch
+    void rewind() { Rewind rewind(_query); }
+
+    RowView view() const { return RowView(_columns, _values.data()); }
+
+    sqlite3 *handle() const { return _handle; }
+
+    // the counters collected since the last call
+    StatementCounters counters() {
+      StatementCounters counters;
+      if (_stmt != nullptr) {
+        counters.fullscan_steps =
+            sqlite3_stmt_status(_stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+        counters.sorts = sqlite3_stmt_status(_stmt, SQLITE_STMTSTATUS_SORT, 1);
+        counters.autoindexes =
+            sqlite3_stmt_status(_stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+        counters.vm_steps =
+            sqlite3_stmt_status(_stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+      }
+      return counters;
+    }
+
+    // true once a schema change altered the columns; the statement has to
+    // be compiled again
+    bool stale() const { return _stale; }
+
+    // true while the handle has an open transaction, whose uncommitted
+    // writes the statement would see
+    bool in_transaction() const { return sqlite3_get_autocommit(_handle) == 0; }
+
+    // steps through the result, handing the statement to fn on every row
+    Status step(const std::function<void(SQLite::Statement &)> &fn) {
+      bool loaded = false;
+      bool changed = false;
+      auto result = guard([&]() {
+        Rewind rewind(_query);
+        auto more = _query.executeStep();
+        // the first step recompiles the statement after a schema change
+        changed = columns_changed();
+        while (more && !changed) {
+          loaded = true;
+          fn(_query);
+          more = _query.executeStep();
+        }
+      });
+      if (!result.is_ok()) {
+        return result;
+      }
+      if (changed) {
+        return schema_changed();
+      }
+
+      return (loaded) ? Status::ok() : Status::not_found();
+    }
+
+   private:
+    // reads the current row straight from the native column accessors
+    class Reader : public ColumnReader {
+     public:
+      Reader(SQLite::Statement &query, const RowView::Columns &columns)
+          : _query(query), _columns(columns) {}
+
+      const RowView::Columns &columns() const override { return _columns; }
+
+      bool is_null(int index) const override {
+        return _query.isColumnNull(index);
+      }
+
+      int64_t get_int64(int index) const override {
+        return _query.getColumn(index).getInt64();
+      }
+
+      double get_double(int index) const override {
+        return _query.getColumn(index).getDouble();
+      }
+
+      StringView get_text(int index) const override {
+        auto column = _query.getColumn(index);
+        if (column.isNull()) {
+          return StringView();
+        }
+        auto t = column.getText();
+        return StringView(t, column.getBytes());
+      }
+
+     private:
+      SQLite::Statement &_query;
+      const RowView::Columns &_columns;
+    };
+
+    // resets the statement on scope exit so it never holds a read lock
+    class Rewind {
+     public:
+      explicit Rewind(SQLite::Statement &query) : _query(query) {}
+      ~Rewind() {
+        try {
+          _query.reset();
+        } catch (const SQLite::Exception &) {
+          // reset() reports the error of the failed step again
+        }
+      }
+
+     private:
+      SQLite::Statement &_query;
+    };
+
+    SQLite::Statement _query;
+    sqlite3 *_handle = nullptr;
+    sqlite3_stmt *_stmt = nullptr;
+    RowView::Columns _columns;
+    std::vector<StringView> _values;
+    int _reprepares = 0;
+    bool _stale = false;
+
+    // sqlite3 recompiles a statement whose schema changed on its next step.
+    // The columns read at prepare time, and the column count SQLiteCpp
+    // checks indexes against, are then out of date when the columns moved.
+    bool columns_changed() {
+      if (_stmt == nullptr) {
+        return false;
+      }
+      auto reprepares =
+          sqlite3_stmt_status(_stmt, SQLITE_STMTSTATUS_REPREPARE, 0);
+      if (reprepares == _reprepares) {
+        return _stale;
+      }
+      _reprepares = reprepares;
+
+      auto count = sqlite3_column_count(_stmt);
+      if (count == static_cast<int>(_columns.size())) {
+        bool same = true;
+        for (int i = 0; i < count && same; i++) {
+          same = _columns.name(i) == sqlite3_column_name(_stmt, i);
+        }
+        if (same) {
+          return false;
+        }
+      }
+      _stale = true;
+      return true;
+    }
+
+    static Status schema_changed() {
+      return Status::status_ailment(
+          "the columns changed with the schema; prepare the statement again");
+    }
+
+    // points _values at the text of the current row
+    void load() {
+      auto count = static_cast<int>(_values.size());
+      for (int i = 0; i < count; i++) {
+        auto column = _query.getColumn(i);
+        if (column.isNull()) {
+          _values[i] = StringView();
+          continue;
+        }
+        // getText() must precede getBytes() so the size matches the text
+        auto t = column.getText();
+        _values[i] = StringView(t, column.getBytes());
+      }
+    }
+
+    // reads the column in its storage class; numbers are never formatted
+    static Value to_value(const SQLite::Column &column) {
+      switch (column.getType()) {
+        case SQLITE_INTEGER:
+          return Value::integer(column.getInt64());
+        case SQLITE_FLOAT:
+          return Value::real(column.getDouble());
+        case SQLITE_TEXT: {
+          auto t = column.getText();
+          return Value::text(t, column.getBytes());
+        }
+        case SQLITE_BLOB: {
+          auto b = column.getBlob();
+          return Value::blob(b, column.getBytes());
+        }
+        default:
+          return Value();
+      }
+    }
+
+    static ColumnarResult::Type to_columnar_type(int type) {
+      switch (type) {
+        case SQLITE_INTEGER:
+          return ColumnarResult::Type::kInteger;
+        case SQLITE_FLOAT:
+          return ColumnarResult::Type::kReal;
+        case SQLITE_BLOB:
+          return ColumnarResult::Type::kBlob;
+        default:
+          return ColumnarResult::Type::kText;
+      }
+    }
+
+    template <typename F>
+    Status guard(F fn) {
+      try {
+        fn();
+      } catch (const SQLite::Exception &e) {
+        return Status::status_ailment(e.what());
+      }
+      return Status::ok();
+    }
+  };
+
+  // walks a cached statement one row per next(); the statement returns to
+  // the cache once the cursor is closed
+  class StatementCursor : public Cursor {
+   public:
+    StatementCursor(Impl *impl, const std::string &sql,
+                    std::shared_ptr<Statement> statement)
+        : _impl(impl), _sql(sql), _statement(statement),
+          _row(statement->view()) {}
+
+    virtual ~StatementCursor() { close(); }
+
+    bool next() override {
+      if (_statement == nullptr) {
+        return false;
+      }
+
+      auto result = _statement->fetch();
+      if (_statement->stale()) {
+        // detected on the first step, before any row was returned
+        _statement.reset();
+        std::lock_guard<std::recursive_mutex> lock(_impl->_writer_mutex);
+        result = _impl->acquire(_sql, &_statement);
+        if (result.is_ok()) {
+          _row = _statement->view();
+          result = _statement->fetch();
+        }
+      }
+      if (result.is_ok()) {
+        return true;
+      }
+      if (!result.is_not_found()) {
+        _status = result;
+      }
+      close();
+      return false;
+    }
+
+    const RowView &row() const override { return _row; }
+
+    Status status() const override { return _status; }
+
+    void close() override {
+      if (_statement) {
+        _statement->rewind();
+        _statement.reset();
+      }
+    }
+
+   private:
+    Impl *_impl;
+    std::string _sql;
+    std::shared_ptr<Statement> _statement;
+    RowView _row;
+    Status _status = Status::ok();
+  };
+
+  class BulkAppender : public AppenderBase {
+   public:
+    BulkAppender(Impl *impl, std::shared_ptr<Schema> schema,
+                 const BulkInsertOptions &options)
+        : AppenderBase(schema, options), _impl(impl) {
+      _impl->_appenders.insert(this);
+    }
+
+    virtual ~BulkAppender() {
+      flush();
+      if (_impl) {
+        std::lock_guard<std::recursive_mutex> lock(_impl->_writer_mutex);
+        _impl->_appenders.erase(this);
+      }
+    }
+
+    // called by disconnect(): the statement is finalized so the database
+    // can be closed, and closing it rolls back the pending chunk
+    void detach() {
+      _statement.reset();
+      _pending = 0;
+      _impl = nullptr;
+    }
+
+    Status prepare() {
+      fmt::MemoryWriter buf;
+      buf << insert_prefix() << "(";
+      for (std::size_t i = 0; i < _columns.size(); i++) {
+        buf << ((0 < i) ? ", ?" : "?");
+      }
+      buf << ")";
+      return _impl->acquire(buf.str(), &_statement);
+    }
+
+    Status append(const Row &row) override {
+      if (_impl == nullptr) {
+        return Status::status_ailment("not connected");
+      }
+      auto result = check_row(row);
+      if (!result.is_ok()) {
+        return result;
+      }
+
+      if (_pending == 0) {
+        result = begin();
+        if (!result.is_ok()) {
+          return result;
+        }
+      }
+
+      result = bind_row(*_statement, row);
+      if (result.is_ok()) {
+        result = _statement->execute();
+      }
+      if (!result.is_ok()) {
+        rollback();
+        return result;
+      }
+
+      _pending += 1;
+      return (_pending < _options.chunk_size) ? Status::ok() : commit();
+    }
+
+    Status flush() override { return commit(); }
+
+   private:
+    Impl *_impl = nullptr;
+    std::shared_ptr<Statement> _statement;
+    std::size_t _pending = 0;
+    // false while running inside a transaction opened by the caller; each
+    // chunk is then a savepoint, so that a failed one leaves the caller's
+    // earlier writes in place
+    bool _owns_transaction = false;
+
+    Status begin() {
+      _owns_transaction = sqlite3_get_autocommit(_impl->_db->getHandle()) != 0;
+      return exec((_owns_transaction) ? "BEGIN" : "SAVEPOINT ookoto_chunk");
+    }
+
+    Status commit() {
+      if (_impl == nullptr) {
+        return Status::status_ailment("not connected");
+      }
+      if (_pending == 0) {
+        return Status::ok();
+      }
+
+      auto result =
+          exec((_owns_transaction) ? "COMMIT" : "RELEASE ookoto_chunk");
+      if (!result.is_ok()) {
+        rollback();
+        return result;
+      }
+
+      chunk_committed(_pending);
+      _pending = 0;
+      return result;
+    }
+
+    void rollback() {
+      if (_owns_transaction) {
+        exec("ROLLBACK");
+      } else {
+        // ROLLBACK TO keeps the savepoint open
+        exec("ROLLBACK TO ookoto_chunk; RELEASE ookoto_chunk");
+      }
+      _pending = 0;
+    }
+
+    Status exec(const char *sql) {
+      try {
+        _impl->_db->exec(sql);
+      } catch (const SQLite::Exception &e) {
+        return Status::status_ailment(e.what());
+      }
+      return Status::ok();
+    }
+  };
+
+  // copies the database on its own thread, pages_per_step pages at a time.
+  // The backup handle reads through the writer handle, so it is created,
+  // stepped and finished under the writer lock: writers wait for one step
+  // at most, and sqlite3 carries their changes into the copy.
+  class BackupJob : public BackupTask {
+   public:
+    BackupJob(Impl *impl, const std::string &path, const BackupOptions &options)
+        : _impl(impl), _path(path), _options(options) {}
+
+    virtual ~BackupJob() {
+      auto impl = _impl.load();
+      if (impl) {
+        impl->forget_backup(this);
+      }
+      cancel();
+      join();
+    }
+
+    void start() {
+      _thread = std::thread([this]() {
+        auto result = run();
+        std::lock_guard<std::mutex> lock(_mutex);
+        _status = result;
+        _done = true;
+        _finished.notify_all();
+      });
+    }
+
+    Status wait() override {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _finished.wait(lock, [this]() { return _done; });
+      return _status;
+    }
+
+    void cancel() override {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _cancelled = true;
+      _finished.notify_all();
+    }
+
+    bool done() const override {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _done;
+    }
+
+    BackupProgress progress() const override {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _progress;
+    }
+
+    // stops the copy before the connection goes away
+    void detach() {
+      cancel();
+      join();
+      _impl.store(nullptr);
+    }
+
+   private:
+    std::atomic<Impl *> _impl;
+    std::string _path;
+    BackupOptions _options;
+    std::thread _thread;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _finished;
+    bool _cancelled = false;
+    bool _done = false;
+    Status _status = Status::ok();
+    BackupProgress _progress;
+
+    void join() {
+      if (_thread.joinable()) {
+        _thread.join();
+      }
+    }
+
+    Status run() {
+      auto impl = _impl.load();
+      std::unique_ptr<SQLite::Database> destination;
+      std::unique_ptr<SQLite::Backup> backup;
+      Status result;
+      try {
+        destination.reset(new SQLite::Database(
+            _path, SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE));
+        result = copy(impl, *destination, &backup);
+      } catch (const SQLite::Exception &e) {
+        result = Status::status_ailment(e.what());
+      }
+
+      if (backup) {
+        std::lock_guard<std::recursive_mutex> lock(impl->_writer_mutex);
+        backup.reset();
+      }
+      return result;
+    }
+
+    Status copy(Impl *impl, SQLite::Database &destination,
+                std::unique_ptr<SQLite::Backup> *backup) {
+      auto pages = (0 < _options.pages_per_step) ? _options.pages_per_step : -1;
+      auto interval = std::chrono::microseconds(_options.step_interval);
+      while (true) {
+        int step;
+        BackupProgress progress;
+        {
+          std::lock_guard<std::recursive_mutex> lock(impl->_writer_mutex);
+          if (impl->_db == nullptr) {
+            return Status::status_ailment("not connected");
+          }
+          if (*backup == nullptr) {
+            backup->reset(new SQLite::Backup(destination, *impl->_db));
+          }
+          step = (*backup)->executeStep(pages);
+          progress.remaining = (*backup)->remainingPageCount();
+          progress.total = (*backup)->totalPageCount();
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _progress = progress;
+        }
+        if (_options.progress != nullptr) {
+          _options.progress(progress);
+        }
+        if (step == SQLITE_DONE) {
+          return Status::ok();
+        }
+
+        // a busy destination is retried after a short pause
+        auto pause = interval;
+        if ((step == SQLITE_BUSY || step == SQLITE_LOCKED) &&
+            pause < std::chrono::milliseconds(1)) {
+          pause = std::chrono::milliseconds(1);
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (_finished.wait_for(lock, pause, [this]() { return _cancelled; })) {
+          return Status::status_ailment("backup cancelled");
+        }
+      }
+    }
+  };
+
   Impl() = default;
-  virtual ~Impl() = default;
+
+  virtual ~Impl() { disconnect(); }
 
   bool exists_table(const std::string &table_name) const {
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
     return _db->tableExists(table_name);
   }
 
@@ -20,22 +731,126 @@ class SqliteConnection::Impl : public ConnectionImpl {
       return Status::invalid_argument();
     }
 
+    SqliteOptions options;
+    auto result = resolve_options(config.sqlite, &options);
+    if (!result.is_ok()) {
+      return result;
+    }
+
+    auto flags = (options.read_only)
+                     ? SQLITE_OPEN_READONLY
+                     : SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE;
+    if (options.no_mutex) {
+      flags |= SQLITE_OPEN_NOMUTEX;
+    }
+
+    // the connection is only kept once every setting has been applied
+    std::unique_ptr<SQLite::Database> db;
+    std::vector<std::unique_ptr<Reader>> readers;
+    SqliteOptions effective;
+    try {
+      db.reset(new SQLite::Database(config.database, flags));
+      configure(*db, options);
+      effective = inspect(*db, options);
+      if (0 < options.readers && effective.journal_mode != "WAL") {
+        return Status::invalid_argument(
+            "sqlite readers require journal_mode=WAL");
+      }
+      for (std::size_t i = 0; i < options.readers; i++) {
+        readers.emplace_back(open_reader(config, options));
+      }
+    } catch (const SQLite::Exception &e) {
+      return Status::status_ailment(e.what());
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    _db = std::move(db);
     _config = config;
-    _db.reset(new SQLite::Database(config.database,
-                                   SQLITE_OPEN_CREATE | SQLITE_OPEN_READWRITE));
+    _effective_options = effective;
+    _effective_options.group_commit_size = options.group_commit_size;
+    _effective_options.group_commit_window = options.group_commit_window;
+    if (config.result_cache) {
+      watch_writes(effective.journal_mode == "WAL");
+    }
+    _effective_options.readers = readers.size();
+    _statements.set_capacity(config.statement_cache_capacity);
+    {
+      std::lock_guard<std::mutex> readers_lock(_readers_mutex);
+      _readers = std::move(readers);
+      for (auto &reader : _readers) {
+        _idle_readers.push_back(reader.get());
+      }
+    }
     return Status::ok();
   }
 
   Status disconnect() {
+    // backups step under the writer lock, so they are stopped before it is
+    // taken
+    {
+      std::lock_guard<std::mutex> backups_lock(_backups_mutex);
+      for (auto job : _backups) {
+        job->detach();
+      }
+      _backups.clear();
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    for (auto appender : _appenders) {
+      appender->detach();
+    }
+    _appenders.clear();
+    {
+      // every reader must have been returned by now
+      std::lock_guard<std::mutex> readers_lock(_readers_mutex);
+      _idle_readers.clear();
+      _readers.clear();
+    }
+    // cached statements must be finalized before the database is closed
+    _statements.clear();
+    _dirty_tables.clear();
+    _wal = false;
+    _checkpoint_pages = 0;
     _config = {};
-    _db.release();
+    _effective_options = SqliteOptions();
+    _db.reset();
     return Status::ok();
   }
 
   Status execute_sql(const std::string &sql) {
-    fmt::print("SQL: {}\n", sql);
-    _db->exec(sql);
-    return Status::ok();
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    QueryLog log(_config.query_logger.get(), sql);
+    QueryProfile profile(_config.profiler.get(), sql);
+    try {
+      _db->exec(sql);
+    } catch (const SQLite::Exception &e) {
+      // a failed batch may still have written some of its statements; the
+      // exception still reaches the caller, as it always has
+      wrote(sql);
+      log.finish(profile.finish(Status::status_ailment(e.what())));
+      throw;
+    }
+    if (profile.claim_plan()) {
+      profile.set_plan(explain(_db->getHandle(), sql));
+    }
+
+    wrote(sql);
+    return log.finish(profile.finish(Status::ok()));
+  }
+
+  // the update hook misses DROP, ALTER and truncating DELETEs, so a
+  // statement that is not understood may have done any of them
+  void wrote(const std::string &sql) {
+    std::vector<std::string> tables;
+    if (_config.result_cache == nullptr) {
+      return;
+    }
+    if (!SqlTables::written(sql, &tables)) {
+      _config.result_cache->clear();
+    }
+    for (auto &table : tables) {
+      _config.result_cache->invalidate(table);
+    }
   }
 
   Status execute_sql_for_each(const std::string &sql,
@@ -44,41 +859,917 @@ class SqliteConnection::Impl : public ConnectionImpl {
       return Status::status_ailment();
     }
 
-    fmt::print("SQL: {}\n", sql);
-
-    bool loaded = false;
-    SQLite::Statement query(*_db, sql);
-    while (query.executeStep()) {
-      loaded = true;
+    return execute_sql_for_each(sql, [&](const RowView &view) {
       RowType row;
-      auto count = query.getColumnCount();
-      for (int i = 0; i < count; i++) {
-        auto column = query.getColumn(i);
-        auto t = column.getText();
-        std::string value = (t) ? t : "";
-        row.emplace(std::make_pair(column.getName(), value));
+      for (std::size_t i = 0; i < view.size(); i++) {
+        row.emplace(std::make_pair(view.name(i), view[i].to_string()));
       }
       fn(row);
+    });
+  }
+
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const RowView &)> &fn) {
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+
+    QueryLog log(_config.query_logger.get(), sql);
+    QueryProfile profile(_config.profiler.get(), sql);
+    auto timed = profile.wrap(fn);
+    auto status = read(sql, profile, [&](Statement &statement) {
+      return statement.execute_for_each(timed);
+    });
+    return log.finish(profile.finish(status));
+  }
+
+  Status execute_sql_for_each(
+      const std::string &sql,
+      const std::function<void(const ColumnReader &)> &fn) {
+    QueryLog log(_config.query_logger.get(), sql);
+    QueryProfile profile(_config.profiler.get(), sql);
+    auto timed = profile.wrap(fn);
+    auto status = read(sql, profile, [&](Statement &statement) {
+      return statement.read_each(timed);
+    });
+    return log.finish(profile.finish(status));
+  }
+
+  Status execute_sql_for_each(const std::string &sql,
+                              const std::function<void(const ValueRow &)> &fn) {
+    QueryLog log(_config.query_logger.get(), sql);
+    QueryProfile profile(_config.profiler.get(), sql);
+    auto timed = profile.wrap(fn);
+    auto status = read(sql, profile, [&](Statement &statement) {
+      return statement.read_values(timed);
+    });
+    return log.finish(profile.finish(status));
+  }
+
+  Status execute_sql_for_each_batch(
+      const std::string &sql, std::size_t batch_size,
+      const std::function<void(const RowBatch &)> &fn) {
+    if (batch_size == 0) {
+      return Status::invalid_argument();
+    }
+
+    QueryLog log(_config.query_logger.get(), sql);
+    QueryProfile profile(_config.profiler.get(), sql);
+    auto timed = profile.wrap(fn);
+    auto status = read(sql, profile, [&](Statement &statement) {
+      return statement.read_batches(batch_size, timed);
+    });
+    return log.finish(profile.finish(status));
+  }
+
+  Status execute_sql_columnar(const std::string &sql,
+                              ColumnarResult *result) {
+    if (result == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    QueryLog log(_config.query_logger.get(), sql);
+    QueryProfile profile(_config.profiler.get(), sql);
+    auto status = read(sql, profile, [&](Statement &statement) {
+      return statement.execute_columnar(result);
+    });
+    profile.add_rows(result->row_count());
+    return log.finish(profile.finish(status));
+  }
+
+  Status execute_sql_cached(const std::string &sql,
+                            const std::vector<Value> &params,
+                            const std::function<void(const RowView &)> &fn) {
+    if (fn == nullptr) {
+      return Status::status_ailment();
+    }
+
+    auto cache = _config.result_cache;
+    if (cache == nullptr) {
+      QueryLog log(_config.query_logger.get(), sql);
+      QueryProfile profile(_config.profiler.get(), sql);
+      auto timed = profile.wrap(fn);
+      auto status = read(sql, profile, [&](Statement &statement) {
+        auto result = bind_params(statement, params);
+        return (result.is_ok()) ? statement.execute_for_each(timed) : result;
+      });
+      return log.finish(profile.finish(status));
+    }
+
+    CachedQuery query(*cache, sql, params);
+    Status result;
+    if (query.replay(fn, &result)) {
+      return result;
+    }
+
+    std::vector<std::string> tables;
+    if (!query.dependencies(&tables)) {
+      result = dependencies(sql, &tables);
+      if (!result.is_ok()) {
+        return result;
+      }
+      query.set_dependencies(tables);
+    }
+
+    QueryLog log(_config.query_logger.get(), sql);
+    QueryProfile profile(_config.profiler.get(), sql);
+    bool in_transaction = false;
+    auto record = query.record(fn);
+    auto timed = profile.wrap(record);
+    result = read(sql, profile, [&](Statement &statement) {
+      in_transaction = statement.in_transaction();
+      auto result = bind_params(statement, params);
+      return (result.is_ok()) ? statement.execute_for_each(timed) : result;
+    });
+    if (!in_transaction) {
+      query.store(result, tables);
+    }
+    return log.finish(profile.finish(result));
+  }
+
+  Status parallel_for_each(
+      const std::string &table, const std::string &predicate,
+      const std::function<void(std::size_t, const RowView &)> &fn,
+      std::size_t partitions, const std::function<void(std::size_t)> &merge) {
+    if (table.empty() || fn == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    bool empty = true;
+    int64_t first = 0;
+    int64_t last = 0;
+    auto bounds = fmt::format("SELECT min(rowid), max(rowid) FROM {}", table);
+    auto result = read(bounds, [&](Statement &statement) {
+      return statement.read_each([&](const ColumnReader &reader) {
+        if (!reader.is_null(0)) {
+          empty = false;
+          first = reader.get_int64(0);
+          last = reader.get_int64(1);
+        }
+      });
+    });
+    if (!result.is_ok()) {
+      return result;
+    }
+
+    auto sql = fmt::format("SELECT * FROM {} WHERE rowid BETWEEN ? AND ?", table);
+    if (!predicate.empty()) {
+      sql += fmt::format(" AND ({})", predicate);
+    }
+    QueryLog log(_config.query_logger.get(), sql);
+    if (empty) {
+      return log.finish(Status::ok());
+    }
+
+    if (partitions == 0) {
+      partitions = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // unsigned arithmetic keeps the widest rowid span from overflowing
+    auto width = static_cast<uint64_t>(last) - static_cast<uint64_t>(first);
+    if (width < partitions - 1) {
+      partitions = static_cast<std::size_t>(width) + 1;
+    }
+    auto step = width / partitions + 1;
+
+    auto config = _config;
+    auto options = _effective_options;
+    std::vector<Status> results(partitions);
+    // an exception from fn is carried back to the calling thread
+    std::vector<std::exception_ptr> errors(partitions);
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < partitions; i++) {
+      auto offset = i * step;
+      if (width < offset) {
+        break;
+      }
+      auto lo = static_cast<int64_t>(static_cast<uint64_t>(first) + offset);
+      auto hi = (width - offset < step)
+                    ? last
+                    : static_cast<int64_t>(static_cast<uint64_t>(lo) + step - 1);
+      workers.emplace_back([&, i, lo, hi]() {
+        try {
+          results[i] = scan_range(config, options, sql, lo, hi,
+                                  [&](const RowView &row) { fn(i, row); });
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+    for (auto &error : errors) {
+      if (error != nullptr) {
+        std::rethrow_exception(error);
+      }
+    }
+
+    for (auto &partition : results) {
+      if (!partition.is_ok() && !partition.is_not_found()) {
+        return log.finish(partition);
+      }
+    }
+    if (merge != nullptr) {
+      for (std::size_t i = 0; i < workers.size(); i++) {
+        merge(i);
+      }
+    }
+    return log.finish(Status::ok());
+  }
+
+  Status backup_to(const std::string &path, const BackupOptions &options,
+                   std::unique_ptr<BackupTask> *task) {
+    if (path.empty() || task == nullptr) {
+      return Status::invalid_argument();
+    }
+    {
+      std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+      if (_db == nullptr) {
+        return Status::status_ailment("not connected");
+      }
+    }
+
+    std::unique_ptr<BackupJob> job(new BackupJob(this, path, options));
+    {
+      std::lock_guard<std::mutex> lock(_backups_mutex);
+      _backups.insert(job.get());
+    }
+    job->start();
+    task->reset(job.release());
+    return Status::ok();
+  }
+
+  void forget_backup(BackupJob *job) {
+    std::lock_guard<std::mutex> lock(_backups_mutex);
+    _backups.erase(job);
+  }
+
+  Status query(const std::string &sql, std::unique_ptr<Cursor> *cursor) {
+    if (cursor == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    QueryLog log(_config.query_logger.get(), sql);
+
+    std::shared_ptr<Statement> statement;
+    auto result = acquire(sql, &statement);
+    if (result.is_ok()) {
+      cursor->reset(new StatementCursor(this, sql, statement));
+    }
+    return log.finish(result);
+  }
+
+  Status prepare(const std::string &sql,
+                 std::shared_ptr<PreparedStatement> *statement) {
+    if (statement == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    std::shared_ptr<Statement> prepared;
+    auto result = acquire(sql, &prepared);
+    if (result.is_ok()) {
+      *statement = prepared;
+    }
+    return result;
+  }
+
+  StatementCacheStats statement_cache_stats() const {
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    return _statements.stats();
+  }
+
+  Status create_appender(std::shared_ptr<Schema> schema,
+                         const BulkInsertOptions &options,
+                         std::unique_ptr<Appender> *appender) override {
+    if (schema == nullptr || appender == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    std::unique_ptr<BulkAppender> bulk(new BulkAppender(this, schema, options));
+    auto result = bulk->prepare();
+    if (result.is_ok()) {
+      appender->reset(bulk.release());
     }
+    return result;
+  }
 
-    return (loaded) ? Status::ok() : Status::not_found();
+  Status bulk_insert(std::shared_ptr<Schema> schema,
+                     const std::vector<Appender::Row> &rows,
+                     const BulkInsertOptions &options, BulkInsertStats *stats) {
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    return ConnectionImpl::bulk_insert(schema, rows, options, stats);
   }
 
   Status transaction(const std::function<Status()> &t) {
     if (t == nullptr) return Status::invalid_argument();
 
+    // a nested call stays on the plain path of the enclosing transaction
+    if (1 < _effective_options.group_commit_size &&
+        _transaction_owner.load() != std::this_thread::get_id()) {
+      return group_transaction(t);
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    // reads issued by t must see its own uncommitted writes
+    TransactionOwner owner(_transaction_owner);
+
     SQLite::Transaction transaction(*_db);
     auto status = t();
     if (status.is_ok()) transaction.commit();
 
-    return Status::ok();
+    return status;
+  }
+
+  int64_t last_row_id() const {
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    return _db->getLastInsertRowid();
   }
 
-  int64_t last_row_id() const { return _db->getLastInsertRowid(); }
+  const SqliteOptions &effective_options() const { return _effective_options; }
 
  private:
+  // a read-only handle with its own statement cache; used by one thread at
+  // a time between lease_reader and return_reader
+  struct Reader {
+    std::unique_ptr<SQLite::Database> db;
+    StatementCache<Statement> statements;
+  };
+
+  class TransactionOwner {
+   public:
+    explicit TransactionOwner(std::atomic<std::thread::id> &owner)
+        : _owner(owner), _previous(owner.load()) {
+      _owner.store(std::this_thread::get_id());
+    }
+    ~TransactionOwner() { _owner.store(_previous); }
+
+   private:
+    std::atomic<std::thread::id> &_owner;
+    std::thread::id _previous;
+  };
+
   std::unique_ptr<SQLite::Database> _db;
   Config _config;
+  SqliteOptions _effective_options;
+  StatementCache<Statement> _statements;
+
+  // serializes every use of the writer handle; recursive because
+  // transaction() and bulk_insert() call back into execute_sql()
+  mutable std::recursive_mutex _writer_mutex;
+  std::atomic<std::thread::id> _transaction_owner{std::thread::id()};
+
+  // running backups, stopped by disconnect
+  std::mutex _backups_mutex;
+  std::set<BackupJob *> _backups;
+  // the live appenders, guarded by _writer_mutex
+  std::set<BulkAppender *> _appenders;
+
+  std::mutex _readers_mutex;
+  std::condition_variable _reader_available;
+  std::vector<std::unique_ptr<Reader>> _readers;
+  std::vector<Reader *> _idle_readers;
+  // the threads holding a reader, once per reader they hold
+  std::vector<std::thread::id> _lessees;
+
+  // a transaction() call waiting for, or running in, a group commit
+  struct GroupRequest {
+    const std::function<Status()> *t = nullptr;
+    Status status = Status::ok();
+    std::exception_ptr error;
+    bool done = false;
+  };
+
+  std::mutex _group_mutex;
+  std::condition_variable _group_full;
+  std::condition_variable _group_done;
+  std::deque<GroupRequest *> _group_queue;
+  bool _group_leading = false;
+
+  // queues t and waits until it has been committed. The first waiting
+  // thread becomes the leader: it takes up to group_commit_size queued
+  // requests, commits them together and wakes their callers, while new
+  // requests queue up for the next leader.
+  Status group_transaction(const std::function<Status()> &t) {
+    auto size = _effective_options.group_commit_size;
+    auto window =
+        std::chrono::microseconds(_effective_options.group_commit_window);
+
+    GroupRequest request;
+    request.t = &t;
+
+    std::unique_lock<std::mutex> lock(_group_mutex);
+    _group_queue.push_back(&request);
+    if (size <= _group_queue.size()) {
+      _group_full.notify_one();
+    }
+
+    while (true) {
+      _group_done.wait(lock, [&]() { return request.done || !_group_leading; });
+      if (request.done) {
+        break;
+      }
+
+      _group_leading = true;
+      if (0 < window.count()) {
+        _group_full.wait_for(lock, window,
+                             [&]() { return size <= _group_queue.size(); });
+      }
+      auto end = _group_queue.begin() +
+                 std::min<std::ptrdiff_t>(size, _group_queue.size());
+      std::vector<GroupRequest *> group(_group_queue.begin(), end);
+      _group_queue.erase(_group_queue.begin(), end);
+
+      lock.unlock();
+      commit_group(group);
+      lock.lock();
+
+      for (auto one : group) {
+        one->done = true;
+      }
+      _group_leading = false;
+      _group_done.notify_all();
+    }
+    lock.unlock();
+
+    if (request.error) {
+      std::rethrow_exception(request.error);
+    }
+    return request.status;
+  }
+
+  // runs the group in one transaction, each request under its own savepoint
+  // so that a failure rolls back only that request. When the transaction
+  // itself fails, every request reports the failure.
+  void commit_group(const std::vector<GroupRequest *> &group) {
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    TransactionOwner owner(_transaction_owner);
+
+    auto result = exec("BEGIN");
+    for (auto request : group) {
+      if (result.is_ok()) {
+        result = exec("SAVEPOINT ookoto_group");
+      }
+      if (!result.is_ok()) {
+        break;
+      }
+
+      try {
+        request->status = (*request->t)();
+      } catch (...) {
+        request->error = std::current_exception();
+      }
+      if (!request->status.is_ok() || request->error) {
+        result = exec("ROLLBACK TO ookoto_group");
+      }
+      if (result.is_ok()) {
+        result = exec("RELEASE ookoto_group");
+      }
+    }
+    if (result.is_ok()) {
+      result = exec("COMMIT");
+    }
+    if (result.is_ok()) {
+      return;
+    }
+
+    exec("ROLLBACK");
+    for (auto request : group) {
+      if (request->status.is_ok() && !request->error) {
+        request->status = result;
+      }
+    }
+  }
+
+  Status exec(const char *sql) {
+    try {
+      _db->exec(sql);
+    } catch (const SQLite::Exception &e) {
+      return Status::status_ailment(e.what());
+    }
+    return Status::ok();
+  }
+
+  // tables written by the open transaction of the writer, invalidated again
+  // once it commits; readers may cache the old rows until then
+  std::set<std::string> _dirty_tables;
+  bool _wal = false;
+  int _checkpoint_pages = 0;
+
+  // invalidates the result cache on every row change of the writer. In WAL
+  // mode readers run alongside, so the tables are invalidated once more
+  // after the commit; the WAL hook replaces the built-in auto-checkpoint,
+  // which is carried on in on_commit.
+  void watch_writes(bool wal) {
+    auto handle = _db->getHandle();
+    sqlite3_update_hook(handle, &Impl::on_update, this);
+    _wal = wal;
+    if (wal) {
+      _checkpoint_pages = std::atoi(pragma(*_db, "wal_autocheckpoint").c_str());
+      sqlite3_wal_hook(handle, &Impl::on_commit, this);
+    }
+  }
+
+  static void on_update(void *data, int, const char *, const char *table,
+                        sqlite3_int64) {
+    auto impl = static_cast<Impl *>(data);
+    if (impl->_config.result_cache) {
+      impl->_config.result_cache->invalidate(table);
+      if (impl->_wal) {
+        impl->_dirty_tables.insert(table);
+      }
+    }
+  }
+
+  static int on_commit(void *data, sqlite3 *db, const char *name, int pages) {
+    auto impl = static_cast<Impl *>(data);
+    if (impl->_config.result_cache) {
+      for (auto &table : impl->_dirty_tables) {
+        impl->_config.result_cache->invalidate(table);
+      }
+    }
+    impl->_dirty_tables.clear();
+
+    if (0 < impl->_checkpoint_pages && impl->_checkpoint_pages <= pages) {
+      sqlite3_wal_checkpoint(db, name);
+    }
+    return SQLITE_OK;
+  }
+
+  // the tables sql reads, as reported to the authorizer while compiling it.
+  // Views report their base tables, and count(*) reports its table with an
+  // empty column name.
+  Status dependencies(const std::string &sql,
+                      std::vector<std::string> *tables) {
+    std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+    auto handle = _db->getHandle();
+    std::set<std::string> names;
+    sqlite3_set_authorizer(handle, &Impl::authorize, &names);
+    sqlite3_stmt *stmt = nullptr;
+    auto rc = sqlite3_prepare_v2(handle, sql.c_str(), -1, &stmt, nullptr);
+    sqlite3_finalize(stmt);
+    sqlite3_set_authorizer(handle, nullptr, nullptr);
+    if (rc != SQLITE_OK) {
+      return Status::status_ailment(sqlite3_errmsg(handle));
+    }
+
+    tables->clear();
+    for (auto &name : names) {
+      tables->push_back(SqlTables::normalize(name));
+    }
+    return Status::ok();
+  }
+
+  static int authorize(void *data, int action, const char *table,
+                       const char *, const char *, const char *) {
+    if (action == SQLITE_READ && table != nullptr) {
+      static_cast<std::set<std::string> *>(data)->insert(table);
+    }
+    return SQLITE_OK;
+  }
+
+  static std::unique_ptr<Reader> open_reader(const Config &config,
+                                             const SqliteOptions &options) {
+    std::unique_ptr<Reader> reader(new Reader);
+    reader->db.reset(new SQLite::Database(
+        config.database, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX));
+
+    // journal_mode, synchronous and page_size belong to the writer
+    SqliteOptions read_options;
+    read_options.cache_size = options.cache_size;
+    read_options.mmap_size = options.mmap_size;
+    read_options.temp_store = options.temp_store;
+    read_options.busy_timeout = options.busy_timeout;
+    configure(*reader->db, read_options);
+
+    reader->statements.set_capacity(config.statement_cache_capacity);
+    return reader;
+  }
+
+  // runs fn on a statement compiled on an idle reader. The writer is used
+  // when there are no readers, when the calling thread is inside
+  // transaction() and has to see its own writes, or when it reads again
+  // from inside a read and no other reader is idle.
+  Status read(const std::string &sql,
+              const std::function<Status(Statement &)> &fn) {
+    Reader *reader = nullptr;
+    if (!_readers.empty() &&
+        _transaction_owner.load() != std::this_thread::get_id()) {
+      reader = lease_reader();
+    }
+    if (reader == nullptr) {
+      std::lock_guard<std::recursive_mutex> lock(_writer_mutex);
+      return run(*_db, _statements, sql, fn);
+    }
+
+    ReaderLease lease(this, reader);
+    return read_on(reader, sql, fn);
+  }
+
+  Status read_on(Reader *reader, const std::string &sql,
+                 const std::function<Status(Statement &)> &fn) {
+    return run(*reader->db, reader->statements, sql, fn);
+  }
+
+  // runs fn on the cached statement of sql, and once more on a new one when
+  // the first turned out stale before it returned a row
+  static Status run(SQLite::Database &db,
+                    StatementCache<Statement> &statements,
+                    const std::string &sql,
+                    const std::function<Status(Statement &)> &fn) {
+    std::shared_ptr<Statement> statement;
+    auto result = acquire(db, statements, sql, &statement);
+    if (!result.is_ok()) {
+      return result;
+    }
+    result = fn(*statement);
+    if (!statement->stale()) {
+      return result;
+    }
+
+    statement.reset();
+    result = acquire(db, statements, sql, &statement);
+    return (result.is_ok()) ? fn(*statement) : result;
+  }
+
+  // read() for a profiled statement: reports the counters of the statement
+  // and, when it was slow, explains it on the same handle
+  Status read(const std::string &sql, QueryProfile &profile,
+              const std::function<Status(Statement &)> &fn) {
+    if (!profile.enabled()) {
+      return read(sql, fn);
+    }
+
+    return read(sql, [&](Statement &statement) {
+      // drops what executions outside the profiler left behind
+      statement.counters();
+      auto result = fn(statement);
+      profile.set_counters(statement.counters());
+      if (profile.claim_plan()) {
+        profile.set_plan(explain(statement.handle(), sql));
+      }
+      return result;
+    });
+  }
+
+  // the EXPLAIN QUERY PLAN of sql, one step per line indented by depth;
+  // empty when sql cannot be explained
+  static std::string explain(sqlite3 *handle, const std::string &sql) {
+    auto query = "EXPLAIN QUERY PLAN " + sql;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(handle, query.c_str(), -1, &stmt, nullptr) !=
+        SQLITE_OK) {
+      sqlite3_finalize(stmt);
+      return std::string();
+    }
+
+    fmt::MemoryWriter plan;
+    std::map<int, int> depths;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      auto id = sqlite3_column_int(stmt, 0);
+      auto parent = depths.find(sqlite3_column_int(stmt, 1));
+      auto depth = (parent == depths.end()) ? 0 : parent->second + 1;
+      depths[id] = depth;
+
+      auto detail = sqlite3_column_text(stmt, 3);
+      plan << std::string(depth * 2, ' ')
+           << ((detail) ? reinterpret_cast<const char *>(detail) : "") << '\n';
+    }
+    sqlite3_finalize(stmt);
+    return plan.str();
+  }
+
+  // scans one rowid range on a handle of its own
+  static Status scan_range(const Config &config, const SqliteOptions &options,
+                           const std::string &sql, int64_t lo, int64_t hi,
+                           const std::function<void(const RowView &)> &fn) {
+    try {
+      auto reader = open_reader(config, options);
+      Statement statement(*reader->db, sql);
+      statement.bind(1, lo);
+      statement.bind(2, hi);
+      return statement.execute_for_each(fn);
+    } catch (const SQLite::Exception &e) {
+      return Status::status_ailment(e.what());
+    }
+  }
+
+  // an idle reader; nullptr instead of waiting when the calling thread
+  // already holds one, since the readers it waits for may all be its own
+  Reader *lease_reader() {
+    auto self = std::this_thread::get_id();
+    std::unique_lock<std::mutex> lock(_readers_mutex);
+    auto nested = std::find(_lessees.begin(), _lessees.end(), self) !=
+                  _lessees.end();
+    if (nested && _idle_readers.empty()) {
+      return nullptr;
+    }
+    _reader_available.wait(lock, [&]() { return !_idle_readers.empty(); });
+    auto reader = _idle_readers.back();
+    _idle_readers.pop_back();
+    _lessees.push_back(self);
+    return reader;
+  }
+
+  void return_reader(Reader *reader) {
+    {
+      std::lock_guard<std::mutex> lock(_readers_mutex);
+      _idle_readers.push_back(reader);
+      _lessees.erase(std::find(_lessees.begin(), _lessees.end(),
+                               std::this_thread::get_id()));
+    }
+    _reader_available.notify_one();
+  }
+
+  // returns a leased reader on scope exit, also when fn throws
+  class ReaderLease {
+   public:
+    ReaderLease(Impl *impl, Reader *reader) : _impl(impl), _reader(reader) {}
+    ~ReaderLease() { _impl->return_reader(_reader); }
+
+   private:
+    Impl *_impl;
+    Reader *_reader;
+  };
+
+  static bool load_profile(const std::string &name, SqliteOptions *options) {
+    if (name == "durable") {
+      options->journal_mode = "WAL";
+      options->synchronous = "FULL";
+      options->busy_timeout = 5000;
+    } else if (name == "balanced") {
+      options->journal_mode = "WAL";
+      options->synchronous = "NORMAL";
+      options->cache_size = -64 * 1024;
+      options->mmap_size = 256LL * 1024 * 1024;
+      options->temp_store = "MEMORY";
+      options->busy_timeout = 5000;
+    } else if (name == "bulk-load") {
+      // the journal stays in memory so ROLLBACK keeps working
+      options->journal_mode = "MEMORY";
+      options->synchronous = "OFF";
+      options->cache_size = -256 * 1024;
+      options->page_size = 32 * 1024;
+      options->temp_store = "MEMORY";
+    } else if (name == "read-only-mmap") {
+      options->cache_size = -64 * 1024;
+      options->mmap_size = 1024LL * 1024 * 1024;
+      options->temp_store = "MEMORY";
+      options->read_only = true;
+      options->no_mutex = true;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  // merges the explicit settings over the profile
+  static Status resolve_options(const SqliteOptions &requested,
+                                SqliteOptions *options) {
+    *options = SqliteOptions();
+    if (!requested.profile.empty() &&
+        !load_profile(requested.profile, options)) {
+      return Status::invalid_argument(
+          fmt::format("unknown sqlite profile: {}", requested.profile));
+    }
+    options->profile = requested.profile;
+
+    auto merge_text = [](const std::string &value, std::string *target) {
+      if (!value.empty()) {
+        *target = value;
+      }
+      return is_keyword(*target);
+    };
+    auto merge_integer = [](int64_t value, int64_t *target) {
+      if (value != SqliteOptions::kDefault) {
+        *target = value;
+      }
+    };
+
+    // keywords are spliced into the PRAGMA statements
+    if (!merge_text(requested.journal_mode, &options->journal_mode) ||
+        !merge_text(requested.synchronous, &options->synchronous) ||
+        !merge_text(requested.temp_store, &options->temp_store)) {
+      return Status::invalid_argument("invalid sqlite pragma value");
+    }
+    merge_integer(requested.cache_size, &options->cache_size);
+    merge_integer(requested.mmap_size, &options->mmap_size);
+    merge_integer(requested.page_size, &options->page_size);
+    merge_integer(requested.busy_timeout, &options->busy_timeout);
+    if (0 < requested.readers) {
+      options->readers = requested.readers;
+    }
+    options->group_commit_size = requested.group_commit_size;
+    options->group_commit_window = requested.group_commit_window;
+    if (0 < options->readers && options->journal_mode.empty()) {
+      options->journal_mode = "WAL";
+    }
+    options->read_only = options->read_only || requested.read_only;
+    options->no_mutex = options->no_mutex || requested.no_mutex;
+    return Status::ok();
+  }
+
+  static bool is_keyword(const std::string &value) {
+    for (auto c : value) {
+      if (!std::isalpha(static_cast<unsigned char>(c))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // page_size goes first since journal_mode=WAL fixes the page size
+  static void configure(SQLite::Database &db, const SqliteOptions &options) {
+    auto set = [&](const char *name, const std::string &value) {
+      if (!value.empty()) {
+        db.exec(fmt::format("PRAGMA {} = {}", name, value));
+      }
+    };
+    auto set_integer = [&](const char *name, int64_t value) {
+      if (value != SqliteOptions::kDefault) {
+        db.exec(fmt::format("PRAGMA {} = {}", name, value));
+      }
+    };
+
+    set_integer("page_size", options.page_size);
+    set("journal_mode", options.journal_mode);
+    set("synchronous", options.synchronous);
+    set_integer("cache_size", options.cache_size);
+    set_integer("mmap_size", options.mmap_size);
+    set("temp_store", options.temp_store);
+    if (options.busy_timeout != SqliteOptions::kDefault) {
+      db.setBusyTimeout(static_cast<int>(options.busy_timeout));
+    }
+  }
+
+  // reads back the values sqlite3 actually accepted
+  static SqliteOptions inspect(SQLite::Database &db,
+                               const SqliteOptions &options) {
+    static const char *kSynchronous[] = {"OFF", "NORMAL", "FULL", "EXTRA"};
+    static const char *kTempStore[] = {"DEFAULT", "FILE", "MEMORY"};
+
+    SqliteOptions effective;
+    effective.profile = options.profile;
+    effective.journal_mode = pragma(db, "journal_mode");
+    for (auto &c : effective.journal_mode) {
+      c = std::toupper(static_cast<unsigned char>(c));
+    }
+    auto synchronous = std::atoi(pragma(db, "synchronous").c_str());
+    if (0 <= synchronous && synchronous < 4) {
+      effective.synchronous = kSynchronous[synchronous];
+    }
+    auto temp_store = std::atoi(pragma(db, "temp_store").c_str());
+    if (0 <= temp_store && temp_store < 3) {
+      effective.temp_store = kTempStore[temp_store];
+    }
+    effective.cache_size = std::atoll(pragma(db, "cache_size").c_str());
+    effective.mmap_size = std::atoll(pragma(db, "mmap_size").c_str());
+    effective.page_size = std::atoll(pragma(db, "page_size").c_str());
+    effective.busy_timeout = std::atoll(pragma(db, "busy_timeout").c_str());
+    effective.read_only = sqlite3_db_readonly(db.getHandle(), "main") == 1;
+    effective.no_mutex = sqlite3_db_mutex(db.getHandle()) == nullptr;
+    return effective;
+  }
+
+  // some pragmas return no row when the feature is compiled out
+  static std::string pragma(SQLite::Database &db, const char *name) {
+    SQLite::Statement query(db, fmt::format("PRAGMA {}", name));
+    if (!query.executeStep() || query.isColumnNull(0)) {
+      return std::string();
+    }
+    return query.getColumn(0).getText();
+  }
+
+  Status acquire(const std::string &sql, std::shared_ptr<Statement> *statement) {
+    return acquire(*_db, _statements, sql, statement);
+  }
+
+  static Status acquire(SQLite::Database &db,
+                        StatementCache<Statement> &statements,
+                        const std::string &sql,
+                        std::shared_ptr<Statement> *statement) {
+    auto cached = statements.acquire(sql);
+    if (cached && cached->stale()) {
+      statements.erase(sql);
+      cached.reset();
+    }
+    if (cached) {
+      *statement = cached;
+      return cached->clear_bindings();
+    }
+
+    try {
+      cached = std::make_shared<Statement>(db, sql);
+    } catch (const SQLite::Exception &e) {
+      return Status::status_ailment(e.what());
+    }
+
+    statements.insert(sql, cached);
+    *statement = cached;
+    return Status::ok();
+  }
 
   std::string column_type_to_string(Schema::Type type) {
     static std::map<Schema::Type, std::string> mapping = {
@@ -96,6 +1787,37 @@ class SqliteConnection::Impl : public ConnectionImpl {
     return mapping[type];
   }
 
+  std::string table_options_to_string(const Schema &schema) {
+    return (schema.without_rowid()) ? "WITHOUT ROWID" : "";
+  }
+
+  Status build_indexes(std::shared_ptr<Schema> schema, bool deferred) {
+    // IF NOT EXISTS lets create_indexes run again after a later load
+    std::vector<std::string> statements;
+    schema->each_index([&](const Schema::Index &index) {
+      if (index.deferred() != deferred) {
+        return;
+      }
+
+      fmt::MemoryWriter buf;
+      buf << "CREATE " << ((index.unique()) ? "UNIQUE " : "")
+          << "INDEX IF NOT EXISTS " << index.name() << " ON "
+          << schema->table_name() << " (" << index_columns(index) << ")";
+      if (!index.where().empty()) {
+        buf << " WHERE " << index.where();
+      }
+      statements.emplace_back(buf.str());
+    });
+
+    for (auto &sql : statements) {
+      auto result = execute_sql(sql);
+      if (!result.is_ok()) {
+        return result;
+      }
+    }
+    return Status::ok();
+  }
+
   std::string column_prop_to_string(Schema::PropertyPtr prop) {
     std::vector<std::string> results;
     if (prop->not_null()) {
@@ -127,12 +1849,18 @@ class SqliteConnection::Impl : public ConnectionImpl {
 
 SqliteConnection::SqliteConnection() { _impl.reset(new Impl); }
 
+SqliteConnection::~SqliteConnection() = default;
+
 bool SqliteConnection::exists_table(const std::string &table_name) const {
   return _impl->exists_table(table_name);
 }
 
 int64_t SqliteConnection::last_row_id() const { return _impl->last_row_id(); }
 
+SqliteOptions SqliteConnection::effective_options() const {
+  return _impl->effective_options();
+}
+
 Status SqliteConnection::connect(const Config &config) {
   auto result = _impl->connect(config);
   if (result.is_ok()) {
@@ -153,6 +1881,10 @@ Status SqliteConnection::create_table(std::shared_ptr<Schema> schema) {
   return _impl->create_table(schema);
 }
 
+Status SqliteConnection::create_indexes(std::shared_ptr<Schema> schema) {
+  return _impl->create_indexes(schema);
+}
+
 Status SqliteConnection::drop_table(const std::string &table_name) {
   return _impl->drop_table(table_name);
 }
@@ -170,4 +1902,79 @@ Status SqliteConnection::execute_sql_for_each(
   return _impl->execute_sql_for_each(sql, fn);
 }
 
+Status SqliteConnection::execute_sql_for_each(
+    const std::string &sql, const std::function<void(const RowView &)> &fn) {
+  return _impl->execute_sql_for_each(sql, fn);
+}
+
+Status SqliteConnection::execute_sql_for_each(
+    const std::string &sql,
+    const std::function<void(const ColumnReader &)> &fn) {
+  return _impl->execute_sql_for_each(sql, fn);
+}
+
+Status SqliteConnection::execute_sql_for_each(
+    const std::string &sql, const std::function<void(const ValueRow &)> &fn) {
+  return _impl->execute_sql_for_each(sql, fn);
+}
+
+Status SqliteConnection::execute_sql_for_each_batch(
+    const std::string &sql, std::size_t batch_size,
+    const std::function<void(const RowBatch &)> &fn) {
+  return _impl->execute_sql_for_each_batch(sql, batch_size, fn);
+}
+
+Status SqliteConnection::execute_sql_columnar(const std::string &sql,
+                                              ColumnarResult *result) {
+  return _impl->execute_sql_columnar(sql, result);
+}
+
+Status SqliteConnection::execute_sql_cached(
+    const std::string &sql, const std::vector<Value> &params,
+    const std::function<void(const RowView &)> &fn) {
+  return _impl->execute_sql_cached(sql, params, fn);
+}
+
+Status SqliteConnection::parallel_for_each(
+    const std::string &table, const std::string &predicate,
+    const std::function<void(std::size_t partition, const RowView &row)> &fn,
+    std::size_t partitions,
+    const std::function<void(std::size_t partition)> &merge) {
+  return _impl->parallel_for_each(table, predicate, fn, partitions, merge);
+}
+
+Status SqliteConnection::backup_to(const std::string &path,
+                                   const BackupOptions &options,
+                                   std::unique_ptr<BackupTask> *task) {
+  return _impl->backup_to(path, options, task);
+}
+
+Status SqliteConnection::query(const std::string &sql,
+                               std::unique_ptr<Cursor> *cursor,
+                               const CursorOptions &) {
+  return _impl->query(sql, cursor);
+}
+
+Status SqliteConnection::prepare(
+    const std::string &sql, std::shared_ptr<PreparedStatement> *statement) {
+  return _impl->prepare(sql, statement);
+}
+
+StatementCacheStats SqliteConnection::statement_cache_stats() const {
+  return _impl->statement_cache_stats();
+}
+
+Status SqliteConnection::create_appender(std::shared_ptr<Schema> schema,
+                                         const BulkInsertOptions &options,
+                                         std::unique_ptr<Appender> *appender) {
+  return _impl->create_appender(schema, options, appender);
+}
+
+Status SqliteConnection::bulk_insert(std::shared_ptr<Schema> schema,
+                                     const std::vector<Appender::Row> &rows,
+                                     const BulkInsertOptions &options,
+                                     BulkInsertStats *stats) {
+  return _impl->bulk_insert(schema, rows, options, stats);
+}
+
 }  // ookoto
@@ -0,0 +1,24 @@
+#include <ookoto/ookoto.h>
+
+namespace ookoto {
+
+Status::Status() = default;
+
+Status::Status(Code code, const std::string &msg)
+    : _code(code), _message(msg) {}
+
+Status Status::ok(const std::string &msg) { return Status(kOk, msg); }
+
+Status Status::not_found(const std::string &msg) {
+  return Status(kNotFound, msg);
+}
+
+Status Status::invalid_argument(const std::string &msg) {
+  return Status(kInvalidArgument, msg);
+}
+
+Status Status::status_ailment(const std::string &msg) {
+  return Status(kStatusAilment, msg);
+}
+
+}  // ookoto
@@ -0,0 +1,220 @@
+#include <cppformat/format.h>
+#include <ookoto/ookoto.h>
+#include <memory>
+#include "ConnectionImpl.h"
+
+namespace ookoto {
+
+// The statements are prepared once and bound by column position. Values are
+// converted with the same rules as the appenders use.
+class Table::Impl {
+ public:
+  using Column = AppenderBase::Column;
+
+  Impl(ConnectionInterface *connection, std::shared_ptr<Schema> schema)
+      : _connection(connection), _schema(schema) {}
+
+  Status open() {
+    if (_connection == nullptr || _schema == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    _insertable.clear();
+    _keys.clear();
+    _values.clear();
+    std::vector<std::string> names;
+    _schema->each_define([&](const Schema::ColumnType &def) {
+      Column column = {std::get<Schema::kColumnName>(def),
+                       std::get<Schema::kColumnType>(def)};
+      auto &prop = std::get<Schema::kColumnProperties>(def);
+      names.push_back(column.name);
+      if (!prop->auto_increment()) {
+        _insertable.push_back(column);
+      }
+      if (prop->primary_key()) {
+        _keys.push_back(column);
+      } else {
+        _values.push_back(column);
+      }
+    });
+
+    auto table = _schema->table_name();
+    auto result = _connection->prepare(insert_sql(table), &_insert);
+    if (!result.is_ok() || _keys.empty()) {
+      return result;
+    }
+
+    fmt::MemoryWriter select;
+    select << "SELECT " << join(names, ", ") << " FROM " << table
+           << where_key();
+    result = _connection->prepare(select.str(), &_select);
+    if (!result.is_ok()) {
+      return result;
+    }
+
+    if (!_values.empty()) {
+      fmt::MemoryWriter update;
+      update << "UPDATE " << table << " SET "
+             << join(column_names(_values), " = ?, ") << " = ?"
+             << where_key();
+      result = _connection->prepare(update.str(), &_update);
+      if (!result.is_ok()) {
+        return result;
+      }
+    }
+
+    fmt::MemoryWriter remove;
+    remove << "DELETE FROM " << table << where_key();
+    return _connection->prepare(remove.str(), &_remove);
+  }
+
+  Status insert(const Row &row) {
+    auto result = check(_insert, _insertable, row);
+    if (result.is_ok()) {
+      result = AppenderBase::bind_values(*_insert, _insertable, row);
+    }
+    if (result.is_ok()) {
+      result = _insert->execute();
+    }
+    return result;
+  }
+
+  Status find(const Key &key, const std::function<void(const RowView &)> &fn) {
+    if (fn == nullptr) {
+      return Status::invalid_argument();
+    }
+
+    auto result = check(_select, _keys, key);
+    if (result.is_ok()) {
+      result = AppenderBase::bind_values(*_select, _keys, key);
+    }
+    if (result.is_ok()) {
+      result = _select->execute_for_each(fn);
+    }
+    return result;
+  }
+
+  Status update(const Key &key, const Row &values) {
+    auto result = check(_update, _values, values);
+    if (result.is_ok()) {
+      result = check(_update, _keys, key);
+    }
+    if (result.is_ok()) {
+      result = AppenderBase::bind_values(*_update, _values, values);
+    }
+    if (result.is_ok()) {
+      result = AppenderBase::bind_values(*_update, _keys, key,
+                                         static_cast<int>(_values.size()));
+    }
+    if (result.is_ok()) {
+      result = _update->execute();
+    }
+    return result;
+  }
+
+  Status remove(const Key &key) {
+    auto result = check(_remove, _keys, key);
+    if (result.is_ok()) {
+      result = AppenderBase::bind_values(*_remove, _keys, key);
+    }
+    if (result.is_ok()) {
+      result = _remove->execute();
+    }
+    return result;
+  }
+
+ private:
+  ConnectionInterface *_connection = nullptr;
+  std::shared_ptr<Schema> _schema;
+  std::vector<Column> _insertable;
+  std::vector<Column> _keys;
+  std::vector<Column> _values;
+  std::shared_ptr<PreparedStatement> _insert;
+  std::shared_ptr<PreparedStatement> _select;
+  std::shared_ptr<PreparedStatement> _update;
+  std::shared_ptr<PreparedStatement> _remove;
+
+  // fails when open() has not prepared the statement, e.g. without a key
+  static Status check(const std::shared_ptr<PreparedStatement> &statement,
+                      const std::vector<Column> &columns, const Row &row) {
+    if (statement == nullptr) {
+      return Status::invalid_argument("statement is not prepared");
+    }
+    if (row.size() != columns.size()) {
+      return Status::invalid_argument(fmt::format(
+          "expected {} values, got {}", columns.size(), row.size()));
+    }
+    return Status::ok();
+  }
+
+  std::string insert_sql(const std::string &table) const {
+    fmt::MemoryWriter buf;
+    if (_insertable.empty()) {
+      // every column is auto-increment: "() VALUES ()" is MySQL only and
+      // "DEFAULT VALUES" SQLite only, but both generate a value for NULL
+      std::string generated;
+      _schema->each_define([&](const Schema::ColumnType &def) {
+        if (generated.empty()) {
+          generated = std::get<Schema::kColumnName>(def);
+        }
+      });
+      buf << "INSERT INTO " << table << " (" << generated << ") VALUES (NULL)";
+      return buf.str();
+    }
+    buf << "INSERT INTO " << table << " ("
+        << join(column_names(_insertable), ", ") << ") VALUES (";
+    for (std::size_t i = 0; i < _insertable.size(); i++) {
+      buf << ((0 < i) ? ", ?" : "?");
+    }
+    buf << ")";
+    return buf.str();
+  }
+
+  // " WHERE a = ? AND b = ?"
+  std::string where_key() const {
+    return fmt::format(" WHERE {} = ?", join(column_names(_keys), " = ? AND "));
+  }
+
+  static std::vector<std::string> column_names(
+      const std::vector<Column> &columns) {
+    std::vector<std::string> names;
+    for (auto &column : columns) {
+      names.push_back(column.name);
+    }
+    return names;
+  }
+
+  static std::string join(const std::vector<std::string> &names,
+                          const char *separator) {
+    std::string joined;
+    for (std::size_t i = 0; i < names.size(); i++) {
+      if (0 < i) {
+        joined += separator;
+      }
+      joined += names[i];
+    }
+    return joined;
+  }
+};
+
+Table::Table(ConnectionInterface *connection, std::shared_ptr<Schema> schema)
+    : _impl(new Impl(connection, schema)) {}
+
+Table::~Table() = default;
+
+Status Table::open() { return _impl->open(); }
+
+Status Table::insert(const Row &row) { return _impl->insert(row); }
+
+Status Table::find(const Key &key,
+                   const std::function<void(const RowView &)> &fn) {
+  return _impl->find(key, fn);
+}
+
+Status Table::update(const Key &key, const Row &values) {
+  return _impl->update(key, values);
+}
+
+Status Table::remove(const Key &key) { return _impl->remove(key); }
+
+}  // ookoto